@@ -147,6 +147,11 @@ Options: Metrics:\n\
   --force-metric       Force hpcprof to show all thread-level metrics,\n\
                        regardless of their number.\n\
 \n\
+Options: Performance:\n\
+  -j <n>, --jobs <n>   Read and merge profiles with <n> threads. Use all\n\
+                       online processors if <n> is 0. {1}\n\
+                       hpcprof-mpi does not use this option.\n\
+\n\
 Options: Output:\n\
   -o <db-path>, --db <db-path>, --output <db-path>\n\
                        Specify Experiment database name <db-path>.\n\
@@ -197,6 +202,10 @@ CmdLineParser::OptArgDesc Analysis::ArgsHPCProf::optArgs[] = {
   {  0 , "force-metric",    CLP::ARG_NONE, CLP::DUPOPT_CLOB, NULL,
      NULL },
 
+  // Performance
+  { 'j', "jobs",            CLP::ARG_REQ,  CLP::DUPOPT_CLOB, NULL,
+     NULL },
+
   // Output options
   { 'o', "output",          CLP::ARG_REQ , CLP::DUPOPT_CLOB, NULL,
      NULL },
@@ -393,7 +402,8 @@ ArgsHPCProf::parse(int argc, const char* const argv[])
 	parseArg_metric(metricVec[i], "--metric/-M option");
       }
     }
-    // N.B.: hpcprof checks for "force-metric": src/tool/hpcprof/Args.cpp
+    // N.B.: hpcprof checks for "force-metric" and "jobs":
+    // src/tool/hpcprof/Args.cpp
     
     // Check for other options: Output options
     bool isDbDirSet = false;
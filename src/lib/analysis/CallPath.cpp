@@ -72,8 +72,11 @@ using std::string;
 #include <cstring>
 
 #include <typeinfo>
+#include <vector>
+#include <utility>
 
 #include <sys/stat.h>
+#include <pthread.h>
 
 //*************************** User Include Files ****************************
 
@@ -133,6 +136,12 @@ vdso_loadmodule(const char *pathname)
 }
 
 
+static Prof::CallPath::Profile*
+readParallel(const Analysis::Util::StringVec& profileFiles,
+	     const Analysis::Util::UIntVec* groupMap,
+	     int mergeTy, uint rFlags, uint mrgFlags, uint numThreads);
+
+
 namespace Analysis {
 
 namespace CallPath {
@@ -140,13 +149,18 @@ namespace CallPath {
 
 Prof::CallPath::Profile*
 read(const Util::StringVec& profileFiles, const Util::UIntVec* groupMap,
-     int mergeTy, uint rFlags, uint mrgFlags)
+     int mergeTy, uint rFlags, uint mrgFlags, uint numThreads)
 {
   // Special case
   if (profileFiles.empty()) {
     Prof::CallPath::Profile* prof = Prof::CallPath::Profile::make(rFlags);
     return prof;
   }
+
+  if (numThreads > 1 && profileFiles.size() > 1) {
+    return readParallel(profileFiles, groupMap, mergeTy, rFlags, mrgFlags,
+			numThreads);
+  }
   
   // General case
   uint groupId = (groupMap) ? (*groupMap)[0] : 0;
@@ -311,6 +325,245 @@ coalesceStmts(Prof::Struct::ANode* node)
 }
 
 
+//****************************************************************************
+// Reading profiles with several threads
+//****************************************************************************
+
+// A loop whose iterations [0, n) are shared by several threads.  The
+// first exception thrown by an iteration stops the loop and is
+// rethrown by the thread that runs it.
+struct ParallelLoop {
+  void (*body)(void* arg, uint i);
+  void* arg;
+  uint n;
+  uint next;
+  bool failed;
+  string error;
+  pthread_mutex_t lock;
+};
+
+
+static void*
+parallelLoopWorker(void* arg)
+{
+  ParallelLoop* loop = (ParallelLoop*)arg;
+
+  while (true) {
+    pthread_mutex_lock(&loop->lock);
+    uint i = loop->next++;
+    bool isDone = (i >= loop->n || loop->failed);
+    pthread_mutex_unlock(&loop->lock);
+    if (isDone) {
+      break;
+    }
+
+    bool isError = true;
+    string error;
+    try {
+      loop->body(loop->arg, i);
+      isError = false;
+    }
+    catch (const Diagnostics::Exception& x) {
+      error = x.what();
+    }
+    catch (const std::exception& x) {
+      error = x.what();
+    }
+    catch (...) {
+      error = "Unknown exception encountered!";
+    }
+
+    if (isError) {
+      pthread_mutex_lock(&loop->lock);
+      if (!loop->failed) {
+	loop->failed = true;
+	loop->error = error;
+      }
+      pthread_mutex_unlock(&loop->lock);
+    }
+  }
+  return NULL;
+}
+
+
+static void
+parallelLoop(uint numThreads, uint n, void (*body)(void*, uint), void* arg)
+{
+  numThreads = std::min(numThreads, n);
+  if (numThreads <= 1) {
+    for (uint i = 0; i < n; ++i) {
+      body(arg, i);
+    }
+    return;
+  }
+
+  ParallelLoop loop;
+  loop.body = body;
+  loop.arg = arg;
+  loop.n = n;
+  loop.next = 0;
+  loop.failed = false;
+  pthread_mutex_init(&loop.lock, NULL);
+
+  std::vector<pthread_t> threads(numThreads);
+  uint numStarted = 0;
+  for (uint t = 0; t < numThreads; ++t) {
+    if (pthread_create(&threads[numStarted], NULL, parallelLoopWorker,
+		       &loop) == 0) {
+      numStarted++;
+    }
+  }
+  DIAG_WMsgIf(numStarted < numThreads, "parallelLoop: started only "
+	      << numStarted << " of " << numThreads << " threads");
+
+  // without any thread, run the iterations here
+  if (numStarted == 0) {
+    parallelLoopWorker(&loop);
+  }
+  for (uint t = 0; t < numStarted; ++t) {
+    pthread_join(threads[t], NULL);
+  }
+  pthread_mutex_destroy(&loop.lock);
+
+  if (loop.failed) {
+    DIAG_Throw(loop.error);
+  }
+}
+
+
+struct ReadParallelArgs {
+  const Analysis::Util::StringVec* profileFiles;
+  const Analysis::Util::UIntVec* groupMap;
+  int mergeTy;
+  uint rFlags;
+  uint mrgFlags;
+  uint stride; // of the current level of the reduction tree
+
+  std::vector<Prof::CallPath::Profile*> profs;
+
+  // the metrics of each profile as read, for the perf event statistics
+  std::vector<Prof::Metric::Mgr*> stats;
+
+  // trace files to rewrite and their cp-id translations
+  std::vector<std::pair<string, const Prof::CallPath::Profile::CPIdMap*> >
+    traces;
+};
+
+
+static void
+readParallel_read(void* arg, uint i)
+{
+  ReadParallelArgs* args = (ReadParallelArgs*)arg;
+
+  uint groupId = (args->groupMap) ? (*args->groupMap)[i] : 0;
+  Prof::CallPath::Profile* prof =
+    Analysis::CallPath::read((*args->profileFiles)[i], groupId, args->rFlags);
+
+  Prof::Metric::Mgr* stats = new Prof::Metric::Mgr;
+  for (uint mId = 0; mId < prof->metricMgr()->size(); ++mId) {
+    stats->insert(prof->metricMgr()->metric(mId)->clone());
+  }
+
+  args->profs[i] = prof;
+  args->stats[i] = stats;
+}
+
+
+// merge the i-th pair of the current level of the reduction tree: the
+// right profile always goes into the left one, which keeps the metrics
+// in the order of 'profileFiles'
+static void
+readParallel_merge(void* arg, uint i)
+{
+  ReadParallelArgs* args = (ReadParallelArgs*)arg;
+
+  uint x = i * 2 * args->stride;
+  uint y = x + args->stride;
+
+  args->profs[x]->merge(*args->profs[y], args->mergeTy, args->mrgFlags);
+  delete args->profs[y];
+  args->profs[y] = NULL;
+}
+
+
+static void
+readParallel_fixTrace(void* arg, uint i)
+{
+  ReadParallelArgs* args = (ReadParallelArgs*)arg;
+  Prof::CallPath::Profile::fixTraceFile(args->traces[i].first,
+					*args->traces[i].second);
+}
+
+
+static Prof::CallPath::Profile*
+readParallel(const Analysis::Util::StringVec& profileFiles,
+	     const Analysis::Util::UIntVec* groupMap,
+	     int mergeTy, uint rFlags, uint mrgFlags, uint numThreads)
+{
+  uint numProfs = profileFiles.size();
+
+  ReadParallelArgs args;
+  args.profileFiles = &profileFiles;
+  args.groupMap = groupMap;
+  args.mergeTy = mergeTy;
+  args.rFlags = rFlags;
+  args.mrgFlags = mrgFlags;
+  args.profs.resize(numProfs, NULL);
+  args.stats.resize(numProfs, NULL);
+
+  // Trace files can only be rewritten once all cp-ids are known: a
+  // profile merged into another one may already be a merge of several.
+  if (mrgFlags & Prof::CCT::MrgFlg_NormalizeTraceFileY) {
+    args.mrgFlags |= Prof::CCT::MrgFlg_DeferTraceFix;
+  }
+
+  // -------------------------------------------------------
+  // 1. Read the profiles
+  // -------------------------------------------------------
+  parallelLoop(numThreads, numProfs, readParallel_read, &args);
+
+  // -------------------------------------------------------
+  // 2. Merge them in a reduction tree, one level at a time
+  // -------------------------------------------------------
+  for (uint stride = 1; stride < numProfs; stride *= 2) {
+    args.stride = stride;
+    uint numPairs = (numProfs + stride - 1) / (2 * stride);
+    parallelLoop(numThreads, numPairs, readParallel_merge, &args);
+  }
+
+  Prof::CallPath::Profile* prof = args.profs[0];
+
+  // -------------------------------------------------------
+  // 3. Finish as Analysis::CallPath::read() does, in file order
+  // -------------------------------------------------------
+  for (uint i = 0; i < numProfs; ++i) {
+    if (i > 0) {
+      prof->metricMgr()->mergePerfEventStatistics(args.stats[i]);
+    }
+    delete args.stats[i];
+
+    prof->addDirectory(profileFiles[i]);
+  }
+  prof->metricMgr()->mergePerfEventStatistics_finalize(numProfs);
+
+  // -------------------------------------------------------
+  // 4. Rewrite the trace files with their final cp-ids
+  // -------------------------------------------------------
+  Prof::CallPath::Profile::TraceCPIdMaps& traceCPIdMaps =
+    prof->traceCPIdMaps();
+  // N.B.: a trace without new cp-ids is still rewritten if it is in
+  // an older version (cf. fixTraceFile)
+  for (Prof::CallPath::Profile::TraceCPIdMaps::const_iterator it =
+	 traceCPIdMaps.begin(); it != traceCPIdMaps.end(); ++it) {
+    args.traces.push_back(std::make_pair(it->first, &it->second));
+  }
+  parallelLoop(numThreads, args.traces.size(), readParallel_fixTrace, &args);
+  traceCPIdMaps.clear();
+
+  return prof;
+}
+
+
 //****************************************************************************
 // Overlaying static structure on a CCT
 //****************************************************************************
@@ -1091,6 +1344,7 @@ makeDatabase(Prof::CallPath::Profile& prof, const Analysis::Args& args)
 				  args.searchPathTpls, db_dir);
 
   // 2. Copy trace files (if necessary)
+  prof.upgradeTraceFiles();
   Analysis::Util::copyTraceFiles(db_dir, prof.traceFileNameSet());
 
   // 3. Create 'experiment.xml' file
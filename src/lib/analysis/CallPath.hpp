@@ -94,9 +94,13 @@ extern std::ostream* dbgOs; // for parallel debugging
 //
 // ---------------------------------------------------------
 
+// read: Read 'profileFiles' and merge them into one profile.  If
+// 'numThreads' > 1, the profiles are read by that many threads and
+// merged pairwise in a reduction tree whose shape, and thus whose
+// result, only depends on the number of profiles.
 Prof::CallPath::Profile*
 read(const Util::StringVec& profileFiles, const Util::UIntVec* groupMap,
-     int mergeTy, uint rFlags = 0, uint mrgFlags = 0);
+     int mergeTy, uint rFlags = 0, uint mrgFlags = 0, uint numThreads = 1);
 
 Prof::CallPath::Profile*
 read(const char* prof_fnm, uint groupId, uint rFlags = 0);
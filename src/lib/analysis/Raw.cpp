@@ -186,10 +186,18 @@ Analysis::Raw::writeAsText_callpathTrace(const char* filenm)
 
     hpctrace_fmt_hdr_fprint(&hdr, stdout);
 
+    hpctrace_fmt_block_t blk;
+    hpctrace_fmt_block_init(&blk);
+
     // Read trace records and exit on EOF
     while ( !feof(fs) ) {
       hpctrace_fmt_datum_t datum;
-      ret = hpctrace_fmt_datum_fread(&datum, hdr.flags, fs);
+      if (hdr.flags.fields.isCompact) {
+	ret = hpctrace_fmt_block_datum_fread(&datum, hdr.flags, &blk, fs);
+      }
+      else {
+	ret = hpctrace_fmt_datum_fread(&datum, hdr.flags, fs);
+      }
       if (ret == HPCFMT_EOF) {
 	break;
       }
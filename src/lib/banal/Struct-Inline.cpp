@@ -111,8 +111,11 @@ static Symtab *the_symtab = NULL;
 
 static struct sigaction old_act_abrt;
 static struct sigaction old_act_segv;
-static sigjmp_buf jbuf;
-static int jbuf_active = 0;
+
+// per thread, with hpcstruct -j the queries come from several threads
+static __thread sigjmp_buf jbuf;
+static __thread int jbuf_active = 0;
+static __thread InlineCache * the_cache = NULL;
 
 static int num_queries = 0;
 static int num_errors = 0;
@@ -280,12 +283,42 @@ analyzeDemangle(VMA vma)
 }
 
 
+void
+setInlineCache(InlineCache * cache)
+{
+  the_cache = cache;
+}
+
+
+static bool
+analyzeAddrSymtab(InlineSeqn &nodelist, VMA addr);
+
 // Returns nodelist as a list of InlineNodes for the inlined sequence
 // at VMA addr.  The front of the list is the outermost frame, back is
 // innermost.
 //
 bool
 analyzeAddr(InlineSeqn &nodelist, VMA addr)
+{
+  if (the_cache == NULL) {
+    return analyzeAddrSymtab(nodelist, addr);
+  }
+
+  auto it = the_cache->find(addr);
+
+  if (it == the_cache->end()) {
+    bool ret = analyzeAddrSymtab(nodelist, addr);
+    (*the_cache)[addr] = make_pair(ret, nodelist);
+    return ret;
+  }
+
+  nodelist = it->second.second;
+  return it->second.first;
+}
+
+
+static bool
+analyzeAddrSymtab(InlineSeqn &nodelist, VMA addr)
 {
   FunctionBase *func, *parent;
   bool ret = false;
@@ -295,7 +328,7 @@ analyzeAddr(InlineSeqn &nodelist, VMA addr)
   }
   nodelist.clear();
 
-  num_queries++;
+  __sync_fetch_and_add(&num_queries, 1);
 
   if (sigsetjmp(jbuf, 1) == 0) {
     //
@@ -345,7 +378,7 @@ analyzeAddr(InlineSeqn &nodelist, VMA addr)
   }
   else {
     // error return
-    num_errors++;
+    __sync_fetch_and_add(&num_errors, 1);
     ret = false;
   }
   jbuf_active = 0;
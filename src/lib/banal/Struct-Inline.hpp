@@ -344,6 +344,13 @@ bool closeSymtab();
 
 bool analyzeAddr(InlineSeqn &nodelist, VMA addr);
 
+// Results of analyzeAddr() by address.  With a cache set, the calling
+// thread looks up and saves its results there, so that a group of
+// funcs can be analyzed again without repeating the symtab queries.
+typedef map <VMA, pair <bool, InlineSeqn> > InlineCache;
+
+void setInlineCache(InlineCache * cache);
+
 void
 addStmtToTree(TreeNode * root, HPC::StringTable & strTab, VMA vma,
 	      int len, string & filenm, SrcFile::ln line);
@@ -64,6 +64,7 @@
 //***************************************************************************
 
 #include <sys/types.h>
+#include <pthread.h>
 #include <string.h>
 #include <include/uint.h>
 
@@ -154,6 +155,14 @@ typedef map <Block *, bool> BlockSet;
 typedef map <VMA, HeaderInfo> HeaderList;
 typedef map <VMA, Region *> RegionMap;
 typedef vector <Statement::Ptr> StatementVector;
+typedef map <pair <VMA, SymtabAPI::Function *>, StatementVector> StmtCache;
+
+class GroupTask;
+class GroupQueue;
+
+// Results of getStatement() for the group being analyzed by the
+// calling thread, NULL if not saved.
+static __thread StmtCache * the_stmt_cache = NULL;
 
 static FileMap *
 makeSkeleton(CodeObject *, ProcNameMgr *, const string &, bool);
@@ -186,6 +195,24 @@ addGaps(FileInfo *, GroupInfo *, HPC::StringTable &);
 static void
 getStatement(StatementVector &, Offset, SymtabAPI::Function *);
 
+static void
+getStatementSymtab(StatementVector &, Offset, SymtabAPI::Function *);
+
+static GroupQueue *
+startGroupWorkers(Symtab *, FileMap *, int, bool);
+
+static void
+waitGroupTask(GroupQueue *, GroupTask *);
+
+static void
+mergeGroupTask(Symtab *, GroupTask *, HPC::StringTable &, bool);
+
+static void
+finishGroupWorkers(GroupQueue *);
+
+static void
+remapTree(TreeNode *, vector <long> &);
+
 static LoopInfo *
 findLoopHeader(FileInfo *, GroupInfo *, ParseAPI::Function *,
 	       TreeNode *, Loop *, const string &, HPC::StringTable &);
@@ -329,12 +356,92 @@ public:
 
 //----------------------------------------------------------------------
 
+// One group of funcs for hpcstruct -j.  A worker thread makes the
+// inline trees for the group with its own string table and saves its
+// symtab queries, in case the group has to be done again on the main
+// thread in mergeGroupTask().
+//
+class GroupTask {
+public:
+  FileInfo * finfo;
+  GroupInfo * ginfo;
+  HPC::StringTable * strTab;
+  StmtCache  stmtCache;
+  InlineCache  inlineCache;
+  bool  done;
+
+  GroupTask(FileInfo * fi, GroupInfo * gi)
+  {
+    finfo = fi;
+    ginfo = gi;
+    strTab = NULL;
+    done = false;
+  }
+};
+
+// The groups of one load module in output order, and the workers
+// that take them in that order.
+//
+class GroupQueue {
+public:
+  Symtab * symtab;
+  bool  fullGaps;
+  vector <GroupTask *> taskVec;
+  vector <pthread_t> threadVec;
+  long  next_task;
+  pthread_mutex_t  lock;
+  pthread_cond_t  cond;
+
+  GroupQueue(Symtab * sym, bool gaps)
+  {
+    symtab = sym;
+    fullGaps = gaps;
+    next_task = 0;
+    pthread_mutex_init(&lock, NULL);
+    pthread_cond_init(&cond, NULL);
+  }
+
+  ~GroupQueue()
+  {
+    for (auto tit = taskVec.begin(); tit != taskVec.end(); ++tit) {
+      delete *tit;
+    }
+    pthread_mutex_destroy(&lock);
+    pthread_cond_destroy(&cond);
+  }
+};
+
+//----------------------------------------------------------------------
+
+// Saved line map info from getStatementSymtab(), if the calling
+// thread has a cache, else query SymtabAPI directly.
+//
+static void
+getStatement(StatementVector & svec, Offset vma, SymtabAPI::Function * sym_func)
+{
+  if (the_stmt_cache == NULL) {
+    getStatementSymtab(svec, vma, sym_func);
+    return;
+  }
+
+  auto key = make_pair((VMA) vma, sym_func);
+  auto it = the_stmt_cache->find(key);
+
+  if (it == the_stmt_cache->end()) {
+    getStatementSymtab(svec, vma, sym_func);
+    (*the_stmt_cache)[key] = svec;
+    return;
+  }
+
+  svec = it->second;
+}
+
 // Line map info from SymtabAPI.  Try the Module associated with the
 // Symtab Function as a hint first, else look for other modules that
 // might contain vma.
 //
 static void
-getStatement(StatementVector & svec, Offset vma, SymtabAPI::Function * sym_func)
+getStatementSymtab(StatementVector & svec, Offset vma, SymtabAPI::Function * sym_func)
 {
   svec.clear();
 
@@ -375,13 +482,18 @@ getStatement(StatementVector & svec, Offset vma, SymtabAPI::Function * sym_func)
 // over functions, loops and blocks, make an internal inline tree and
 // write an hpcstruct file to 'outFile'.
 //
+// With numThreads > 1, the groups of funcs are analyzed on worker
+// threads and merged back in order, the output is the same as with
+// one thread.
+//
 void
 makeStructure(InputFile & inputFile,
 	      ostream * outFile,
 	      ostream * gapsFile,
 	      string gaps_filenm,
 	      bool ourDemangle,
-	      ProcNameMgr * procNmMgr)
+	      ProcNameMgr * procNmMgr,
+	      int numThreads)
 {
   ElfFileVector * elfFileVector = inputFile.fileVector();
   string & sfilename = inputFile.fileName();
@@ -432,6 +544,14 @@ makeStructure(InputFile & inputFile,
 
     Output::printLoadModuleBegin(outFile, elfFile->getFileName());
 
+    // start the worker threads for the groups, not for cuda
+    GroupQueue * queue = NULL;
+    long num_task = 0;
+
+    if (numThreads > 1 && ! cuda_file) {
+      queue = startGroupWorkers(symtab, fileMap, numThreads, gapsFile != NULL);
+    }
+
     // process the files in the skeleton map
     for (auto fit = fileMap->begin(); fit != fileMap->end(); ++fit) {
       FileInfo * finfo = fit->second;
@@ -446,6 +566,12 @@ makeStructure(InputFile & inputFile,
 	if (cuda_file) {
 	  doCudaList(symtab, finfo, ginfo, strTab);
 	}
+	else if (queue != NULL) {
+	  GroupTask * task = queue->taskVec[num_task++];
+
+	  waitGroupTask(queue, task);
+	  mergeGroupTask(symtab, task, strTab, gapsFile != NULL);
+	}
 	else {
 	  doFunctionList(symtab, finfo, ginfo, strTab, gapsFile != NULL);
 	}
@@ -467,6 +593,10 @@ makeStructure(InputFile & inputFile,
 
     Output::printLoadModuleEnd(outFile);
 
+    if (queue != NULL) {
+      finishGroupWorkers(queue);
+    }
+
     delete code_obj;
     delete code_src;
     Inline::closeSymtab();
@@ -477,6 +607,239 @@ makeStructure(InputFile & inputFile,
 
 //----------------------------------------------------------------------
 
+// Worker thread for hpcstruct -j.  Take the next group in the queue
+// and make its inline trees with a new string table.
+//
+static void *
+doGroupWorker(void * arg)
+{
+  GroupQueue * queue = (GroupQueue *) arg;
+  long num_tasks = queue->taskVec.size();
+  long num;
+
+  while ((num = __sync_fetch_and_add(&queue->next_task, 1)) < num_tasks) {
+    GroupTask * task = queue->taskVec[num];
+
+    // insert empty string "" first, as in makeStructure()
+    HPC::StringTable * strTab = new HPC::StringTable;
+    strTab->str2index("");
+
+    the_stmt_cache = &task->stmtCache;
+    Inline::setInlineCache(&task->inlineCache);
+
+    doFunctionList(queue->symtab, task->finfo, task->ginfo, *strTab,
+		   queue->fullGaps);
+
+    the_stmt_cache = NULL;
+    Inline::setInlineCache(NULL);
+
+    pthread_mutex_lock(&queue->lock);
+    task->strTab = strTab;
+    task->done = true;
+    pthread_cond_broadcast(&queue->cond);
+    pthread_mutex_unlock(&queue->lock);
+  }
+
+  return NULL;
+}
+
+// Make the tasks for all groups in the file map in the order that
+// makeStructure() prints them, and start up to numThreads workers.
+// If no thread starts, the main thread does the tasks itself in
+// waitGroupTask().
+//
+static GroupQueue *
+startGroupWorkers(Symtab * symtab, FileMap * fileMap, int numThreads,
+		  bool fullGaps)
+{
+  GroupQueue * queue = new GroupQueue(symtab, fullGaps);
+
+  for (auto fit = fileMap->begin(); fit != fileMap->end(); ++fit) {
+    FileInfo * finfo = fit->second;
+
+    for (auto git = finfo->groupMap.begin(); git != finfo->groupMap.end(); ++git) {
+      queue->taskVec.push_back(new GroupTask(finfo, git->second));
+    }
+  }
+
+  long num_threads = numThreads;
+
+  if (num_threads > (long) queue->taskVec.size()) {
+    num_threads = queue->taskVec.size();
+  }
+
+  for (long n = 0; n < num_threads; n++) {
+    pthread_t thread;
+
+    if (pthread_create(&thread, NULL, doGroupWorker, queue) != 0) {
+      break;
+    }
+    queue->threadVec.push_back(thread);
+  }
+
+  return queue;
+}
+
+// Wait for a worker to finish the task.
+//
+static void
+waitGroupTask(GroupQueue * queue, GroupTask * task)
+{
+  if (queue->threadVec.empty()) {
+    doGroupWorker(queue);
+  }
+
+  pthread_mutex_lock(&queue->lock);
+  while (! task->done) {
+    pthread_cond_wait(&queue->cond, &queue->lock);
+  }
+  pthread_mutex_unlock(&queue->lock);
+}
+
+// Move the inline trees of one group from the task's string table to
+// strTab.  The strings of the task's table are either already in
+// strTab or new and added at the end, in the task's order.  If that
+// makes the indices increasing, then every index comparison in
+// doFunctionList() gives the same answer for both tables and the
+// trees are the same as with one thread, so just renumber them.
+//
+// Otherwise, the order of the trees may depend on the indices, so
+// make the group again with strTab from the task's saved queries.
+//
+static void
+mergeGroupTask(Symtab * symtab, GroupTask * task, HPC::StringTable & strTab,
+	       bool fullGaps)
+{
+  HPC::StringTable * taskTab = task->strTab;
+  GroupInfo * ginfo = task->ginfo;
+  long size = taskTab->size();
+  long next_index = strTab.size();
+  long last_index = -1;
+  bool increasing = true;
+
+  for (long i = 0; i < size; i++) {
+    long index = strTab.find(taskTab->index2str(i));
+
+    if (index < 0) {
+      index = next_index++;
+    }
+    if (index <= last_index) {
+      increasing = false;
+      break;
+    }
+    last_index = index;
+  }
+
+  if (increasing) {
+    vector <long> indexMap(size);
+
+    for (long i = 0; i < size; i++) {
+      indexMap[i] = strTab.str2index(taskTab->index2str(i));
+    }
+
+    for (auto pit = ginfo->procMap.begin(); pit != ginfo->procMap.end(); ++pit) {
+      ProcInfo * pinfo = pit->second;
+
+      if (pinfo->root != NULL) {
+	remapTree(pinfo->root, indexMap);
+      }
+    }
+  }
+  else {
+    for (auto pit = ginfo->procMap.begin(); pit != ginfo->procMap.end(); ++pit) {
+      ProcInfo * pinfo = pit->second;
+
+      delete pinfo->root;
+      pinfo->root = NULL;
+    }
+    ginfo->gapSet.clear();
+
+    the_stmt_cache = &task->stmtCache;
+    Inline::setInlineCache(&task->inlineCache);
+
+    doFunctionList(symtab, task->finfo, ginfo, strTab, fullGaps);
+
+    the_stmt_cache = NULL;
+    Inline::setInlineCache(NULL);
+  }
+
+  delete taskTab;
+  task->strTab = NULL;
+  task->stmtCache.clear();
+  task->inlineCache.clear();
+}
+
+static void
+finishGroupWorkers(GroupQueue * queue)
+{
+  for (auto tit = queue->threadVec.begin(); tit != queue->threadVec.end(); ++tit) {
+    pthread_join(*tit, NULL);
+  }
+
+  delete queue;
+}
+
+static long
+remapIndex(long index, vector <long> & indexMap)
+{
+  if (index >= 0 && index < (long) indexMap.size()) {
+    return indexMap[index];
+  }
+  return index;
+}
+
+static void
+remapFLP(FLPIndex & flp, vector <long> & indexMap)
+{
+  flp.file_index = remapIndex(flp.file_index, indexMap);
+  flp.base_index = remapIndex(flp.base_index, indexMap);
+  flp.proc_index = remapIndex(flp.proc_index, indexMap);
+  flp.pretty_index = remapIndex(flp.pretty_index, indexMap);
+}
+
+// Renumber the string indices in the subtree 'node' from a task's
+// string table to the main one.  The order of the nodeMap keys is
+// the same after an increasing renumbering, so the map is rebuilt
+// with the same entries.
+//
+static void
+remapTree(TreeNode * node, vector <long> & indexMap)
+{
+  node->file_index = remapIndex(node->file_index, indexMap);
+
+  for (auto sit = node->stmtMap.begin(); sit != node->stmtMap.end(); ++sit) {
+    StmtInfo * sinfo = sit->second;
+
+    sinfo->file_index = remapIndex(sinfo->file_index, indexMap);
+    sinfo->base_index = remapIndex(sinfo->base_index, indexMap);
+  }
+
+  for (auto lit = node->loopList.begin(); lit != node->loopList.end(); ++lit) {
+    LoopInfo * linfo = *lit;
+
+    linfo->file_index = remapIndex(linfo->file_index, indexMap);
+    linfo->base_index = remapIndex(linfo->base_index, indexMap);
+
+    for (auto pit = linfo->path.begin(); pit != linfo->path.end(); ++pit) {
+      remapFLP(*pit, indexMap);
+    }
+    remapTree(linfo->node, indexMap);
+  }
+
+  NodeMap nodeMap;
+
+  for (auto nit = node->nodeMap.begin(); nit != node->nodeMap.end(); ++nit) {
+    FLPIndex flp = nit->first;
+
+    remapFLP(flp, indexMap);
+    remapTree(nit->second, indexMap);
+    nodeMap[flp] = nit->second;
+  }
+  node->nodeMap.swap(nodeMap);
+}
+
+//----------------------------------------------------------------------
+
 // codeMap is a map of all code regions from start vma to Region *.
 // Used to find the region containing a vma and thus the region's end.
 //
@@ -68,7 +68,8 @@ makeStructure(InputFile & inputFile,
 	      std::ostream * gapsFile,
 	      std::string gaps_filenm,
 	      bool ourDemangle,
-	      ProcNameMgr * procNameMgr = NULL);
+	      ProcNameMgr * procNameMgr = NULL,
+	      int numThreads = 1);
 
 } // namespace Struct
 } // namespace BAnal
@@ -201,6 +201,92 @@ hpcfmt_real8_fread(double* val, FILE* infs)
 }
 
 
+//***************************************************************************
+// Reader primitives for files mapped in memory
+//***************************************************************************
+
+// The unread part [pos, end) of a file mapped in memory.  The
+// hpcfmt_*_mread() functions decode the same big-endian data as their
+// hpcfmt_*_fread() counterparts, without a stdio call per byte.
+typedef struct hpcfmt_mbuf_t {
+  const unsigned char* pos;
+  const unsigned char* end;
+} hpcfmt_mbuf_t;
+
+
+static inline int
+hpcfmt_mbuf_check(const hpcfmt_mbuf_t* buf, size_t size)
+{
+  size_t avail = (size_t)(buf->end - buf->pos);
+  if (avail < size) {
+    return (avail == 0) ? HPCFMT_EOF : HPCFMT_ERR;
+  }
+  return HPCFMT_OK;
+}
+
+
+// decode big-endian values; the caller checks the bounds
+static inline uint16_t
+hpcfmt_be2_decode(const unsigned char* p)
+{
+  return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+
+static inline uint32_t
+hpcfmt_be4_decode(const unsigned char* p)
+{
+  return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16)
+    | ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+
+static inline uint64_t
+hpcfmt_be8_decode(const unsigned char* p)
+{
+  return ((uint64_t)hpcfmt_be4_decode(p) << 32) | hpcfmt_be4_decode(p + 4);
+}
+
+
+static inline int
+hpcfmt_int2_mread(uint16_t* val, hpcfmt_mbuf_t* buf)
+{
+  int ret = hpcfmt_mbuf_check(buf, sizeof(uint16_t));
+  if (ret != HPCFMT_OK) {
+    return ret;
+  }
+  *val = hpcfmt_be2_decode(buf->pos);
+  buf->pos += sizeof(uint16_t);
+  return HPCFMT_OK;
+}
+
+
+static inline int
+hpcfmt_int4_mread(uint32_t* val, hpcfmt_mbuf_t* buf)
+{
+  int ret = hpcfmt_mbuf_check(buf, sizeof(uint32_t));
+  if (ret != HPCFMT_OK) {
+    return ret;
+  }
+  *val = hpcfmt_be4_decode(buf->pos);
+  buf->pos += sizeof(uint32_t);
+  return HPCFMT_OK;
+}
+
+
+static inline int
+hpcfmt_int8_mread(uint64_t* val, hpcfmt_mbuf_t* buf)
+{
+  int ret = hpcfmt_mbuf_check(buf, sizeof(uint64_t));
+  if (ret != HPCFMT_OK) {
+    return ret;
+  }
+  *val = hpcfmt_be8_decode(buf->pos);
+  buf->pos += sizeof(uint64_t);
+  return HPCFMT_OK;
+}
+
+
 //***************************************************************************
 
 static inline int
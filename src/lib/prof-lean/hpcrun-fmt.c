@@ -611,7 +611,24 @@ hpcrun_fmt_loadmapEntry_free(loadmap_entry_t* x, hpcfmt_free_fn dealloc)
 // cct
 //***************************************************************************
 
- int
+// store one value of a sparse node, as a pair if the caller keeps the
+// sparse form, else at its metric id
+static inline void
+hpcrun_fmt_cct_node_set_sparse(hpcrun_fmt_cct_node_t* x, uint16_t mid,
+			       uint64_t val)
+{
+  if (!x->metric_ids) {
+    x->metrics[mid].bits = val;
+  }
+  else if (x->num_nz < x->num_metrics) {
+    x->metric_ids[x->num_nz] = mid;
+    x->metrics[x->num_nz].bits = val;
+    x->num_nz++;
+  }
+}
+
+
+int
 hpcrun_fmt_cct_node_fread(hpcrun_fmt_cct_node_t* x,
 			  epoch_flags_t flags, FILE* fs)
 {
@@ -631,6 +648,27 @@ hpcrun_fmt_cct_node_fread(hpcrun_fmt_cct_node_t* x,
     hpcrun_fmt_lip_fread(&x->lip, fs);
   }
 
+  if (flags.fields.isSparse) {
+    if (!x->metric_ids) {
+      memset(x->metrics, 0, x->num_metrics * sizeof(hpcrun_metricVal_t));
+    }
+    x->num_nz = 0;
+
+    uint16_t num_nz = 0;
+    HPCFMT_ThrowIfError(hpcfmt_int2_fread(&num_nz, fs));
+    for (int i = 0; i < num_nz; ++i) {
+      uint16_t mid = 0;
+      uint64_t val = 0;
+      HPCFMT_ThrowIfError(hpcfmt_int2_fread(&mid, fs));
+      HPCFMT_ThrowIfError(hpcfmt_int8_fread(&val, fs));
+      // values of metrics the caller did not ask for are dropped
+      if (mid < x->num_metrics) {
+	hpcrun_fmt_cct_node_set_sparse(x, mid, val);
+      }
+    }
+    return HPCFMT_OK;
+  }
+
   for (int i = 0; i < x->num_metrics; ++i) {
     HPCFMT_ThrowIfError(hpcfmt_int8_fread(&x->metrics[i].bits, fs));
   }
@@ -639,6 +677,80 @@ hpcrun_fmt_cct_node_fread(hpcrun_fmt_cct_node_t* x,
 }
 
 
+int
+hpcrun_fmt_cct_node_mread(hpcrun_fmt_cct_node_t* x,
+			  epoch_flags_t flags, hpcfmt_mbuf_t* buf)
+{
+  // fast path: the fixed-size part of a node is all there
+  if (!flags.fields.isLogicalUnwind
+      && hpcfmt_mbuf_check(buf, 4 + 4 + 2 + 8) == HPCFMT_OK) {
+    const unsigned char* p = buf->pos;
+    x->id        = hpcfmt_be4_decode(p);
+    x->id_parent = hpcfmt_be4_decode(p + 4);
+    x->as_info   = lush_assoc_info_NULL;
+    x->lm_id     = hpcfmt_be2_decode(p + 8);
+    x->lm_ip     = hpcfmt_be8_decode(p + 10);
+    buf->pos += 4 + 4 + 2 + 8;
+    lush_lip_init(&x->lip);
+  }
+  else {
+    int ret = hpcfmt_int4_mread(&x->id, buf);
+    if (ret != HPCFMT_OK) {
+      return ret;
+    }
+    HPCFMT_ThrowIfError(hpcfmt_int4_mread(&x->id_parent, buf));
+
+    x->as_info = lush_assoc_info_NULL;
+    if (flags.fields.isLogicalUnwind) {
+      HPCFMT_ThrowIfError(hpcfmt_int4_mread(&x->as_info.bits, buf));
+    }
+
+    HPCFMT_ThrowIfError(hpcfmt_int2_mread(&x->lm_id, buf));
+    HPCFMT_ThrowIfError(hpcfmt_int8_mread(&x->lm_ip, buf));
+
+    lush_lip_init(&x->lip);
+    if (flags.fields.isLogicalUnwind) {
+      HPCFMT_ThrowIfError(hpcrun_fmt_lip_mread(&x->lip, buf));
+    }
+  }
+
+  if (flags.fields.isSparse) {
+    if (!x->metric_ids) {
+      memset(x->metrics, 0, x->num_metrics * sizeof(hpcrun_metricVal_t));
+    }
+    x->num_nz = 0;
+
+    uint16_t num_nz = 0;
+    HPCFMT_ThrowIfError(hpcfmt_int2_mread(&num_nz, buf));
+    if (hpcfmt_mbuf_check(buf, num_nz * (2 + 8)) != HPCFMT_OK) {
+      return HPCFMT_ERR;
+    }
+    const unsigned char* p = buf->pos;
+    for (int i = 0; i < num_nz; ++i, p += 2 + 8) {
+      uint16_t mid = hpcfmt_be2_decode(p);
+      // values of metrics the caller did not ask for are dropped
+      if (mid < x->num_metrics) {
+	hpcrun_fmt_cct_node_set_sparse(x, mid, hpcfmt_be8_decode(p + 2));
+      }
+    }
+    buf->pos = p;
+    return HPCFMT_OK;
+  }
+
+  // dense metric values: one bounds check for the whole array
+  if (hpcfmt_mbuf_check(buf, x->num_metrics * sizeof(uint64_t)) != HPCFMT_OK) {
+    return HPCFMT_ERR;
+  }
+  const unsigned char* p = buf->pos;
+  for (int i = 0; i < x->num_metrics; ++i, p += sizeof(uint64_t)) {
+    x->metrics[i].bits = hpcfmt_be8_decode(p);
+  }
+  buf->pos = p;
+
+  return HPCFMT_OK;
+}
+
+
 int
 hpcrun_fmt_cct_node_fwrite(hpcrun_fmt_cct_node_t* x,
 			   epoch_flags_t flags, FILE* fs)
@@ -657,6 +769,26 @@ hpcrun_fmt_cct_node_fwrite(hpcrun_fmt_cct_node_t* x,
     HPCFMT_ThrowIfError(hpcrun_fmt_lip_fwrite(&x->lip, fs));
   }
 
+  if (flags.fields.isSparse) {
+    if (x->num_metrics > HPCRUN_FMT_SparseMetricsMax) {
+      return HPCFMT_ERR;
+    }
+
+    uint16_t num_nz = 0;
+    for (int i = 0; i < x->num_metrics; ++i) {
+      if (x->metrics[i].bits != 0) num_nz++;
+    }
+
+    HPCFMT_ThrowIfError(hpcfmt_int2_fwrite(num_nz, fs));
+    for (int i = 0; i < x->num_metrics; ++i) {
+      if (x->metrics[i].bits != 0) {
+	HPCFMT_ThrowIfError(hpcfmt_int2_fwrite((uint16_t)i, fs));
+	HPCFMT_ThrowIfError(hpcfmt_int8_fwrite(x->metrics[i].bits, fs));
+      }
+    }
+    return HPCFMT_OK;
+  }
+
   for (int i = 0; i < x->num_metrics; ++i) {
     HPCFMT_ThrowIfError(hpcfmt_int8_fwrite(x->metrics[i].bits, fs));
   }
@@ -665,6 +797,96 @@ hpcrun_fmt_cct_node_fwrite(hpcrun_fmt_cct_node_t* x,
 }
 
 
+// Nodes are encoded in big-endian order, field by field, into a small
+// staging buffer that is appended to the outbuf whenever it fills up,
+// so a node costs one or two copies instead of one stdio call per field.
+typedef struct cct_node_enc_t {
+  hpcio_outbuf_t* outbuf;
+  int ret;
+  size_t len;
+  unsigned char buf[1024];
+} cct_node_enc_t;
+
+
+static void
+cct_node_enc_flush(cct_node_enc_t* e)
+{
+  if (e->len > 0 && hpcio_outbuf_write(e->outbuf, e->buf, e->len) != e->len) {
+    e->ret = HPCFMT_ERR;
+  }
+  e->len = 0;
+}
+
+
+static void
+cct_node_enc_put(cct_node_enc_t* e, uint64_t val, int nbytes)
+{
+  if (e->len + nbytes > sizeof(e->buf)) {
+    cct_node_enc_flush(e);
+  }
+  for (int shift = 8 * (nbytes - 1); shift >= 0; shift -= 8) {
+    e->buf[e->len++] = (val >> shift) & 0xff;
+  }
+}
+
+
+// Append the cct node record to the outbuf.  The encoding is the same
+// as hpcrun_fmt_cct_node_fwrite().
+// Returns: HPCFMT_OK on success, else HPCFMT_ERR.
+int
+hpcrun_fmt_cct_node_outbuf(hpcrun_fmt_cct_node_t* x, epoch_flags_t flags,
+			   hpcio_outbuf_t* outbuf)
+{
+  cct_node_enc_t e;
+  e.outbuf = outbuf;
+  e.ret = HPCFMT_OK;
+  e.len = 0;
+
+  cct_node_enc_put(&e, x->id, 4);
+  cct_node_enc_put(&e, x->id_parent, 4);
+
+  if (flags.fields.isLogicalUnwind) {
+    cct_node_enc_put(&e, x->as_info.bits, 4);
+  }
+
+  cct_node_enc_put(&e, x->lm_id, 2);
+  cct_node_enc_put(&e, x->lm_ip, 8);
+
+  if (flags.fields.isLogicalUnwind) {
+    for (int i = 0; i < LUSH_LIP_DATA8_SZ; ++i) {
+      cct_node_enc_put(&e, x->lip.data8[i], 8);
+    }
+  }
+
+  if (flags.fields.isSparse) {
+    if (x->num_metrics > HPCRUN_FMT_SparseMetricsMax) {
+      return HPCFMT_ERR;
+    }
+
+    uint16_t num_nz = 0;
+    for (int i = 0; i < x->num_metrics; ++i) {
+      if (x->metrics[i].bits != 0) num_nz++;
+    }
+
+    cct_node_enc_put(&e, num_nz, 2);
+    for (int i = 0; i < x->num_metrics; ++i) {
+      if (x->metrics[i].bits != 0) {
+	cct_node_enc_put(&e, i, 2);
+	cct_node_enc_put(&e, x->metrics[i].bits, 8);
+      }
+    }
+  }
+  else {
+    for (int i = 0; i < x->num_metrics; ++i) {
+      cct_node_enc_put(&e, x->metrics[i].bits, 8);
+    }
+  }
+
+  cct_node_enc_flush(&e);
+  return e.ret;
+}
+
+
 int
 hpcrun_fmt_cct_node_fprint(hpcrun_fmt_cct_node_t* x, FILE* fs,
 			   epoch_flags_t flags, const metric_tbl_t* metricTbl,
@@ -733,6 +955,17 @@ hpcrun_fmt_lip_fread(lush_lip_t* x, FILE* fs)
 }
 
 
+int
+hpcrun_fmt_lip_mread(lush_lip_t* x, hpcfmt_mbuf_t* buf)
+{
+  for (int i = 0; i < LUSH_LIP_DATA8_SZ; ++i) {
+    HPCFMT_ThrowIfError(hpcfmt_int8_mread(&x->data8[i], buf));
+  }
+  
+  return HPCFMT_OK;
+}
+
+
 int
 hpcrun_fmt_lip_fwrite(lush_lip_t* x, FILE* fs)
 {
@@ -768,6 +1001,12 @@ const hpctrace_hdr_flags_t hpctrace_hdr_flags_NULL = {
   .bits = 0
 };
 
+const hpctrace_fmt_clock_t hpctrace_fmt_clock_USEC = {
+  .ticksPerSec = 1000000,
+  .tick0       = 0,
+  .ns0         = 0
+};
+
 
 int
 hpctrace_fmt_hdr_fread(hpctrace_fmt_hdr_t* hdr, FILE* infs)
@@ -801,6 +1040,16 @@ hpctrace_fmt_hdr_fread(hpctrace_fmt_hdr_t* hdr, FILE* infs)
     HPCFMT_ThrowIfError(hpcfmt_int8_fread(&(hdr->flags.bits), infs));
   }
 
+  hdr->clock = hpctrace_fmt_clock_USEC;
+  if (hdr->version > 1.01) {
+    HPCFMT_ThrowIfError(hpcfmt_int8_fread(&(hdr->clock.ticksPerSec), infs));
+    HPCFMT_ThrowIfError(hpcfmt_int8_fread(&(hdr->clock.tick0), infs));
+    HPCFMT_ThrowIfError(hpcfmt_int8_fread(&(hdr->clock.ns0), infs));
+    if (hdr->clock.ticksPerSec == 0) {
+      return HPCFMT_ERR;
+    }
+  }
+
   return HPCFMT_OK;
 }
 
@@ -808,18 +1057,22 @@ hpctrace_fmt_hdr_fread(hpctrace_fmt_hdr_t* hdr, FILE* infs)
 // Writer based on outbuf.
 // Returns: HPCFMT_OK on success, else HPCFMT_ERR.
 int
-hpctrace_fmt_hdr_outbuf(hpctrace_hdr_flags_t flags, hpcio_outbuf_t* outbuf)
+hpctrace_fmt_hdr_outbuf(hpctrace_hdr_flags_t flags,
+			const hpctrace_fmt_clock_t* clock, hpcio_outbuf_t* outbuf)
 {
   ssize_t ret;
 
-  const int bufSZ = sizeof(flags);
+  const int bufSZ = sizeof(flags) + sizeof(*clock);
   unsigned char buf[bufSZ];
 
-  uint64_t flag_bits = flags.bits;
+  uint64_t vals[4] = { flags.bits, clock->ticksPerSec, clock->tick0,
+		       clock->ns0 };
   int k = 0;
-  for (int shift = 56; shift >= 0; shift -= 8) {
-    buf[k] = (flag_bits >> shift) & 0xff;
-    k++;
+  for (int i = 0; i < 4; i++) {
+    for (int shift = 56; shift >= 0; shift -= 8) {
+      buf[k] = (vals[i] >> shift) & 0xff;
+      k++;
+    }
   }
 
   hpcio_outbuf_write(outbuf, HPCTRACE_FMT_Magic, HPCTRACE_FMT_MagicLen);
@@ -837,7 +1090,8 @@ hpctrace_fmt_hdr_outbuf(hpctrace_hdr_flags_t flags, hpcio_outbuf_t* outbuf)
 
 // N.B.: not async safe
 int
-hpctrace_fmt_hdr_fwrite(hpctrace_hdr_flags_t flags, FILE* fs)
+hpctrace_fmt_hdr_fwrite(hpctrace_hdr_flags_t flags,
+			const hpctrace_fmt_clock_t* clock, FILE* fs)
 {
   int nw;
 
@@ -852,6 +1106,10 @@ hpctrace_fmt_hdr_fwrite(hpctrace_hdr_flags_t flags, FILE* fs)
 
   HPCFMT_ThrowIfError(hpcfmt_int8_fwrite(flags.bits, fs));
 
+  HPCFMT_ThrowIfError(hpcfmt_int8_fwrite(clock->ticksPerSec, fs));
+  HPCFMT_ThrowIfError(hpcfmt_int8_fwrite(clock->tick0, fs));
+  HPCFMT_ThrowIfError(hpcfmt_int8_fwrite(clock->ns0, fs));
+
   return HPCFMT_OK;
 }
 
@@ -865,12 +1123,32 @@ hpctrace_fmt_hdr_fprint(hpctrace_fmt_hdr_t* hdr, FILE* fs)
   fprintf(fs, "  (version: %s)\n", hdr->versionStr);
   fprintf(fs, "  (endian: %c)\n", hdr->endian);
   fprintf(fs, "  (flags: 0x%"PRIx64")\n", hdr->flags.bits);
+  fprintf(fs, "  (clock: %"PRIu64" ticks/s, tick0: %"PRIu64", ns0: %"PRIu64")\n",
+	  hdr->clock.ticksPerSec, hdr->clock.tick0, hdr->clock.ns0);
   fprintf(fs, "]\n");
 
   return HPCFMT_OK;
 }
 
 
+uint64_t
+hpctrace_fmt_clock_to_ns(const hpctrace_fmt_clock_t* clock, uint64_t time)
+{
+  const uint64_t nsPerSec = 1000000000;
+  uint64_t hz = clock->ticksPerSec;
+
+  // split the scaling to avoid overflowing 64 bits on long runs
+  if (time >= clock->tick0) {
+    uint64_t d = time - clock->tick0;
+    return clock->ns0 + (d / hz) * nsPerSec + ((d % hz) * nsPerSec) / hz;
+  }
+  else {
+    uint64_t d = clock->tick0 - time;
+    return clock->ns0 - (d / hz) * nsPerSec - ((d % hz) * nsPerSec) / hz;
+  }
+}
+
+
 //***************************************************************************
 // [hpctrace] datum (trace record)
 //***************************************************************************
@@ -899,14 +1177,13 @@ hpctrace_fmt_datum_fread(hpctrace_fmt_datum_t* x, hpctrace_hdr_flags_t flags,
 }
 
 
-// Append the trace record to the outbuf.
-// Returns: HPCFMT_OK on success, else HPCFMT_ERR.
+// Encode the trace record into 'buf', which must hold at least
+// HPCTRACE_FMT_DatumMaxLen bytes.
+// Returns: the length of the record.
 int
-hpctrace_fmt_datum_outbuf(hpctrace_fmt_datum_t* x, hpctrace_hdr_flags_t flags,
-			  hpcio_outbuf_t* outbuf)
+hpctrace_fmt_datum_encode(hpctrace_fmt_datum_t* x, hpctrace_hdr_flags_t flags,
+			  unsigned char* buf)
 {
-  const int bufSZ = sizeof(hpctrace_fmt_datum_t);
-  unsigned char buf[bufSZ];
   int shift, k;
 
   k = 0;
@@ -931,6 +1208,19 @@ hpctrace_fmt_datum_outbuf(hpctrace_fmt_datum_t* x, hpctrace_hdr_flags_t flags,
     }
   }
 
+  return k;
+}
+
+
+// Append the trace record to the outbuf.
+// Returns: HPCFMT_OK on success, else HPCFMT_ERR.
+int
+hpctrace_fmt_datum_outbuf(hpctrace_fmt_datum_t* x, hpctrace_hdr_flags_t flags,
+			  hpcio_outbuf_t* outbuf)
+{
+  unsigned char buf[HPCTRACE_FMT_DatumMaxLen];
+  int k = hpctrace_fmt_datum_encode(x, flags, buf);
+
   if (hpcio_outbuf_write(outbuf, buf, k) != k) {
     return HPCFMT_ERR;
   }
@@ -966,6 +1256,180 @@ hpctrace_fmt_datum_fprint(hpctrace_fmt_datum_t* x, hpctrace_hdr_flags_t flags,
 }
 
 
+//***************************************************************************
+// [hpctrace] compact trace blocks
+//***************************************************************************
+
+static inline int
+varint_encode(uint64_t val, unsigned char* buf)
+{
+  int k = 0;
+  while (val >= 0x80) {
+    buf[k++] = (val & 0x7f) | 0x80;
+    val >>= 7;
+  }
+  buf[k++] = val;
+  return k;
+}
+
+
+// Returns: the number of bytes decoded, or 0 if the varint is
+// truncated or malformed.
+static inline int
+varint_decode(const unsigned char* buf, uint32_t len, uint64_t* val)
+{
+  uint64_t x = 0;
+  for (uint32_t k = 0; k < len && k < 10; k++) {
+    x |= ((uint64_t)(buf[k] & 0x7f)) << (7 * k);
+    if ((buf[k] & 0x80) == 0) {
+      *val = x;
+      return k + 1;
+    }
+  }
+  return 0;
+}
+
+
+static inline uint64_t
+zigzag_encode(int64_t x)
+{
+  return ((uint64_t)x << 1) ^ (uint64_t)(x >> 63);
+}
+
+
+static inline int64_t
+zigzag_decode(uint64_t x)
+{
+  return (int64_t)(x >> 1) ^ -(int64_t)(x & 1);
+}
+
+
+void
+hpctrace_fmt_block_init(hpctrace_fmt_block_t* blk)
+{
+  blk->time = 0;
+  blk->size = 0;
+  blk->numRecords = 0;
+  blk->lastTime = 0;
+  blk->pos = 0;
+  blk->numRead = 0;
+}
+
+
+bool
+hpctrace_fmt_block_append(hpctrace_fmt_block_t* blk, hpctrace_fmt_datum_t* x,
+			  hpctrace_hdr_flags_t flags)
+{
+  unsigned char rec[HPCTRACE_FMT_CompactDatumMaxLen];
+
+  if (blk->numRecords == 0) {
+    blk->time = x->time;
+    blk->lastTime = x->time;
+  }
+
+  int k = varint_encode(zigzag_encode((int64_t)(x->time - blk->lastTime)), rec);
+  k += varint_encode(x->cpId, rec + k);
+  if (flags.fields.isDataCentric) {
+    k += varint_encode(x->metricId, rec + k);
+  }
+
+  if (blk->size + k > HPCTRACE_FMT_BlockMaxLen) {
+    return false;
+  }
+
+  memcpy(blk->buf + HPCTRACE_FMT_BlockHeaderLen + blk->size, rec, k);
+  blk->size += k;
+  blk->numRecords++;
+  blk->lastTime = x->time;
+  return true;
+}
+
+
+int
+hpctrace_fmt_block_finish(hpctrace_fmt_block_t* blk)
+{
+  if (blk->numRecords == 0) {
+    return 0;
+  }
+
+  int shift, k = 0;
+  for (shift = 56; shift >= 0; shift -= 8) {
+    blk->buf[k++] = (blk->time >> shift) & 0xff;
+  }
+  for (shift = 24; shift >= 0; shift -= 8) {
+    blk->buf[k++] = (blk->size >> shift) & 0xff;
+  }
+  for (shift = 24; shift >= 0; shift -= 8) {
+    blk->buf[k++] = (blk->numRecords >> shift) & 0xff;
+  }
+
+  return HPCTRACE_FMT_BlockHeaderLen + blk->size;
+}
+
+
+int
+hpctrace_fmt_block_fwrite(hpctrace_fmt_block_t* blk, FILE* outfs)
+{
+  int len = hpctrace_fmt_block_finish(blk);
+  hpctrace_fmt_block_init(blk);
+  if (len == 0) {
+    return HPCFMT_OK;
+  }
+  return hpcfmt_fwrite(blk->buf, len, outfs);
+}
+
+
+int
+hpctrace_fmt_block_datum_fread(hpctrace_fmt_datum_t* x,
+			       hpctrace_hdr_flags_t flags,
+			       hpctrace_fmt_block_t* blk, FILE* fs)
+{
+  // skip to the next non-empty block
+  while (blk->numRead == blk->numRecords) {
+    int ret = hpcfmt_int8_fread(&(blk->time), fs);
+    if (ret != HPCFMT_OK) {
+      return ret; // can be HPCFMT_EOF
+    }
+    HPCFMT_ThrowIfError(hpcfmt_int4_fread(&(blk->size), fs));
+    HPCFMT_ThrowIfError(hpcfmt_int4_fread(&(blk->numRecords), fs));
+    if (blk->size > HPCTRACE_FMT_BlockMaxLen) {
+      return HPCFMT_ERR;
+    }
+    unsigned char* payload = blk->buf + HPCTRACE_FMT_BlockHeaderLen;
+    HPCFMT_ThrowIfError(hpcfmt_fread(payload, blk->size, fs));
+    blk->lastTime = blk->time;
+    blk->pos = 0;
+    blk->numRead = 0;
+  }
+
+  const unsigned char* p = blk->buf + HPCTRACE_FMT_BlockHeaderLen;
+  uint64_t val;
+  int k;
+
+  k = varint_decode(p + blk->pos, blk->size - blk->pos, &val);
+  if (k == 0) return HPCFMT_ERR;
+  blk->pos += k;
+  x->time = blk->lastTime + zigzag_decode(val);
+
+  k = varint_decode(p + blk->pos, blk->size - blk->pos, &val);
+  if (k == 0) return HPCFMT_ERR;
+  blk->pos += k;
+  x->cpId = (uint32_t)val;
+
+  x->metricId = HPCRUN_FMT_MetricId_NULL;
+  if (flags.fields.isDataCentric) {
+    k = varint_decode(p + blk->pos, blk->size - blk->pos, &val);
+    if (k == 0) return HPCFMT_ERR;
+    blk->pos += k;
+    x->metricId = (uint32_t)val;
+  }
+
+  blk->lastTime = x->time;
+  blk->numRead++;
+  return HPCFMT_OK;
+}
+
+
 //***************************************************************************
 // hpcprof-metricdb (located here for now)
 //***************************************************************************
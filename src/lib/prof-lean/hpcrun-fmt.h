@@ -111,7 +111,7 @@ static const char HPCPROF_TmpFnmSfx[] = "tmp";
 // N.B.: The header string is 24 bytes of character data
 
 static const char HPCRUN_FMT_Magic[]   = "HPCRUN-profile____"; // 18 bytes
-static const char HPCRUN_FMT_Version[] = "02.00";              // 5 bytes
+static const char HPCRUN_FMT_Version[] = "02.01";              // 5 bytes
 static const char HPCRUN_FMT_Endian[]  = "b";                  // 1 byte
 
 static const int HPCRUN_FMT_MagicLen   = (sizeof(HPCRUN_FMT_Magic) - 1);
@@ -120,7 +120,10 @@ static const int HPCRUN_FMT_EndianLen  = (sizeof(HPCRUN_FMT_Endian) - 1);
 
 
 // currently supported versions
+// - 2.00
+// - 2.01: epoch flag 'isSparse' (sparse cct node metrics)
 static const double HPCRUN_FMT_Version_20 = 2.0;
+static const double HPCRUN_FMT_Version_21 = 2.01;
 
 
 typedef struct hpcrun_fmt_hdr_t {
@@ -173,7 +176,8 @@ static const int  HPCRUN_FMT_EpochTagLen = (sizeof(HPCRUN_FMT_EpochTag) - 1);
 
 typedef struct epoch_flags_bitfield {
   bool isLogicalUnwind : 1;
-  uint64_t unused      : 63;
+  bool isSparse        : 1; // cct node metrics are (id, value) pairs
+  uint64_t unused      : 62;
 } epoch_flags_bitfield;
 
 
@@ -540,6 +544,12 @@ typedef struct hpcrun_fmt_cct_node_t {
   hpcfmt_uint_t num_metrics;
   hpcrun_metricVal_t* metrics;
 
+  // sparse metrics: if the reader provides 'metric_ids' (room for
+  // 'num_metrics' ids), a sparse node is read as 'num_nz' pairs
+  // (metric_ids[k], metrics[k]) instead of 'num_metrics' values.
+  uint16_t num_nz;
+  uint16_t* metric_ids;
+
 } hpcrun_fmt_cct_node_t;
 
 
@@ -550,15 +560,33 @@ hpcrun_fmt_cct_node_init(hpcrun_fmt_cct_node_t* x)
 }
 
 
+// Sparse encoding (epoch flag 'isSparse'): instead of 'num_metrics'
+// values, a node lists its non-zero metrics as
+//   (count: int2) [(metric-id: int2) (value: int8)]*count
+// 'num_metrics' must then be at most HPCRUN_FMT_SparseMetricsMax.
+// The readers expand the pairs into 'metrics' unless 'metric_ids' is
+// set; fwrite and fprint always take one value per metric.
+#define HPCRUN_FMT_SparseMetricsMax (0xFFFF)
+
 // N.B.: assumes space for metrics has been allocated
 extern int
 hpcrun_fmt_cct_node_fread(hpcrun_fmt_cct_node_t* x,
 			  epoch_flags_t flags, FILE* fs);
 
+// the same, decoding a node of a profile mapped in memory
+extern int
+hpcrun_fmt_cct_node_mread(hpcrun_fmt_cct_node_t* x,
+			  epoch_flags_t flags, hpcfmt_mbuf_t* buf);
+
 extern int
 hpcrun_fmt_cct_node_fwrite(hpcrun_fmt_cct_node_t* x,
 			   epoch_flags_t flags, FILE* fs);
 
+// append the node to a buffered descriptor (same encoding as fwrite)
+extern int
+hpcrun_fmt_cct_node_outbuf(hpcrun_fmt_cct_node_t* x, epoch_flags_t flags,
+			   hpcio_outbuf_t* outbuf);
+
 extern int
 hpcrun_fmt_cct_node_fprint(hpcrun_fmt_cct_node_t* x, FILE* fs,
 			   epoch_flags_t flags, const metric_tbl_t* metricTbl,
@@ -572,6 +600,9 @@ hpcrun_fmt_cct_node_fprint(hpcrun_fmt_cct_node_t* x, FILE* fs,
 extern int
 hpcrun_fmt_lip_fread(lush_lip_t* x, FILE* fs);
 
+extern int
+hpcrun_fmt_lip_mread(lush_lip_t* x, hpcfmt_mbuf_t* buf);
+
 extern int
 hpcrun_fmt_lip_fwrite(lush_lip_t* x, FILE* fs);
 
@@ -590,15 +621,17 @@ hpcrun_fmt_lip_fprint(lush_lip_t* x, FILE* fs, const char* pre);
 // Header sizes:
 // - version 1.00: 24 bytes
 // - version 1.01: 32 bytes: 24 + sizeof(hpctrace_hdr_flags_t)
+// - version 1.02: 56 bytes: 32 + sizeof(hpctrace_fmt_clock_t)
 
 static const char HPCTRACE_FMT_Magic[]   = "HPCRUN-trace______"; // 18 bytes
-static const char HPCTRACE_FMT_Version[] = "01.01";              // 5 bytes
+static const char HPCTRACE_FMT_Version[] = "01.02";              // 5 bytes
 static const char HPCTRACE_FMT_Endian[]  = "b";                  // 1 byte
 
 
 typedef struct hpctrace_hdr_flags_bitfield {
   bool isDataCentric : 1;
-  uint64_t unused    : 63;
+  bool isCompact     : 1; // records are in blocks; cf. hpctrace_fmt_block_t
+  uint64_t unused    : 62;
 } hpctrace_hdr_flags_bitfield;
 
 
@@ -610,21 +643,39 @@ typedef union hpctrace_hdr_flags_t {
 extern const hpctrace_hdr_flags_t hpctrace_hdr_flags_NULL;
 
 
+// Clock calibration: trace record times are in 'ticks' of the clock
+// used by hpcrun (gettimeofday, TSC, perf sample time).  A time 't'
+// maps to nanoseconds since the epoch as
+//   ns = ns0 + (t - tick0) * 10^9 / ticksPerSec
+// Files older than version 1.02 are in microseconds, which is the
+// calibration hpctrace_fmt_clock_USEC.
+typedef struct hpctrace_fmt_clock_t {
+  uint64_t ticksPerSec;
+  uint64_t tick0;
+  uint64_t ns0;
+} hpctrace_fmt_clock_t;
+
+extern const hpctrace_fmt_clock_t hpctrace_fmt_clock_USEC;
+
+
 #define HPCTRACE_FMT_MagicLenX   (sizeof(HPCTRACE_FMT_Magic) - 1)
 #define HPCTRACE_FMT_VersionLenX (sizeof(HPCTRACE_FMT_Version) - 1)
 #define HPCTRACE_FMT_EndianLenX  (sizeof(HPCTRACE_FMT_Endian) - 1)
 #define HPCTRACE_FMT_FlagsLenX   (sizeof(hpctrace_hdr_flags_t))
+#define HPCTRACE_FMT_ClockLenX   (sizeof(hpctrace_fmt_clock_t))
 
 static const int HPCTRACE_FMT_MagicLen   = HPCTRACE_FMT_MagicLenX;
 static const int HPCTRACE_FMT_VersionLen = HPCTRACE_FMT_VersionLenX;
 static const int HPCTRACE_FMT_EndianLen  = HPCTRACE_FMT_EndianLenX;
 static const int HPCTRACE_FMT_FlagsLen   = HPCTRACE_FMT_FlagsLenX;
+static const int HPCTRACE_FMT_ClockLen   = HPCTRACE_FMT_ClockLenX;
 
 static const int HPCTRACE_FMT_HeaderLen =
   HPCTRACE_FMT_MagicLenX +
   HPCTRACE_FMT_VersionLenX +
   HPCTRACE_FMT_EndianLenX +
-  HPCTRACE_FMT_FlagsLenX;
+  HPCTRACE_FMT_FlagsLenX +
+  HPCTRACE_FMT_ClockLenX;
 
 
 typedef struct hpctrace_fmt_hdr_t {
@@ -636,6 +687,8 @@ typedef struct hpctrace_fmt_hdr_t {
 
   hpctrace_hdr_flags_t flags;
 
+  hpctrace_fmt_clock_t clock;
+
 } hpctrace_fmt_hdr_t;
 
 
@@ -643,15 +696,21 @@ int
 hpctrace_fmt_hdr_fread(hpctrace_fmt_hdr_t* hdr, FILE* infs);
 
 int
-hpctrace_fmt_hdr_outbuf(hpctrace_hdr_flags_t flags, hpcio_outbuf_t* outbuf);
+hpctrace_fmt_hdr_outbuf(hpctrace_hdr_flags_t flags,
+			const hpctrace_fmt_clock_t* clock, hpcio_outbuf_t* outbuf);
 
 // N.B.: not async safe
 int
-hpctrace_fmt_hdr_fwrite(hpctrace_hdr_flags_t flags, FILE* fs);
+hpctrace_fmt_hdr_fwrite(hpctrace_hdr_flags_t flags,
+			const hpctrace_fmt_clock_t* clock, FILE* fs);
 
 int
 hpctrace_fmt_hdr_fprint(hpctrace_fmt_hdr_t* hdr, FILE* fs);
 
+// Convert a trace record time to nanoseconds since the epoch.
+uint64_t
+hpctrace_fmt_clock_to_ns(const hpctrace_fmt_clock_t* clock, uint64_t time);
+
 
 //***************************************************************************
 // [hpctrace] trace record/datum
@@ -660,16 +719,23 @@ hpctrace_fmt_hdr_fprint(hpctrace_fmt_hdr_t* hdr, FILE* fs);
 #define HPCRUN_FMT_MetricId_NULL (INT_MAX) // for Java, no UINT32_MAX
 
 typedef struct hpctrace_fmt_datum_t {
-  uint64_t time; // microseconds
+  uint64_t time; // clock ticks; cf. hpctrace_fmt_clock_t
   uint32_t cpId; // call path id (CCT leaf id); cf. HPCRUN_FMT_CCTNodeId_NULL
   uint32_t metricId;
 } hpctrace_fmt_datum_t;
 
+// largest encoded record
+#define HPCTRACE_FMT_DatumMaxLen (sizeof(hpctrace_fmt_datum_t))
+
 
 int
 hpctrace_fmt_datum_fread(hpctrace_fmt_datum_t* x, hpctrace_hdr_flags_t flags,
 			 FILE* fs);
 
+int
+hpctrace_fmt_datum_encode(hpctrace_fmt_datum_t* x, hpctrace_hdr_flags_t flags,
+			  unsigned char* buf);
+
 int
 hpctrace_fmt_datum_outbuf(hpctrace_fmt_datum_t* x, hpctrace_hdr_flags_t flags,
 			  hpcio_outbuf_t* outbuf);
@@ -684,6 +750,67 @@ hpctrace_fmt_datum_fprint(hpctrace_fmt_datum_t* x, hpctrace_hdr_flags_t flags,
 			  FILE* fs);
 
 
+//***************************************************************************
+// [hpctrace] compact trace blocks
+//***************************************************************************
+
+// A compact trace (flags.fields.isCompact) is a sequence of blocks,
+// each starting with its index entry:
+//   (time:int8) (size:int4) (numRecords:int4)
+// 'time' is the time of the first record in the block and 'size' the
+// length of the payload that follows, so a reader can hop from entry
+// to entry to find a time without decoding records.  The payload
+// holds the records as LEB128 varints: the zigzag-encoded time delta
+// from the previous record (from 'time' for the first), the cpId and,
+// for data-centric traces, the metricId.
+
+#define HPCTRACE_FMT_BlockHeaderLen  (16)
+#define HPCTRACE_FMT_BlockMaxLen     (4096) // payload
+#define HPCTRACE_FMT_CompactDatumMaxLen (10 + 5 + 5)
+
+typedef struct hpctrace_fmt_block_t {
+  // index entry
+  uint64_t time;
+  uint32_t size;
+  uint32_t numRecords;
+
+  uint64_t lastTime; // time of the last record written/read
+  uint32_t pos;      // reader: payload bytes consumed
+  uint32_t numRead;  // reader: records decoded
+
+  // header followed by payload, as written
+  unsigned char buf[HPCTRACE_FMT_BlockHeaderLen + HPCTRACE_FMT_BlockMaxLen];
+} hpctrace_fmt_block_t;
+
+
+void
+hpctrace_fmt_block_init(hpctrace_fmt_block_t* blk);
+
+// Add a record to the block.  Returns false (leaving the block
+// unchanged) if it does not fit; the caller writes the block out and
+// retries.  Async safe.
+bool
+hpctrace_fmt_block_append(hpctrace_fmt_block_t* blk, hpctrace_fmt_datum_t* x,
+			  hpctrace_hdr_flags_t flags);
+
+// Fill in the index entry of the block.  Returns: the number of bytes
+// of blk->buf to write, or 0 if the block is empty.  Async safe.
+int
+hpctrace_fmt_block_finish(hpctrace_fmt_block_t* blk);
+
+// N.B.: not async safe; writes the block (if not empty) and resets it
+int
+hpctrace_fmt_block_fwrite(hpctrace_fmt_block_t* blk, FILE* outfs);
+
+// Read the next record of a compact trace, reading the next block
+// into 'blk' as needed.  'blk' must be initialized with
+// hpctrace_fmt_block_init.  Returns HPCFMT_EOF after the last record.
+int
+hpctrace_fmt_block_datum_fread(hpctrace_fmt_datum_t* x,
+			       hpctrace_hdr_flags_t flags,
+			       hpctrace_fmt_block_t* blk, FILE* fs);
+
+
 //***************************************************************************
 // hpcprof-metricdb (located here for now)
 //***************************************************************************
@@ -154,6 +154,11 @@ enum {
   // Instruct a merge function to only perform tree merges; tree
   // inserts are considered errors and throw an exception.
   MrgFlg_AssertCCTMergeOnly  = (1 << 2),
+
+  // With MrgFlg_NormalizeTraceFileY, instruct Profile::merge() to
+  // record the cp-id translations of y's trace files in x instead of
+  // rewriting them, so that y may itself be the result of merges.
+  MrgFlg_DeferTraceFix       = (1 << 4),
   
   // -------------------------------------------------------
   // *Private* CCT Merge flags
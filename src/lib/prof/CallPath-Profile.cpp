@@ -71,6 +71,7 @@ using std::dec;
 using std::string;
 
 #include <map>
+#include <vector>
 #include <algorithm>
 #include <sstream>
 
@@ -86,6 +87,8 @@ using std::string;
 
 #include <alloca.h>
 #include <linux/limits.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 
 
@@ -235,6 +238,10 @@ Profile::merge(Profile& y, int mergeTy, uint mrgFlag)
 
   x.m_profileFileName = "";
 
+  if ((mrgFlag & CCT::MrgFlg_DeferTraceFix) && !x.m_traceFileName.empty()) {
+    x.m_traceCPIdMaps[x.m_traceFileName]; // x's cp-ids are kept
+  }
+
   x.m_traceFileName = "";
   x.m_traceFileNameSet.insert(y.m_traceFileNameSet.begin(),
 			      y.m_traceFileNameSet.end());
@@ -273,7 +280,17 @@ Profile::merge(Profile& y, int mergeTy, uint mrgFlag)
 			     mrgFlag & CCT::MrgFlg_NormalizeTraceFileY),
 	      "CallPath::Profile::merge: there should only be CCT::MergeEffects when MrgFlg_NormalizeTraceFileY is passed");
 
-  y.merge_fixTrace(mrgEffects2);
+  if (mrgFlag & CCT::MrgFlg_DeferTraceFix) {
+    y.merge_deferTrace(mrgEffects2);
+    for (TraceCPIdMaps::iterator it = y.m_traceCPIdMaps.begin();
+	 it != y.m_traceCPIdMaps.end(); ++it) {
+      x.m_traceCPIdMaps[it->first].swap(it->second);
+    }
+    y.m_traceCPIdMaps.clear();
+  }
+  else {
+    y.merge_fixTrace(mrgEffects2);
+  }
   delete mrgEffects2;
 
   return firstMergedMetric;
@@ -384,40 +401,91 @@ Profile::merge_fixCCT(const std::vector<LoadMap::MergeEffect>* mrgEffects)
 void
 Profile::merge_fixTrace(const CCT::MergeEffectList* mrgEffects)
 {
-  typedef std::map<uint, uint> UIntToUIntMap;
-
   // early exit for trivial case
   if (m_traceFileName.empty()) {
     return;
   }
-  else if (!mrgEffects || mrgEffects->empty()) {
-    return; // rely on Analysis::Util::copyTraceFiles() to copy orig file
-  }
 
   // N.B.: We could build a map of old->new cpIds within
   // Profile::merge(), but the list of effects is more general and
   // extensible.  There are no asymptotic problems with building the
   // following map for local use.
-  UIntToUIntMap cpIdMap;
+  CPIdMap cpIdMap;
+  if (mrgEffects) {
+    for (CCT::MergeEffectList::const_iterator it = mrgEffects->begin();
+	 it != mrgEffects->end(); ++it) {
+      const CCT::MergeEffect& effct = *it;
+      cpIdMap.insert(std::make_pair(effct.old_cpId, effct.new_cpId));
+    }
+  }
+
+  fixTraceFile(m_traceFileName, cpIdMap);
+}
+
+
+// Compose the cp-id translations of y's trace files, which map the
+// original cp-ids of each trace file to cp-ids of y, with the merge
+// effects, which map cp-ids of y to cp-ids of the merged profile.
+void
+Profile::merge_deferTrace(const CCT::MergeEffectList* mrgEffects)
+{
+  if (!m_traceFileName.empty()) {
+    m_traceCPIdMaps[m_traceFileName]; // not translated yet
+  }
+
+  if (!mrgEffects || mrgEffects->empty()) {
+    return;
+  }
+
+  CPIdMap effctMap;
   for (CCT::MergeEffectList::const_iterator it = mrgEffects->begin();
        it != mrgEffects->end(); ++it) {
-    const CCT::MergeEffect& effct = *it;
-    cpIdMap.insert(std::make_pair(effct.old_cpId, effct.new_cpId));
+    effctMap.insert(std::make_pair(it->old_cpId, it->new_cpId));
   }
 
+  for (TraceCPIdMaps::iterator it = m_traceCPIdMaps.begin();
+       it != m_traceCPIdMaps.end(); ++it) {
+    CPIdMap& cpIdMap = it->second;
+    CPIdMap newMap;
+
+    // 1. cp-ids already translated are translated again
+    for (CPIdMap::const_iterator it1 = cpIdMap.begin();
+	 it1 != cpIdMap.end(); ++it1) {
+      CPIdMap::const_iterator fnd = effctMap.find(it1->second);
+      uint cpId = (fnd != effctMap.end()) ? fnd->second : it1->second;
+      newMap.insert(newMap.end(), std::make_pair(it1->first, cpId));
+    }
+
+    // 2. other cp-ids are still the original ones
+    for (CPIdMap::const_iterator it1 = effctMap.begin();
+	 it1 != effctMap.end(); ++it1) {
+      if (cpIdMap.find(it1->first) == cpIdMap.end()) {
+	newMap.insert(*it1);
+      }
+    }
+
+    cpIdMap.swap(newMap);
+  }
+}
+
+
+void
+Profile::fixTraceFile(const std::string& traceFileName,
+		      const CPIdMap& cpIdMap)
+{
   // ------------------------------------------------------------
   // Rewrite trace file
   // ------------------------------------------------------------
   int ret;
 
-  DIAG_MsgIf(0, "Profile::merge_fixTrace: " << m_traceFileName);
+  DIAG_MsgIf(0, "Profile::fixTraceFile: " << traceFileName);
 
-  string traceFileNameTmp = m_traceFileName + "." + HPCPROF_TmpFnmSfx;
+  string traceFileNameTmp = traceFileName + "." + HPCPROF_TmpFnmSfx;
 
   char* infsBuf = new char[HPCIO_RWBufferSz];
   char* outfsBuf = new char[HPCIO_RWBufferSz];
 
-  const string& inFnm = m_traceFileName;
+  const string& inFnm = traceFileName;
   FILE* infs = hpcio_fopen_r(inFnm.c_str());
   if (!infs) {
     std::string errorString;
@@ -427,7 +495,7 @@ Profile::merge_fixTrace(const CCT::MergeEffectList* mrgEffects)
   }
 
   ret = setvbuf(infs, infsBuf, _IOFBF, HPCIO_RWBufferSz);
-  DIAG_AssertWarn(ret == 0, inFnm << ": Profile::merge_fixTrace: setvbuf!");
+  DIAG_AssertWarn(ret == 0, inFnm << ": Profile::fixTraceFile: setvbuf!");
 
   hpctrace_fmt_hdr_t hdr;
   ret = hpctrace_fmt_hdr_fread(&hdr, infs);
@@ -439,6 +507,16 @@ Profile::merge_fixTrace(const CCT::MergeEffectList* mrgEffects)
     return;
   }
 
+  // Without new cp-ids, rely on Analysis::Util::copyTraceFiles() to
+  // copy the orig file.  Older versions are still rewritten, since the
+  // experiment file gives one db-header-sz for all trace files.
+  if (cpIdMap.empty() && strcmp(hdr.versionStr, HPCTRACE_FMT_Version) == 0) {
+    hpcio_fclose(infs);
+    delete[] infsBuf;
+    delete[] outfsBuf;
+    return;
+  }
+
   const string& outFnm = traceFileNameTmp;
   FILE* outfs = hpcio_fopen_w(outFnm.c_str(), 1/*overwrite*/);
   if (!outfs) {
@@ -458,15 +536,31 @@ Profile::merge_fixTrace(const CCT::MergeEffectList* mrgEffects)
   }
 
   ret = setvbuf(outfs, outfsBuf, _IOFBF, HPCIO_RWBufferSz);
-  DIAG_AssertWarn(ret == 0, outFnm << ": Profile::merge_fixTrace: setvbuf!");
+  DIAG_AssertWarn(ret == 0, outFnm << ": Profile::fixTraceFile: setvbuf!");
+
+  // compact traces are re-encoded block by block: new cct ids may
+  // change the length of the records
+  hpctrace_fmt_block_t* inBlk = NULL;
+  hpctrace_fmt_block_t* outBlk = NULL;
+  if (hdr.flags.fields.isCompact) {
+    inBlk = new hpctrace_fmt_block_t;
+    outBlk = new hpctrace_fmt_block_t;
+    hpctrace_fmt_block_init(inBlk);
+    hpctrace_fmt_block_init(outBlk);
+  }
 
-  ret = hpctrace_fmt_hdr_fwrite(hdr.flags, outfs);
+  ret = hpctrace_fmt_hdr_fwrite(hdr.flags, &hdr.clock, outfs);
   if (ret == HPCFMT_ERR) goto badwrite;
 
   while ( !feof(infs) ) {
     // 1. Read trace record (exit on EOF)
     hpctrace_fmt_datum_t datum;
-    ret = hpctrace_fmt_datum_fread(&datum, hdr.flags, infs);
+    if (inBlk) {
+      ret = hpctrace_fmt_block_datum_fread(&datum, hdr.flags, inBlk, infs);
+    }
+    else {
+      ret = hpctrace_fmt_datum_fread(&datum, hdr.flags, infs);
+    }
     if (ret == HPCFMT_EOF) {
       break;
     } else if (ret == HPCFMT_ERR) {
@@ -474,13 +568,15 @@ Profile::merge_fixTrace(const CCT::MergeEffectList* mrgEffects)
       hpcio_fclose(infs);
       hpcio_fclose(outfs);
       unlink(outFnm.c_str()); // delete incomplete output file
+      delete inBlk;
+      delete outBlk;
       return;
     }
     
     // 2. Translate cct id
     uint cctId_old = datum.cpId;
     uint cctId_new = datum.cpId;
-    UIntToUIntMap::iterator it = cpIdMap.find(cctId_old);
+    CPIdMap::const_iterator it = cpIdMap.find(cctId_old);
     if (it != cpIdMap.end()) {
       cctId_new = it->second;
       DIAG_MsgIf(0, "  " << cctId_old << " -> " << cctId_new);
@@ -488,10 +584,27 @@ Profile::merge_fixTrace(const CCT::MergeEffectList* mrgEffects)
     datum.cpId = cctId_new;
 
     // 3. Write new trace record
-    ret = hpctrace_fmt_datum_fwrite(&datum, hdr.flags, outfs);
+    if (outBlk) {
+      if (!hpctrace_fmt_block_append(outBlk, &datum, hdr.flags)) {
+	ret = hpctrace_fmt_block_fwrite(outBlk, outfs);
+	if (ret == HPCFMT_ERR) goto badwrite;
+	hpctrace_fmt_block_append(outBlk, &datum, hdr.flags);
+      }
+    }
+    else {
+      ret = hpctrace_fmt_datum_fwrite(&datum, hdr.flags, outfs);
+      if (ret == HPCFMT_ERR) goto badwrite;
+    }
+  }
+
+  if (outBlk) {
+    ret = hpctrace_fmt_block_fwrite(outBlk, outfs);
     if (ret == HPCFMT_ERR) goto badwrite;
   }
 
+  delete inBlk;
+  delete outBlk;
+
   hpcio_fclose(infs);
   hpcio_fclose(outfs);
 
@@ -512,6 +625,23 @@ badwrite:
 }
 
 
+void
+Profile::upgradeTraceFiles() const
+{
+  for (StringSet::const_iterator it = m_traceFileNameSet.begin();
+       it != m_traceFileNameSet.end(); ++it) {
+    const string& traceFileName = *it;
+
+    // a trace file rewritten by a merge is already current
+    string traceFileNameTmp = traceFileName + "." + HPCPROF_TmpFnmSfx;
+    if (FileUtil::isReadable(traceFileNameTmp)) {
+      continue;
+    }
+    fixTraceFile(traceFileName, CPIdMap());
+  }
+}
+
+
 
 // ---------------------------------------------------
 // String comparison used for hash map
@@ -918,10 +1048,32 @@ Profile::ddump() const
 // 
 //***************************************************************************
 
+// How cct_makeNode converts the metric values of the nodes of a profile:
+// worked out once per profile instead of once per node.
+struct CCTMetricSrc {
+  bool doZeroMetrics;
+  std::vector<uint>   srcId;  // source metric of each destination metric
+  std::vector<bool>   isReal;
+  std::vector<double> period;
+
+  // for sparse nodes: the destination metrics of each source metric,
+  // and the destination metrics set in 'metricData' by the last node
+  std::vector<std::vector<uint> > dstIds;
+  std::vector<uint>   dstSet;
+
+  // scratch metric values, reused for every node
+  Prof::Metric::IData metricData;
+  Prof::Metric::IData metricZeros;
+};
+
+static void
+cct_initMetricSrc(CCTMetricSrc& msrc, Prof::CallPath::Profile& prof,
+		  uint rFlags);
+
 static std::pair<Prof::CCT::ADynNode*, Prof::CCT::ADynNode*>
 cct_makeNode(Prof::CallPath::Profile& prof,
 	     const hpcrun_fmt_cct_node_t& nodeFmt, uint rFlags,
-	     const std::string& ctxtStr);
+	     CCTMetricSrc& msrc, const std::string& ctxtStr);
 
 static void
 fmt_cct_makeNode(hpcrun_fmt_cct_node_t& n_fmt, const Prof::CCT::ANode& n,
@@ -975,9 +1127,32 @@ Profile::make(const char* fnm, uint rFlags, FILE* outfs)
 
   rFlags |= RFlg_HpcrunData; // TODO: for now assume an hpcrun file (verify!)
 
+  // Map the file so that the CCT, by far its largest part, is decoded
+  // without a stdio call per field.  If the file cannot be mapped, it
+  // is read through 'fs' alone.
+  hpcfmt_mbuf_t inmap;
+  const hpcfmt_mbuf_t* inmapPtr = NULL;
+  void* addr = MAP_FAILED;
+  size_t len = 0;
+
+  struct stat st;
+  if (fstat(fileno(fs), &st) == 0 && st.st_size > 0) {
+    len = st.st_size;
+    addr = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fileno(fs), 0);
+  }
+  if (addr != MAP_FAILED) {
+    madvise(addr, len, MADV_SEQUENTIAL);
+    inmap.pos = (const unsigned char*)addr;
+    inmap.end = inmap.pos + len;
+    inmapPtr = &inmap;
+  }
+
   Profile* prof = NULL;
-  ret = fmt_fread(prof, fs, rFlags, fnm, fnm, outfs);
-  
+  ret = fmt_fread(prof, fs, rFlags, fnm, fnm, outfs, inmapPtr);
+
+  if (addr != MAP_FAILED) {
+    munmap(addr, len);
+  }
   hpcio_fclose(fs);
 
   delete[] fsBuf;
@@ -988,7 +1163,8 @@ Profile::make(const char* fnm, uint rFlags, FILE* outfs)
 
 int
 Profile::fmt_fread(Profile* &prof, FILE* infs, uint rFlags,
-		   std::string ctxtStr, const char* filename, FILE* outfs)
+		   std::string ctxtStr, const char* filename, FILE* outfs,
+		   const hpcfmt_mbuf_t* inmap)
 {
   int ret;
 
@@ -1002,7 +1178,8 @@ Profile::fmt_fread(Profile* &prof, FILE* infs, uint rFlags,
 	    "is not a profile or it is corrupted\n", filename);
     prof_abort(-1);
   }
-  if ( !(hdr.version >= HPCRUN_FMT_Version_20) ) {
+  if ( !(hdr.version >= HPCRUN_FMT_Version_20)
+       || hdr.version > HPCRUN_FMT_Version_21 ) {
     DIAG_Throw("unsupported file version '" << hdr.versionStr << "'");
   }
 
@@ -1027,7 +1204,7 @@ Profile::fmt_fread(Profile* &prof, FILE* infs, uint rFlags,
 
     try {
       ret = fmt_epoch_fread(myprof, infs, rFlags, hdr,
-			    ctxtStr, filename, outfs);
+			    ctxtStr, filename, outfs, inmap);
       if (ret == HPCFMT_EOF) {
 	break;
       }
@@ -1072,7 +1249,7 @@ int
 Profile::fmt_epoch_fread(Profile* &prof, FILE* infs, uint rFlags,
 			 const hpcrun_fmt_hdr_t& hdr,
 			 std::string ctxtStr, const char* filename,
-			 FILE* outfs)
+			 FILE* outfs, const hpcfmt_mbuf_t* inmap)
 {
   using namespace Prof;
 
@@ -1411,7 +1588,7 @@ Profile::fmt_epoch_fread(Profile* &prof, FILE* infs, uint rFlags,
   // ------------------------------------------------------------
   // cct
   // ------------------------------------------------------------
-  fmt_cct_fread(*prof, infs, rFlags, metricTbl, ctxtStr, outfs);
+  fmt_cct_fread(*prof, infs, rFlags, metricTbl, ctxtStr, outfs, inmap);
 
 
   hpcrun_fmt_epochHdr_free(&ehdr, free);
@@ -1421,17 +1598,183 @@ Profile::fmt_epoch_fread(Profile* &prof, FILE* infs, uint rFlags,
 }
 
 
+// Maps the ids of the CCT nodes of a profile being read to their nodes.
+// hpcrun draws the ids of all threads from one counter, so the ids of
+// one profile are sparse; an open-addressing table sized from the
+// number of nodes avoids the rebalancing and allocations of a std::map.
+class CCTIdToCCTNodeMap {
+public:
+  CCTIdToCCTNodeMap(uint64_t numNodes)
+    : m_size(0)
+  {
+    // the number of nodes comes from the file: grow from a sane size
+    size_t sz = 16;
+    while (sz < 2 * numNodes && sz < ((size_t)1 << 24)) {
+      sz *= 2;
+    }
+    m_entries.resize(sz);
+  }
+
+  // N.B.: like std::map::insert, an existing entry is not replaced
+  void
+  insert(int id, Prof::CCT::ANode* node)
+  {
+    Entry& e = m_entries[slot(id)];
+    if (e.id == HPCRUN_FMT_CCTNodeId_NULL) {
+      e.id = id;
+      e.node = node;
+      if (++m_size > m_entries.size() / 2) {
+	grow();
+      }
+    }
+  }
+
+  Prof::CCT::ANode*
+  find(int id) const
+  {
+    const Entry& e = m_entries[slot(id)];
+    return (e.id == id) ? e.node : NULL;
+  }
+
+private:
+  struct Entry {
+    Entry() : id(HPCRUN_FMT_CCTNodeId_NULL), node(NULL) { }
+    int id; // HPCRUN_FMT_CCTNodeId_NULL marks an empty entry
+    Prof::CCT::ANode* node;
+  };
+
+  // the entry of 'id' or the empty entry where it would go
+  size_t
+  slot(int id) const
+  {
+    size_t mask = m_entries.size() - 1;
+    size_t i = ((uint32_t)id * 2654435761u) & mask;
+    while (m_entries[i].id != id
+	   && m_entries[i].id != HPCRUN_FMT_CCTNodeId_NULL) {
+      i = (i + 1) & mask;
+    }
+    return i;
+  }
+
+  void
+  grow()
+  {
+    std::vector<Entry> old;
+    old.swap(m_entries);
+    m_entries.resize(2 * old.size());
+    for (size_t i = 0; i < old.size(); i++) {
+      if (old[i].id != HPCRUN_FMT_CCTNodeId_NULL) {
+	m_entries[slot(old[i].id)] = old[i];
+      }
+    }
+  }
+
+  std::vector<Entry> m_entries;
+  size_t m_size;
+};
+
+
+// A metric whose value hpcrun gives as a formula over the other metrics
+struct MetricFormula {
+  uint metricId;
+  ExprEvalCode code;
+
+  // true if evaluating the formula cannot change a node whose inputs
+  // (including the metric itself) are all zero
+  bool zeroInputsNoop;
+};
+
+
+// a variable map where every metric is zero
+class ZeroVarMap : public BaseVarMap {
+public:
+  ZeroVarMap(BaseVarMap* vars) : m_vars(vars) { }
+
+  bool   isVariable(char *expr) { return m_vars->isVariable(expr); }
+  double getValue(unsigned int var) { return 0; }
+  int    getErrorCode() { return 0; }
+
+private:
+  BaseVarMap* m_vars;
+};
+
+
+static void
+compileMetricFormulas(metric_desc_t* m_lst, uint numMetrics, VarMap* var_map,
+		      std::vector<MetricFormula>& formulas)
+{
+  ExprEval eval;
+
+  for (uint i = 0; i < numMetrics; i++) {
+    char *expr = (char*) m_lst[i].formula;
+    if (expr == NULL || strlen(expr) == 0) continue;
+
+    MetricFormula formula;
+    formula.metricId = i;
+    if (!eval.Compile(expr, var_map, formula.code)) {
+      DIAG_WMsg(2, "Ignoring malformed formula of metric " << m_lst[i].name
+		<< ": " << expr);
+      continue;
+    }
+
+    // a formula with a variable that is not a metric can never be computed
+    const std::vector<unsigned int>& vars = formula.code.GetVars();
+    bool valid = true;
+    for (uint v = 0; v < vars.size(); v++) {
+      valid = valid && (vars[v] < numMetrics);
+    }
+    if (!valid) {
+      continue;
+    }
+
+    ZeroVarMap zeros(var_map);
+    EXPR_EVAL_ERR err;
+    double res = formula.code.Eval(&zeros, err);
+    formula.zeroInputsNoop = (err != EEE_NO_ERROR || res == 0);
+
+    formulas.push_back(formula);
+  }
+}
+
+
+// compute the metrics of a node that have a formula, in metric order
+// since a formula may use the (computed) value of a preceding metric
+static void
+evalMetricFormulas(const std::vector<MetricFormula>& formulas,
+		   metric_desc_t* m_lst, hpcrun_metricVal_t* metrics,
+		   VarMap* var_map)
+{
+  for (uint f = 0; f < formulas.size(); f++) {
+    const MetricFormula& formula = formulas[f];
+    uint mId = formula.metricId;
+
+    if (formula.zeroInputsNoop && metrics[mId].bits == 0) {
+      const std::vector<unsigned int>& vars = formula.code.GetVars();
+      bool allZero = true;
+      for (uint v = 0; v < vars.size() && allZero; v++) {
+	allZero = (metrics[vars[v]].bits == 0);
+      }
+      if (allZero) continue;
+    }
+
+    EXPR_EVAL_ERR err;
+    double res = formula.code.Eval(var_map, err);
+    if (err == EEE_NO_ERROR) {
+      // the formula syntax looks "correct". Update the the metric value
+      hpcrun_fmt_metric_set_value(m_lst[mId], &metrics[mId], res);
+    }
+  }
+}
+
+
 int
 Profile::fmt_cct_fread(Profile& prof, FILE* infs, uint rFlags,
 		       const metric_tbl_t& metricTbl,
-		       std::string ctxtStr, FILE* outfs)
+		       std::string ctxtStr, FILE* outfs,
+		       const hpcfmt_mbuf_t* inmap)
 {
-  typedef std::map<int, CCT::ANode*> CCTIdToCCTNodeMap;
-
   DIAG_Assert(infs, "Bad file descriptor!");
   
-  CCTIdToCCTNodeMap cctNodeMap;
-
   int ret = HPCFMT_ERR;
 
   // ------------------------------------------------------------
@@ -1440,6 +1783,10 @@ Profile::fmt_cct_fread(Profile& prof, FILE* infs, uint rFlags,
   uint64_t numNodes = 0;
   hpcfmt_int8_fread(&numNodes, infs);
 
+  CCTIdToCCTNodeMap cctNodeMap(numNodes);
+  CCTMetricSrc metricSrc;
+  cct_initMetricSrc(metricSrc, prof, rFlags);
+
   // ------------------------------------------------------------
   // Read each CCT node
   // ------------------------------------------------------------
@@ -1463,18 +1810,45 @@ Profile::fmt_cct_fread(Profile& prof, FILE* infs, uint rFlags,
   }
 
   hpcrun_fmt_cct_node_t nodeFmt;
+  hpcrun_fmt_cct_node_init(&nodeFmt);
   nodeFmt.num_metrics = numMetricsSrc;
   nodeFmt.metrics = (numMetricsSrc > 0) ?
     (hpcrun_metricVal_t*)alloca(numMetricsSrc * sizeof(hpcrun_metricVal_t))
     : NULL;
 
-  ExprEval eval;
+  // ------------------------------------------------------------
+  // Compile the metric formulas given by hpcrun once for all the nodes.
+  // A malformed formula is ignored (cf. compileMetricFormulas).
+  // ------------------------------------------------------------
+  metric_desc_t* m_lst = metricTbl.lst;
+  VarMap var_map(nodeFmt.metrics, m_lst, numMetricsSrc);
+  std::vector<MetricFormula> formulas;
+  compileMetricFormulas(m_lst, numMetricsSrc, &var_map, formulas);
+
+  // Sparse nodes stay sparse, unless a formula or the dump needs the
+  // value of every metric.
+  if (prof.m_flags.fields.isSparse && numMetricsSrc > 0
+      && formulas.empty() && !outfs) {
+    nodeFmt.metric_ids = (uint16_t*)alloca(numMetricsSrc * sizeof(uint16_t));
+  }
+
+  // the nodes start at the current position of 'infs'
+  hpcfmt_mbuf_t buf;
+  if (inmap) {
+    buf.pos = inmap->pos + ftell(infs);
+    buf.end = inmap->end;
+  }
 
   for (uint i = 0; i < numNodes; ++i) {
     // ----------------------------------------------------------
     // Read the node
     // ----------------------------------------------------------
-    ret = hpcrun_fmt_cct_node_fread(&nodeFmt, prof.m_flags, infs);
+    if (inmap) {
+      ret = hpcrun_fmt_cct_node_mread(&nodeFmt, prof.m_flags, &buf);
+    }
+    else {
+      ret = hpcrun_fmt_cct_node_fread(&nodeFmt, prof.m_flags, infs);
+    }
     if (ret != HPCFMT_OK) {
       DIAG_Throw("Error reading CCT node " << nodeFmt.id);
     }
@@ -1483,25 +1857,9 @@ Profile::fmt_cct_fread(Profile& prof, FILE* infs, uint rFlags,
 				 &metricTbl, "  ");
     }
     // ------------------------------------------
-    // check if the metric contains a formula
-    //  if this is the case, we'll compute the metric based on the formula
-    //  given by hpcrun.
-    // FIXME: we don't check the validity of the formula (yet).
-    //        If hpcrun has incorrect formula, the result can be anything
+    // compute the metrics that have a formula
     // ------------------------------------------
-    metric_desc_t* m_lst = metricTbl.lst;
-    VarMap var_map(nodeFmt.metrics, m_lst, numMetricsSrc);
-
-    for (uint i = 0; i < numMetricsSrc; i++) {
-      char *expr = (char*) m_lst[i].formula;
-      if (expr == NULL || strlen(expr)==0) continue;
-
-      double res = eval.Eval(expr, &var_map);
-      if (eval.GetErr() == EEE_NO_ERROR) {
-        // the formula syntax looks "correct". Update the the metric value
-      	hpcrun_fmt_metric_set_value(m_lst[i], &nodeFmt.metrics[i], res);
-      }
-    }
+    evalMetricFormulas(formulas, m_lst, nodeFmt.metrics, &var_map);
 
     int nodeId   = (int)nodeFmt.id;
     int parentId = (int)nodeFmt.id_parent;
@@ -1509,11 +1867,8 @@ Profile::fmt_cct_fread(Profile& prof, FILE* infs, uint rFlags,
     // Find parent of node
     CCT::ANode* node_parent = NULL;
     if (parentId != HPCRUN_FMT_CCTNodeId_NULL) {
-      CCTIdToCCTNodeMap::iterator it = cctNodeMap.find(parentId);
-      if (it != cctNodeMap.end()) {
-	      node_parent = it->second;
-      }
-      else {
+      node_parent = cctNodeMap.find(parentId);
+      if (!node_parent) {
 	      DIAG_Throw("Cannot find parent for CCT node " << nodeId);
       }
     }
@@ -1533,7 +1888,7 @@ Profile::fmt_cct_fread(Profile& prof, FILE* infs, uint rFlags,
     // ----------------------------------------------------------
 
     std::pair<CCT::ADynNode*, CCT::ADynNode*> n2 =
-      cct_makeNode(prof, nodeFmt, rFlags, ctxtStr);
+      cct_makeNode(prof, nodeFmt, rFlags, metricSrc, ctxtStr);
     CCT::ADynNode* node = n2.first;
     CCT::ADynNode* node_sib = n2.second;
 
@@ -1558,7 +1913,12 @@ Profile::fmt_cct_fread(Profile& prof, FILE* infs, uint rFlags,
       if (cct->empty()) cct->root(node);
     }
 
-    cctNodeMap.insert(std::make_pair(nodeFmt.id, node));
+    cctNodeMap.insert(nodeFmt.id, node);
+  }
+
+  // leave 'infs' after the nodes for the next epoch
+  if (inmap) {
+    fseek(infs, (long)(buf.pos - inmap->pos), SEEK_SET);
   }
 
   if (outfs) {
@@ -1863,10 +2223,63 @@ Profile::canonicalize(uint rFlags)
 
 //***************************************************************************
 
+static void
+cct_initMetricSrc(CCTMetricSrc& msrc, Prof::CallPath::Profile& prof,
+		  uint rFlags)
+{
+  using namespace Prof;
+
+  msrc.doZeroMetrics = prof.isMetricMgrVirtual()
+    || (rFlags & Prof::CallPath::Profile::RFlg_VirtualMetrics);
+
+  // [numMetricsSrc = nodeFmt.num_metrics] <= numMetricsDst
+  uint numMetricsDst = prof.metricMgr()->size();
+  if (rFlags & Prof::CallPath::Profile::RFlg_NoMetricValues) {
+    numMetricsDst = 0;
+  }
+
+  for (uint i_dst = 0, i_src = 0; i_dst < numMetricsDst; i_dst++) {
+    Metric::ADesc* adesc = prof.metricMgr()->metric(i_dst);
+    Metric::SampledDesc* mdesc = dynamic_cast<Metric::SampledDesc*>(adesc);
+    DIAG_Assert(mdesc, "inconsistency: no corresponding SampledDesc!");
+
+    switch (mdesc->flags().fields.valFmt) {
+      case MetricFlags_ValFmt_Int:
+	msrc.isReal.push_back(false); break;
+      case MetricFlags_ValFmt_Real:
+	msrc.isReal.push_back(true); break;
+      default:
+	DIAG_Die(DIAG_UnexpectedInput);
+    }
+    msrc.srcId.push_back(i_src);
+    msrc.period.push_back((double)mdesc->period());
+    if (msrc.dstIds.size() <= i_src) {
+      msrc.dstIds.resize(i_src + 1);
+    }
+    msrc.dstIds[i_src].push_back(i_dst);
+
+    if (rFlags & Prof::CallPath::Profile::RFlg_MakeInclExcl) {
+      if (adesc->type() == Prof::Metric::ADesc::TyNULL ||
+	  adesc->type() == Prof::Metric::ADesc::TyExcl) {
+	i_src++;
+      }
+      // Prof::Metric::ADesc::TyIncl: reuse i_src
+    }
+    else {
+      i_src++;
+    }
+  }
+
+  uint mSz = (msrc.doZeroMetrics) ? 0 : numMetricsDst;
+  msrc.metricData.ensureMetricsSize(mSz);
+  msrc.metricZeros.ensureMetricsSize(mSz);
+}
+
+
 static std::pair<Prof::CCT::ADynNode*, Prof::CCT::ADynNode*>
 cct_makeNode(Prof::CallPath::Profile& prof,
 	     const hpcrun_fmt_cct_node_t& nodeFmt, uint rFlags,
-	     const std::string& ctxtStr)
+	     CCTMetricSrc& msrc, const std::string& ctxtStr)
 {
   using namespace Prof;
 
@@ -1932,55 +2345,52 @@ cct_makeNode(Prof::CallPath::Profile& prof,
   // metrics
   // ----------------------------------------
 
-  bool doZeroMetrics = prof.isMetricMgrVirtual()
-    || (rFlags & Prof::CallPath::Profile::RFlg_VirtualMetrics);
-
   bool hasMetrics = false;
 
-  // [numMetricsSrc = nodeFmt.num_metrics] <= numMetricsDst
-  uint numMetricsDst = prof.metricMgr()->size();
-  if (rFlags & Prof::CallPath::Profile::RFlg_NoMetricValues) {
-    numMetricsDst = 0;
-  }
-
-  Metric::IData metricData(numMetricsDst);
-  for (uint i_dst = 0, i_src = 0; i_dst < numMetricsDst; i_dst++) {
-    Metric::ADesc* adesc = prof.metricMgr()->metric(i_dst);
-    Metric::SampledDesc* mdesc = dynamic_cast<Metric::SampledDesc*>(adesc);
-    DIAG_Assert(mdesc, "inconsistency: no corresponding SampledDesc!");
-
-    hpcrun_metricVal_t m = nodeFmt.metrics[i_src];
-
-    double mval = 0;
-    switch (mdesc->flags().fields.valFmt) {
-      case MetricFlags_ValFmt_Int:
-	mval = (double)m.i; break;
-      case MetricFlags_ValFmt_Real:
-	mval = m.r; break;
-      default:
-	DIAG_Die(DIAG_UnexpectedInput);
+  // N.B.: the scratch values are copied into the new nodes
+  Metric::IData& metricData = msrc.metricData;
+  if (nodeFmt.metric_ids) {
+    // sparse node: only clear the values set by the last node
+    if (!msrc.doZeroMetrics) {
+      for (uint k = 0; k < msrc.dstSet.size(); k++) {
+	metricData.metric(msrc.dstSet[k]) = 0.0;
+      }
+      msrc.dstSet.clear();
     }
 
-    metricData.metric(i_dst) = mval * (double)mdesc->period();
+    for (uint k = 0; k < nodeFmt.num_nz; k++) {
+      hpcrun_metricVal_t m = nodeFmt.metrics[k];
+      uint i_src = nodeFmt.metric_ids[k];
 
-    if (!hpcrun_metricVal_isZero(m)) {
+      if (hpcrun_metricVal_isZero(m) || i_src >= msrc.dstIds.size()) {
+	continue;
+      }
       hasMetrics = true;
-    }
 
-    if (rFlags & Prof::CallPath::Profile::RFlg_MakeInclExcl) {
-      if (adesc->type() == Prof::Metric::ADesc::TyNULL ||
-	  adesc->type() == Prof::Metric::ADesc::TyExcl) {
-	i_src++;
+      if (!msrc.doZeroMetrics) {
+	const std::vector<uint>& dsts = msrc.dstIds[i_src];
+	for (uint j = 0; j < dsts.size(); j++) {
+	  uint i_dst = dsts[j];
+	  double mval = (msrc.isReal[i_dst]) ? m.r : (double)m.i;
+	  metricData.metric(i_dst) = mval * msrc.period[i_dst];
+	  msrc.dstSet.push_back(i_dst);
+	}
       }
-      // Prof::Metric::ADesc::TyIncl: reuse i_src
-    }
-    else {
-      i_src++;
     }
   }
+  else {
+    for (uint i_dst = 0; i_dst < msrc.srcId.size(); i_dst++) {
+      hpcrun_metricVal_t m = nodeFmt.metrics[msrc.srcId[i_dst]];
+
+      if (!hpcrun_metricVal_isZero(m)) {
+	hasMetrics = true;
+      }
 
-  if (doZeroMetrics) {
-    metricData.clearMetrics();
+      if (!msrc.doZeroMetrics) {
+	double mval = (msrc.isReal[i_dst]) ? m.r : (double)m.i;
+	metricData.metric(i_dst) = mval * msrc.period[i_dst];
+      }
+    }
   }
 
   // ----------------------------------------------------------
@@ -2006,13 +2416,10 @@ cct_makeNode(Prof::CallPath::Profile& prof,
 
       const uint cpId0 = HPCRUN_FMT_CCTNodeId_NULL;
 
-      uint mSz = (doZeroMetrics) ? 0 : numMetricsDst;
-      Metric::IData metricData0(mSz);
-      
       lush_lip_t* lipCopy = CCT::ADynNode::clone_lip(lip);
 
       n = new CCT::Call(NULL, cpId0, nodeFmt.as_info, lmId, lmIP, opIdx,
-			lipCopy, metricData0);
+			lipCopy, msrc.metricZeros);
     }
     else {
       n = new CCT::Call(NULL, cpId, nodeFmt.as_info, lmId, lmIP, opIdx,
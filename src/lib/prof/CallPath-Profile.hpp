@@ -67,6 +67,7 @@
 
 #include <vector>
 #include <set>
+#include <map>
 #include <string>
 
 
@@ -131,6 +132,21 @@ public:
   traceFileNameSet()
   { return m_traceFileNameSet; }
 
+
+  // cp-id translations of the trace files whose rewrite was deferred
+  // by merges with CCT::MrgFlg_DeferTraceFix, by trace file name.
+  // An empty translation means the trace file is already correct.
+  typedef std::map<uint, uint> CPIdMap;
+  typedef std::map<std::string, CPIdMap> TraceCPIdMaps;
+
+  const TraceCPIdMaps&
+  traceCPIdMaps() const
+  { return m_traceCPIdMaps; }
+
+  TraceCPIdMaps&
+  traceCPIdMaps()
+  { return m_traceCPIdMaps; }
+
   // enable/disable redundancy of procedure names
   // @param flag: true  -- redundancy is eliminated
   // 		  false -- redundancy is allowed
@@ -247,6 +263,20 @@ public:
   uint
   merge(Profile& y, int mergeTy, uint mrgFlag = 0);
 
+  // fixTraceFile: Rewrite the trace file 'traceFileName' into a
+  //   temporary file (cf. HPCPROF_TmpFnmSfx), translating its cp-ids
+  //   by 'cpIdMap' and writing the current header.  Does nothing if
+  //   'cpIdMap' is empty and the file is already in the current version.
+  static void
+  fixTraceFile(const std::string& traceFileName, const CPIdMap& cpIdMap);
+
+  // upgradeTraceFiles: Rewrite each trace file of the profile that is
+  //   not in the current version and was not rewritten by a merge, so
+  //   that all trace files have the header size (HPCTRACE_FMT_HeaderLen)
+  //   the experiment file gives.  Call before copying the trace files.
+  void
+  upgradeTraceFiles() const;
+
   // -------------------------------------------------------
   //
   // -------------------------------------------------------
@@ -292,21 +322,26 @@ public:
   // file stream 'infs', checking for errors, and constructs
   // appropriate Prof::Profile::CallPath objects.  If 'outfs' is
   // non-null, a textual form of the data is echoed to 'outfs' for
-  // human inspection.
+  // human inspection.  If 'inmap' is non-null, it maps the whole
+  // file behind 'infs' in memory and the CCT nodes are decoded from
+  // it rather than through 'infs'.
 
   static int
   fmt_fread(Profile* &prof, FILE* infs, uint rFlags,
-	    std::string ctxtStr, const char* filename, FILE* outfs);
+	    std::string ctxtStr, const char* filename, FILE* outfs,
+	    const hpcfmt_mbuf_t* inmap = NULL);
 
   static int
   fmt_epoch_fread(Profile* &prof, FILE* infs, uint rFlags,
 		  const hpcrun_fmt_hdr_t& hdr,
-		  std::string ctxtStr, const char* filename, FILE* outfs);
+		  std::string ctxtStr, const char* filename, FILE* outfs,
+		  const hpcfmt_mbuf_t* inmap = NULL);
 
   static int
   fmt_cct_fread(Profile& prof, FILE* infs, uint rFlags,
 		const metric_tbl_t& metricTbl,
-		std::string ctxtStr, FILE* outfs);
+		std::string ctxtStr, FILE* outfs,
+		const hpcfmt_mbuf_t* inmap = NULL);
 
 
   // fmt_*_fwrite(): Write the appropriate object as hpcrun_fmt to the
@@ -362,6 +397,9 @@ private:
   void
   merge_fixTrace(const CCT::MergeEffectList* mrgEffects);
 
+  void
+  merge_deferTrace(const CCT::MergeEffectList* mrgEffects);
+
 
 private:
   std::string m_name;
@@ -374,6 +412,7 @@ private:
 
   std::string m_traceFileName;   // non-empty, if relevant
   StringSet m_traceFileNameSet;
+  TraceCPIdMaps m_traceCPIdMaps;
   uint64_t m_traceMinTime, m_traceMaxTime;
 
   //typedef std::map<std::string, std::string> StrToStrMap;
@@ -118,7 +118,7 @@ LoadMap::lm_insert(LoadMap::LM* x)
 LoadMap::LMSet_nm::iterator
 LoadMap::lm_find(const std::string& nm) const
 {
-  static LoadMap::LM key;
+  LoadMap::LM key;
   key.name(nm);
 
   LMSet_nm::iterator fnd = m_lm_byName.find(&key);
@@ -1,6 +1,7 @@
 // (c) Peter Kankowski, 2007. http://smallcode.weblogs.us mailto:kankowski@narod.ru
 // This file is a modified version from Expression Evaluator published at
 //   https://www.strchr.com/expression_evaluator
+#include <alloca.h>
 #include <assert.h>
 #include <stdlib.h>
 #include <stdio.h>
@@ -151,6 +152,204 @@ double ExprEval::Eval(EVAL_CHAR* expr, BaseVarMap *var_map)
   return res;
 }
 
+// ================================
+// Compilation
+// ================================
+
+void ExprEvalCode::Emit(Op op, double num, unsigned int var)
+{
+  Instr instr;
+  instr.op  = op;
+  instr.num = num;
+  instr.var = var;
+  _code.push_back(instr);
+
+  if (op == OP_NUM || op == OP_VAR) {
+    _depth++;
+    if (_depth > _max_depth)
+      _max_depth = _depth;
+  }
+  else if (op != OP_NEG) {
+    _depth--;
+  }
+}
+
+double ExprEvalCode::Eval(BaseVarMap *var_map, EXPR_EVAL_ERR &err) const
+{
+  err = EEE_NO_ERROR;
+  double* stack = (double*) alloca((_max_depth + 1) * sizeof(double));
+  int top = -1;
+
+  for (size_t i = 0; i < _code.size(); i++) {
+    const Instr& instr = _code[i];
+    switch (instr.op) {
+      case OP_NUM:
+        stack[++top] = instr.num;
+        break;
+      case OP_VAR:
+        stack[++top] = var_map->getValue(instr.var);
+        if (var_map->getErrorCode() != 0) {
+          err = EEE_INCORRECT_VAR;
+          return 0;
+        }
+        break;
+      case OP_NEG:
+        stack[top] = -stack[top];
+        break;
+      case OP_ADD:
+        top--;
+        stack[top] += stack[top + 1];
+        break;
+      case OP_SUB:
+        top--;
+        stack[top] -= stack[top + 1];
+        break;
+      case OP_MUL:
+        top--;
+        stack[top] *= stack[top + 1];
+        break;
+      case OP_DIV:
+        top--;
+        if (stack[top + 1] == 0) {
+          err = EEE_DIVIDE_BY_ZERO;
+          return 0;
+        }
+        stack[top] /= stack[top + 1];
+        break;
+    }
+  }
+  return stack[0];
+}
+
+void ExprEval::CompileAtom(EVAL_CHAR*& expr, ExprEvalCode& code)
+{
+    // Skip spaces
+    while(*expr == ' ')
+      expr++;
+
+    // Handle the sign before parenthesis (or before number)
+    bool negative = false;
+    if(*expr == '-') {
+      negative = true;
+      expr++;
+    }
+    if(*expr == '+') {
+      expr++;
+    }
+
+    // Check if there is parenthesis
+    if(*expr == '(') {
+      expr++;
+      _paren_count++;
+      CompileSummands(expr, code);
+      if(*expr != ')') {
+        // Unmatched opening parenthesis
+        _err = EEE_PARENTHESIS;
+        _err_pos = expr;
+        return;
+      }
+      expr++;
+      _paren_count--;
+      if (negative)
+        code.Emit(ExprEvalCode::OP_NEG);
+      return;
+    }
+
+    // check if this is variable
+    bool variable = _var_map->isVariable(expr);
+    if (variable) {
+      expr++;
+    }
+
+    // It should be a number; convert it to double
+    char* end_ptr;
+    double res = strtod(expr, &end_ptr);
+    if(end_ptr == expr) {
+      // Report error
+      _err = EEE_WRONG_CHAR;
+      _err_pos = expr;
+      code.Emit(ExprEvalCode::OP_NUM, 0);
+      return;
+    }
+
+    if (variable) {
+      unsigned int index_metric = (unsigned int) res;
+      code.Emit(ExprEvalCode::OP_VAR, 0, index_metric);
+      std::vector<unsigned int>& vars = code._vars;
+      bool known = false;
+      for (size_t i = 0; i < vars.size(); i++) {
+        known = known || (vars[i] == index_metric);
+      }
+      if (!known)
+        vars.push_back(index_metric);
+    }
+    else {
+      code.Emit(ExprEvalCode::OP_NUM, res);
+    }
+    if (negative)
+      code.Emit(ExprEvalCode::OP_NEG);
+
+    // Advance the pointer
+    expr = end_ptr;
+}
+
+void ExprEval::CompileFactors(EVAL_CHAR*& expr, ExprEvalCode& code)
+{
+    CompileAtom(expr, code);
+    for(;;) {
+      // Skip spaces
+      while(*expr == ' ')
+        expr++;
+      EVAL_CHAR op = *expr;
+      if(op != '/' && op != '*')
+        return;
+      expr++;
+      CompileAtom(expr, code);
+      code.Emit((op == '/') ? ExprEvalCode::OP_DIV : ExprEvalCode::OP_MUL);
+    }
+}
+
+void ExprEval::CompileSummands(EVAL_CHAR*& expr, ExprEvalCode& code)
+{
+    CompileFactors(expr, code);
+    for(;;) {
+      // Skip spaces
+      while(*expr == ' ')
+        expr++;
+      EVAL_CHAR op = *expr;
+      if(op != '-' && op != '+')
+        return;
+      expr++;
+      CompileFactors(expr, code);
+      code.Emit((op == '-') ? ExprEvalCode::OP_SUB : ExprEvalCode::OP_ADD);
+    }
+}
+
+bool ExprEval::Compile(EVAL_CHAR* expr, BaseVarMap *var_map, ExprEvalCode& code)
+{
+  _paren_count  = 0;
+  _err          = EEE_NO_ERROR;
+  _var_map	= var_map;
+
+  code._code.clear();
+  code._vars.clear();
+  code._depth     = 0;
+  code._max_depth = 0;
+
+  CompileSummands(expr, code);
+
+  // Now, expr should point to '\0', and _paren_count should be zero
+  if(_paren_count != 0 || *expr == ')') {
+    _err = EEE_PARENTHESIS;
+    _err_pos = expr;
+  }
+  else if(*expr != '\0') {
+    _err = EEE_WRONG_CHAR;
+    _err_pos = expr;
+  }
+  return (_err == EEE_NO_ERROR);
+}
+
 EXPR_EVAL_ERR ExprEval::GetErr() 
 {
   return _err;
@@ -4,6 +4,8 @@
 #ifndef __ExprEval_H__
 #define  __ExprEval_H__
 
+#include <vector>
+
 #include <lib/support/BaseVarMap.hpp>   // basic var map class
 
 // Error codes enumeration
@@ -18,6 +20,38 @@ enum EXPR_EVAL_ERR {
 //typedef char EVAL_CHAR;
 #define EVAL_CHAR char
 
+// A compiled math expression: postfix code that can be evaluated many
+// times with different variable values without parsing the text again.
+class ExprEvalCode {
+public:
+  ExprEvalCode() : _depth(0), _max_depth(0) { }
+
+  // evaluate the expression; division by zero and incorrect variables
+  // are reported in 'err'
+  double Eval(BaseVarMap *var_map, EXPR_EVAL_ERR &err) const;
+
+  // the variables the expression uses (each once)
+  const std::vector<unsigned int>& GetVars() const { return _vars; }
+
+private:
+  friend class ExprEval;
+
+  enum Op { OP_NUM, OP_VAR, OP_NEG, OP_ADD, OP_SUB, OP_MUL, OP_DIV };
+
+  struct Instr {
+    Op op;
+    double num;        // OP_NUM
+    unsigned int var;  // OP_VAR
+  };
+
+  void Emit(Op op, double num = 0, unsigned int var = 0);
+
+  std::vector<Instr> _code;
+  std::vector<unsigned int> _vars;
+  int _depth;      // current and ...
+  int _max_depth;  // ... maximum evaluation stack depth
+};
+
 
 // Parser class to evaluate math expression
 // The math expression has to be simple operators:
@@ -41,10 +75,19 @@ private:
   // parse a sum or substraction
   double ParseSummands(EVAL_CHAR*& expr) ;
 
+  // the same grammar, emitting code instead of computing values
+  void CompileAtom(EVAL_CHAR*& expr, ExprEvalCode& code) ;
+  void CompileFactors(EVAL_CHAR*& expr, ExprEvalCode& code) ;
+  void CompileSummands(EVAL_CHAR*& expr, ExprEvalCode& code) ;
+
 public:
   // main method to evaluate a math expression
   double  Eval(EVAL_CHAR* expr, BaseVarMap *var_map);
 
+  // compile a math expression once for repeated evaluation; returns
+  // false (see GetErr) if the expression is not well formed
+  bool    Compile(EVAL_CHAR* expr, BaseVarMap *var_map, ExprEvalCode& code);
+
   // get the error code
   EXPR_EVAL_ERR GetErr();
 
@@ -88,11 +88,13 @@ static RealPathMgr s_singleton;
 
 RealPathMgr::RealPathMgr()
 {
+  pthread_mutex_init(&m_cacheLock, NULL);
 }
 
 
 RealPathMgr::~RealPathMgr()
 {
+  pthread_mutex_destroy(&m_cacheLock);
 }
 
 
@@ -111,6 +113,8 @@ RealPathMgr::realpath(string& pathNm) const
   
   // INVARIANT: 'pathNm' is not empty
 
+  pthread_mutex_lock(&m_cacheLock);
+
   // INVARIANT: all entries in the map are non-empty
   MyMap::iterator it = m_cache.find(pathNm);
 
@@ -165,6 +169,8 @@ RealPathMgr::realpath(string& pathNm) const
       m_cache.insert(make_pair(pathNm_orig, pathNm_real));
     }
   }
+
+  pthread_mutex_unlock(&m_cacheLock);
   return (pathNm[0] == '/'); // fully resolved
 }
 
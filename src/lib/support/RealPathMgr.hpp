@@ -68,6 +68,8 @@
 
 #include <cctype>
 
+#include <pthread.h>
+
 //*************************** User Include Files ****************************
 
 #include <include/uint.h>
@@ -98,7 +100,7 @@ public:
   // realpath: Given 'fnm', convert it to its 'realpath' (if possible)
   // and return true.  Return true if 'fnm' is as fully resolved as it
   // can be (which does not necessarily mean it exists); otherwise
-  // return false.
+  // return false.  May be called by several threads.
   bool
   realpath(std::string& pathNm) const;
   
@@ -140,6 +142,7 @@ private:
 
   std::string m_searchPaths;
   mutable MyMap m_cache;
+  mutable pthread_mutex_t m_cacheLock;
 };
 
 
@@ -124,6 +124,14 @@ public:
     return index;
   }
 
+  // lookup the string in the map, returns -1 if not there
+  long find(const std::string & str)
+  {
+    StringMap::iterator it = m_map.find(&str);
+
+    return (it != m_map.end()) ? it->second : -1;
+  }
+
   const std::string & index2str(long index)
   {
     if (index < 0 || index >= (long) m_vec.size()) {
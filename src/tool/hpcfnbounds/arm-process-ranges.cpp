@@ -102,7 +102,7 @@ typedef enum arm_state_e {
  * local variables 
  *****************************************************************************/
 
-static arm_state_t state = ARM_STATE_DEFAULT;
+static __thread arm_state_t state = ARM_STATE_DEFAULT;
 
 
 
@@ -171,6 +171,54 @@ process_range(const char *name, long offset, void *vstart, void *vend, DiscoverF
 
 
 
+void
+process_range_part(const char *name, long offset, void *vstart, void *vend,
+		   void *pstart, void *pend, const std::vector<void *> &fstarts,
+		   DiscoverFnTy fn_discovery)
+{
+  process_range(name, offset, pstart, pend, fn_discovery);
+}
+
+
+class ProcessRangeState {
+public:
+  arm_state_t state;
+};
+
+
+ProcessRangeState *
+process_range_state_save()
+{
+  ProcessRangeState *s = new ProcessRangeState;
+  s->state = state;
+  return s;
+}
+
+
+void
+process_range_state_restore(ProcessRangeState *s)
+{
+  state = s ? s->state : ARM_STATE_DEFAULT;
+}
+
+
+bool
+process_range_state_equal(ProcessRangeState *s1, ProcessRangeState *s2)
+{
+  arm_state_t state1 = s1 ? s1->state : ARM_STATE_DEFAULT;
+  arm_state_t state2 = s2 ? s2->state : ARM_STATE_DEFAULT;
+  return state1 == state2;
+}
+
+
+void
+process_range_state_free(ProcessRangeState *s)
+{
+  delete s;
+}
+
+
+
 bool
 range_contains_control_flow(void *vstart, void *vend)
 {
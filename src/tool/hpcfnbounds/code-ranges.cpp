@@ -45,12 +45,26 @@
 // ******************************************************* EndRiceCopyright *
 
 #include <map>
+#include <vector>
 using namespace std;
 
+#include <pthread.h>
+
 #include "code-ranges.h"
+#include "function-entries.h"
 #include "process-ranges.h"
 
 
+/******************************************************************************
+ * macros
+ *****************************************************************************/
+
+// parts of a code range analyzed in parallel start at known function
+// entries about this far apart. the result does not depend on the size
+// or the number of threads: it is the same as that of a serial scan.
+#define CODE_RANGE_PART_SIZE  (1 << 20)
+
+
 /******************************************************************************
  * forward declarations 
  *****************************************************************************/
@@ -65,6 +79,8 @@ public:
   CodeRange(const char *_name, void *_start, void *_end, long _offset, 
             DiscoverFnTy discover);
   void Process();
+  void ProcessPart(void *pstart, void *pend, const vector<void *> &fstarts);
+  void Split(vector<void *> &parts);
   bool Contains(void *addr);
   DiscoverFnTy Discover() { return discover; }
   void *Relocate(void *addr); 
@@ -79,6 +95,17 @@ private:
 
 typedef map<void*,CodeRange*> CodeRangeSet;
 
+class CodeRangePart {
+public:
+  CodeRange *range;
+  void *start;
+  void *end;
+  vector<void *> fstarts;   // guideposts of the parallel scan
+  vector<void *> expected;  // guideposts of the serial scan
+  FunctionEntryLog *log;
+  ProcessRangeState *final;
+};
+
 
 /******************************************************************************
  * local variables 
@@ -86,6 +113,11 @@ typedef map<void*,CodeRange*> CodeRangeSet;
 
 static CodeRangeSet code_ranges;
 
+static int code_range_threads = 1;
+
+static vector<CodeRangePart> code_range_parts;
+static long next_part;
+
 
 /******************************************************************************
  * interface operations 
@@ -142,15 +174,134 @@ new_code_range(const char *sname, void *start, void *end, long offset, DiscoverF
 }
 
 
+void 
+set_code_range_threads(int num_threads)
+{
+  code_range_threads = (num_threads > 1) ? num_threads : 1;
+}
+
+
+static void *
+process_code_range_parts(void *arg)
+{
+  long n = code_range_parts.size();
+  long k;
+
+  while ((k = __sync_fetch_and_add(&next_part, 1)) < n) {
+    CodeRangePart &p = code_range_parts[k];
+    p.log = function_entries_new_log();
+    function_entries_set_log(p.log);
+    process_range_state_restore(NULL);
+    p.range->ProcessPart(p.start, p.end, p.fstarts);
+    p.final = process_range_state_save();
+    function_entries_set_log(NULL);
+  }
+  return NULL;
+}
+
+
+// Check the parts analyzed in parallel in address order, as a serial
+// scan would reach them.  A part analyzed from the state the serial
+// scan has at its start, with the same guideposts, and whose queries
+// of the function entries and protected ranges get the same answers
+// now, did what the serial scan does, so its updates are merged.  Any
+// other part is analyzed again here, in sequence.
+static void
+merge_code_range_parts(ProcessRangeState *carry)
+{
+  for (unsigned int k = 0; k < code_range_parts.size(); k++) {
+    CodeRangePart &p = code_range_parts[k];
+
+    // the serial scan takes the guideposts of a range when it starts
+    if (k == 0 || p.range != code_range_parts[k - 1].range) {
+      for (unsigned int j = k; j < code_range_parts.size()
+	     && code_range_parts[j].range == p.range; j++) {
+	CodeRangePart &q = code_range_parts[j];
+	entries_in_range(q.start, q.end, q.expected);
+      }
+    }
+
+    if (process_range_state_equal(carry, NULL)
+	&& p.fstarts == p.expected
+	&& function_entries_check_log(p.log)) {
+      function_entries_merge_log(p.log);
+      process_range_state_free(carry);
+      carry = p.final;
+    }
+    else {
+      function_entries_free_log(p.log);
+      process_range_state_free(p.final);
+      process_range_state_restore(carry);
+      p.range->ProcessPart(p.start, p.end, p.expected);
+      process_range_state_free(carry);
+      carry = process_range_state_save();
+    }
+  }
+
+  process_range_state_restore(carry);
+  process_range_state_free(carry);
+}
+
+
+// With several threads, each code range is split into parts that are
+// analyzed in parallel, each from the state of a new thread and against
+// the function entries and protected ranges known before the analysis.
+// Then merge_code_range_parts() keeps what matches a serial scan and
+// redoes the rest.
 void 
 process_code_ranges()
 {
   process_range_init();
   CodeRangeSet::iterator it = code_ranges.begin();
+
+  if (code_range_threads <= 1) {
+    for (; it != code_ranges.end(); it++) {
+      CodeRange *r = (*it).second;
+      r->Process();
+    }
+    return;
+  }
+
+  code_range_parts.clear();
   for (; it != code_ranges.end(); it++) {
     CodeRange *r = (*it).second;
-    r->Process();
+    vector<void *> bounds;
+    r->Split(bounds);
+    for (unsigned int i = 0; i + 1 < bounds.size(); i++) {
+      CodeRangePart p;
+      p.range = r;
+      p.start = bounds[i];
+      p.end = bounds[i + 1];
+      entries_in_range(p.start, p.end, p.fstarts);
+      p.log = NULL;
+      p.final = NULL;
+      code_range_parts.push_back(p);
+    }
+  }
+  next_part = 0;
+
+  // the main thread analyzes parts too, so keep its state
+  ProcessRangeState *carry = process_range_state_save();
+
+  int num_threads = code_range_threads;
+  if ((long) code_range_parts.size() < num_threads) {
+    num_threads = code_range_parts.size();
   }
+  vector<pthread_t> threads(num_threads);
+  int num_started = 0;
+  for (int i = 1; i < num_threads; i++) {
+    if (pthread_create(&threads[i], NULL, process_code_range_parts, NULL) != 0) {
+      break;
+    }
+    num_started = i;
+  }
+  process_code_range_parts(NULL);
+  for (int i = 1; i <= num_started; i++) {
+    pthread_join(threads[i], NULL);
+  }
+
+  merge_code_range_parts(carry);
+  code_range_parts.clear();
 }
 
 
@@ -185,3 +336,31 @@ CodeRange::Process()
 {
   process_range(name, -offset, Relocate(start), Relocate(end), discover);
 }
+
+void 
+CodeRange::ProcessPart(void *pstart, void *pend, const vector<void *> &fstarts)
+{
+  process_range_part(name, -offset, Relocate(start), Relocate(end),
+		     Relocate(pstart), Relocate(pend), fstarts, discover);
+}
+
+// Fill in the bounds of the parts of the range: the start, then the
+// first function entry at least CODE_RANGE_PART_SIZE past the previous
+// bound, and so on up to the end. Both the start and the end of a range
+// are function entries.
+void 
+CodeRange::Split(vector<void *> &parts)
+{
+  vector<void *> entries;
+  entries_in_range(start, end, entries);
+
+  parts.push_back(start);
+  for (unsigned int i = 0; i < entries.size(); i++) {
+    void *addr = entries[i];
+    if (addr >= end) break;
+    if ((char *) addr - (char *) parts.back() >= CODE_RANGE_PART_SIZE) {
+      parts.push_back(addr);
+    }
+  }
+  parts.push_back(end);
+}
@@ -66,6 +66,8 @@ void new_code_range(const char *name, void *start, void *end, long offset,
 
 void process_code_ranges();
 
+void set_code_range_threads(int num_threads);
+
 long num_function_entries(void);
 
 #endif // code_ranges_hpp
@@ -83,12 +83,35 @@ public:
 };
 
 
+// The updates made by the analysis of a part, and the queries it made
+// with their answers, in order.
+class FunctionEntryLog {
+public:
+  enum OpKind { ENTRY, RANGE, QUERY_ENTRY, QUERY_INSIDE };
+  struct Op {
+    OpKind kind;
+    void *start;
+    void *end;  // of a protected range
+    string *comment;
+    bool isvisible;
+    int call_count;
+    bool answer;  // of a query
+  };
+  vector<Op> ops;
+  set<void*> entries;
+  intervals ranges;
+};
+
+
 /******************************************************************************
  * forward declarations
  *****************************************************************************/
 
 static void new_function_entry(void *addr, string *comment, bool isvisible, 
 			       int call_count);
+
+static bool inside_ranges(intervals &ranges1, intervals &ranges2,
+			  void *addr);
 static void dump_function_entry(void *addr, const char *comment);
 
 
@@ -106,6 +129,9 @@ static intervals cbranges;
 
 static long num_entries_total = 0;
 
+// log of the calling thread, if it analyzes a part of a code range
+static __thread FunctionEntryLog *entry_log = NULL;
+
 
 /******************************************************************************
  * interface operations 
@@ -197,8 +223,15 @@ query_function_entry(void *addr)
 {
   FunctionSet::iterator it = function_entries.find(addr); 
 
-  if (it == function_entries.end()) return false;
-  else return true;
+  if (it != function_entries.end()) return true;
+  if (entry_log) {
+    bool answer = entry_log->entries.count(addr) != 0;
+    FunctionEntryLog::Op op =
+      { FunctionEntryLog::QUERY_ENTRY, addr, NULL, NULL, false, 0, answer };
+    entry_log->ops.push_back(op);
+    return answer;
+  }
+  return false;
 }
 
 
@@ -206,6 +239,15 @@ void
 add_function_entry(void *addr, const string *comment, bool isvisible, 
 		   int call_count)
 {
+  if (entry_log) {
+    FunctionEntryLog::Op op =
+      { FunctionEntryLog::ENTRY, addr, NULL,
+	comment ? new string(*comment) : NULL, isvisible, call_count, false };
+    entry_log->ops.push_back(op);
+    entry_log->entries.insert(addr);
+    return;
+  }
+
   FunctionSet::iterator it = function_entries.find(addr); 
 
   if (it == function_entries.end()) {
@@ -243,9 +285,93 @@ entries_in_range(void *start, void *end, vector<void *> &result)
 
 bool contains_function_entry(void *address)
 {
-  FunctionSet::iterator it = function_entries.find(address); 
-  if (it != function_entries.end()) return true;
-  else return false;
+  return query_function_entry(address);
+}
+
+
+FunctionEntryLog *
+function_entries_new_log()
+{
+  return new FunctionEntryLog;
+}
+
+
+// Set the log of the calling thread, or NULL to update the global
+// sets directly.
+void
+function_entries_set_log(FunctionEntryLog *log)
+{
+  entry_log = log;
+}
+
+
+// True if each query of 'log' gets the same answer from the global
+// sets, updated by the operations of the log made before the query, as
+// it got when the log was recorded.  That is, if the global sets are
+// now what they were when the analysis of the part began in a serial
+// scan, and the analysis does not depend on other state, then the log
+// holds what the serial scan does.
+bool
+function_entries_check_log(FunctionEntryLog *log)
+{
+  vector<FunctionEntryLog::Op>::iterator it;
+  set<void*> entries;
+  intervals ranges;
+
+  for (it = log->ops.begin(); it != log->ops.end(); it++) {
+    bool answer;
+    switch (it->kind) {
+    case FunctionEntryLog::ENTRY:
+      entries.insert(it->start);
+      break;
+    case FunctionEntryLog::RANGE:
+      ranges.insert(it->start, it->end);
+      break;
+    case FunctionEntryLog::QUERY_ENTRY:
+      answer = (function_entries.find(it->start) != function_entries.end()
+		|| entries.count(it->start) != 0);
+      if (answer != it->answer) return false;
+      break;
+    case FunctionEntryLog::QUERY_INSIDE:
+      answer = inside_ranges(cbranges, ranges, it->start);
+      if (answer != it->answer) return false;
+      break;
+    }
+  }
+  return true;
+}
+
+
+// Apply the updates of 'log' to the global sets in the order they were
+// made, and free the log.
+void
+function_entries_merge_log(FunctionEntryLog *log)
+{
+  vector<FunctionEntryLog::Op>::iterator it;
+
+  for (it = log->ops.begin(); it != log->ops.end(); it++) {
+    if (it->kind == FunctionEntryLog::RANGE) {
+      add_protected_range(it->start, it->end);
+    }
+    else if (it->kind == FunctionEntryLog::ENTRY) {
+      add_function_entry(it->start, it->comment, it->isvisible, it->call_count);
+      delete it->comment;
+    }
+  }
+  delete log;
+}
+
+
+// Free 'log' without applying it.
+void
+function_entries_free_log(FunctionEntryLog *log)
+{
+  vector<FunctionEntryLog::Op>::iterator it;
+
+  for (it = log->ops.begin(); it != log->ops.end(); it++) {
+    delete it->comment;
+  }
+  delete log;
 }
 
 
@@ -296,6 +422,7 @@ new_function_entry(void *addr, string *comment, bool isvisible, int call_count)
 int 
 is_possible_fn(void *addr)
 {
+  if (entry_log && entry_log->ranges.contains(addr) != NULL) return 0;
   return (cbranges.contains(addr) == NULL);
 }
 
@@ -304,12 +431,33 @@ is_possible_fn(void *addr)
 int 
 inside_protected_range(void *addr)
 {
+  if (entry_log) {
+    bool answer = inside_ranges(cbranges, entry_log->ranges, addr);
+    FunctionEntryLog::Op op =
+      { FunctionEntryLog::QUERY_INSIDE, addr, NULL, NULL, false, 0, answer };
+    entry_log->ops.push_back(op);
+    return answer;
+  }
+
   std::pair<void *const, void *> *interval = cbranges.contains(addr);
   if (interval != NULL && (addr > interval->first)) return 1;
   return 0;
 }
 
 
+// inside_protected_range() for the union of two sets of ranges, as if
+// they were one: ranges that overlap or touch are merged, so 'addr' is
+// past the start of its merged range if any range reaches it from below.
+static bool
+inside_ranges(intervals &ranges1, intervals &ranges2, void *addr)
+{
+  if (ranges1.contains(addr) == NULL && ranges2.contains(addr) == NULL) {
+    return false;
+  }
+  return ranges1.reaches(addr) || ranges2.reaches(addr);
+}
+
+
 //
 // FIXME? add finer grained segv handling here?
 //
@@ -317,6 +465,13 @@ void
 add_protected_range(void *start, void *end)
 {
   if (start < end) {
+    if (entry_log) {
+      FunctionEntryLog::Op op =
+	{ FunctionEntryLog::RANGE, start, end, NULL, false, 0, false };
+      entry_log->ops.push_back(op);
+      entry_log->ranges.insert(start,end);
+      return;
+    }
     cbranges.insert(start,end);
   }
 }
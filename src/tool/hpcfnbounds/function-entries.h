@@ -66,4 +66,17 @@ int  inside_protected_range(void *addr);
 void entries_in_range(void *start, void *end, vector<void *> &result);
 bool query_function_entry(void *addr);
 
+// While parts of the code ranges are analyzed in parallel, the new
+// function entries and protected ranges of each part, and the queries
+// it makes, are recorded in a log of the thread that analyzes it.  The
+// logs are checked and merged into the global sets afterwards, in
+// address order.
+class FunctionEntryLog;
+
+FunctionEntryLog *function_entries_new_log();
+void function_entries_set_log(FunctionEntryLog *log);
+bool function_entries_check_log(FunctionEntryLog *log);
+void function_entries_merge_log(FunctionEntryLog *log);
+void function_entries_free_log(FunctionEntryLog *log);
+
 void dump_reachable_functions();
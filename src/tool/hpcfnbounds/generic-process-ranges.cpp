@@ -65,6 +65,40 @@ process_range(const char *name, long offset, void *vstart, void *vend, DiscoverF
 }
 
 
+void
+process_range_part(const char *name, long offset, void *vstart, void *vend,
+		   void *pstart, void *pend, const std::vector<void *> &fstarts,
+		   DiscoverFnTy fn_discovery)
+{
+}
+
+
+ProcessRangeState *
+process_range_state_save()
+{
+  return NULL;
+}
+
+
+void
+process_range_state_restore(ProcessRangeState *state)
+{
+}
+
+
+bool
+process_range_state_equal(ProcessRangeState *s1, ProcessRangeState *s2)
+{
+  return true;
+}
+
+
+void
+process_range_state_free(ProcessRangeState *state)
+{
+}
+
+
 bool
 range_contains_control_flow(void *vstart, void *vend)
 {
@@ -137,6 +137,24 @@ intervals::contains(void * i)
 }
 
 
+//-----------------------------------------------------------------------------
+// Method reaches:
+//    true if an interval starts before the point i and ends at or after
+//    it, i.e. an interval containing i would be merged with it.
+//-----------------------------------------------------------------------------
+bool
+intervals::reaches(void * i)
+{
+  map<void *, void *>::iterator lb;
+  lb = mymap.lower_bound(i);
+  if (lb != mymap.begin()) {
+    --lb;
+    if (i <= (*lb).second) return true;
+  }
+  return false;
+}
+
+
 //-----------------------------------------------------------------------------
 // Method clear:
 //    reset the map to empty
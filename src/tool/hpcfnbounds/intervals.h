@@ -52,6 +52,7 @@ private:
 public:
   void insert(void *start, void *end); 
   std::pair<void *const, void *> *contains(void * i); 
+  bool reaches(void * i);
   void clear();
   void dump(); 
 };
@@ -126,6 +126,14 @@ main(int argc, char* argv[])
   DiscoverFnTy fn_discovery = DiscoverFnTy_Aggressive;
   char *object_file;
   int n, fdin, fdout;
+  int num_threads = 1;
+
+  // server mode is launched by hpcrun, so also take the number of
+  // threads from the environment.
+  char *jobs = getenv("HPCFNBOUNDS_JOBS");
+  if (jobs != NULL && sscanf(jobs, "%d", &num_threads) < 1) {
+    num_threads = 1;
+  }
 
   for (n = 1; n < argc; n++) {
     if (strcmp(argv[n], "-c") == 0) {
@@ -137,6 +145,13 @@ main(int argc, char* argv[])
     else if (strcmp(argv[n], "-h") == 0 || strcmp(argv[n], "--help") == 0) {
       usage(argv[0], 0);
     }
+    else if (strcmp(argv[n], "-j") == 0) {
+      if (argc < n + 2 || sscanf(argv[n+1], "%d", &num_threads) < 1) {
+	fprintf(stderr, "%s: missing number of threads for -j\n", argv[0]);
+	exit(1);
+      }
+      n++;
+    }
     else if (strcmp(argv[n], "-s") == 0) {
       the_mode = MODE_SERVER;
       if (argc < n + 3 || sscanf(argv[n+1], "%d", &fdin) < 1
@@ -166,6 +181,12 @@ main(int argc, char* argv[])
     }
   }
 
+  if (num_threads == 0) {
+    long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    num_threads = (ncpu > 0) ? ncpu : 1;
+  }
+  set_code_range_threads(num_threads);
+
   // Run as the system server.
   if (server_mode()) {
     system_server(fn_discovery, fdin, fdout);
@@ -238,6 +259,8 @@ usage(char *command, int status)
     "\t-c\twrite output in C source code\n"
     "\t-d\tdon't perform function discovery on stripped code\n"
     "\t-h\tprint this help message and exit\n"
+    "\t-j n\tanalyze large code sections with n threads (0 for one per\n"
+    "\t\tcpu), default $HPCFNBOUNDS_JOBS or 1\n"
     "\t-s fdin fdout\trun in server mode\n"
     "\t-t\twrite output in text format (default)\n"
     "\t-v\tturn on verbose output in hpcfnbounds script\n\n"
@@ -47,6 +47,8 @@
 #ifndef process_ranges_hpp
 #define process_ranges_hpp
 
+#include <vector>
+
 #include "code-ranges.h"
 
 void process_range_init();
@@ -54,6 +56,24 @@ void process_range_init();
 void process_range(const char *name, long offset, void *vstart, void *vend,
 		   DiscoverFnTy fn_discovery);
 
+// process the part [pstart, pend) of the range [vstart, vend), from the
+// state of the calling thread, with the function entries 'fstarts' of
+// the part (unrelocated, including pstart and pend) as guideposts.
+void process_range_part(const char *name, long offset, void *vstart, void *vend,
+			void *pstart, void *pend,
+			const std::vector<void *> &fstarts,
+			DiscoverFnTy fn_discovery);
+
+// The state a scan carries from one instruction to the next, and from
+// one range to the next, in the calling thread.  NULL stands for the
+// state of a new thread.
+class ProcessRangeState;
+
+ProcessRangeState *process_range_state_save();
+void process_range_state_restore(ProcessRangeState *state);
+bool process_range_state_equal(ProcessRangeState *s1, ProcessRangeState *s2);
+void process_range_state_free(ProcessRangeState *state);
+
 bool range_contains_control_flow(void *vstart, void *vend);
 
 #endif // process_ranges_hpp
@@ -113,6 +113,11 @@ xed_iclass(char* ins)
  * forward declarations 
  *****************************************************************************/
 
+static void process_span(long offset, void *vstart, void *vend,
+			 void *pstart, void *pend,
+			 const vector<void *> *part_fstarts,
+			 DiscoverFnTy fn_discovery);
+
 static void process_call(char *ins, long offset, xed_decoded_inst_t *xptr,
 			 void *start, void *end);
 
@@ -170,12 +175,15 @@ static xed_state_t xed_machine_state =
     XED_ADDRESS_WIDTH_32b };
 #endif
 
-static char *prologue_start = NULL;
-static char *set_rbp = NULL;
-static char *push_rbp = NULL;
-static char *push_other = NULL;
-static char *last_bad = NULL;
-static xed_reg_enum_t push_other_reg;
+// per thread, so that parts of a range can be processed in parallel
+// (cf. ProcessRangeState)
+static __thread char *prologue_start = NULL;
+static __thread long prologue_offset = 0;
+static __thread char *set_rbp = NULL;
+static __thread char *push_rbp = NULL;
+static __thread char *push_other = NULL;
+static __thread char *last_bad = NULL;
+static __thread xed_reg_enum_t push_other_reg;
 
 
 /******************************************************************************
@@ -227,6 +235,99 @@ process_range_init()
 void 
 process_range(const char *name, long offset, void *vstart, void *vend, 
               DiscoverFnTy fn_discovery)
+{
+  process_span(offset, vstart, vend, vstart, vend, NULL, fn_discovery);
+}
+
+
+void
+process_range_part(const char *name, long offset, void *vstart, void *vend,
+		   void *pstart, void *pend, const vector<void *> &fstarts,
+		   DiscoverFnTy fn_discovery)
+{
+  process_span(offset, vstart, vend, pstart, pend, &fstarts, fn_discovery);
+}
+
+
+class ProcessRangeState {
+public:
+  char *prologue_start;
+  long prologue_offset;
+  char *set_rbp;
+  char *push_rbp;
+  char *push_other;
+  char *last_bad;
+  xed_reg_enum_t push_other_reg;
+};
+
+
+ProcessRangeState *
+process_range_state_save()
+{
+  ProcessRangeState *s = new ProcessRangeState;
+  s->prologue_start = prologue_start;
+  s->prologue_offset = prologue_offset;
+  s->set_rbp = set_rbp;
+  s->push_rbp = push_rbp;
+  s->push_other = push_other;
+  s->last_bad = last_bad;
+  s->push_other_reg = push_other_reg;
+  return s;
+}
+
+
+void
+process_range_state_restore(ProcessRangeState *s)
+{
+  ProcessRangeState init = { NULL, 0, NULL, NULL, NULL, NULL, XED_REG_INVALID };
+  if (s == NULL) s = &init;
+
+  prologue_start = s->prologue_start;
+  prologue_offset = s->prologue_offset;
+  set_rbp = s->set_rbp;
+  push_rbp = s->push_rbp;
+  push_other = s->push_other;
+  last_bad = s->last_bad;
+  push_other_reg = s->push_other_reg;
+}
+
+
+bool
+process_range_state_equal(ProcessRangeState *s1, ProcessRangeState *s2)
+{
+  ProcessRangeState init = { NULL, 0, NULL, NULL, NULL, NULL, XED_REG_INVALID };
+  if (s1 == NULL) s1 = &init;
+  if (s2 == NULL) s2 = &init;
+
+  return s1->prologue_start == s2->prologue_start
+    && s1->prologue_offset == s2->prologue_offset
+    && s1->set_rbp == s2->set_rbp
+    && s1->push_rbp == s2->push_rbp
+    && s1->push_other == s2->push_other
+    && s1->last_bad == s2->last_bad
+    && s1->push_other_reg == s2->push_other_reg;
+}
+
+
+void
+process_range_state_free(ProcessRangeState *s)
+{
+  delete s;
+}
+
+
+
+/******************************************************************************
+ * private operations
+ *****************************************************************************/
+
+// decode the instructions in [pstart, pend). branch targets are
+// checked against the whole range [vstart, vend). the guideposts are
+// 'part_fstarts' if given, else the function entries known now.
+//
+static void
+process_span(long offset, void *vstart, void *vend, void *pstart, void *pend,
+	     const vector<void *> *part_fstarts, DiscoverFnTy fn_discovery)
 {
   if (fn_discovery == DiscoverFnTy_None) {
     return;
@@ -237,10 +338,15 @@ process_range(const char *name, long offset, void *vstart, void *vend,
   xed_error_enum_t xed_error;
 
   int error_count = 0;
-  char *ins = (char *) vstart;
-  char *end = (char *) vend;
+  char *ins = (char *) pstart;
+  char *end = (char *) pend;
   vector<void *> fstarts;
-  entries_in_range(ins + offset, end + offset, fstarts);
+  if (part_fstarts) {
+    fstarts = *part_fstarts;
+  }
+  else {
+    entries_in_range(ins + offset, end + offset, fstarts);
+  }
   
   void **fstart = &fstarts[0];
   char *guidepost = RELOCATE(*fstart, offset);
@@ -421,11 +527,6 @@ process_range(const char *name, long offset, void *vstart, void *vend,
 }
 
 
-
-/******************************************************************************
- * private operations 
- *****************************************************************************/
-
 static int 
 is_padding(int c)
 {
@@ -1354,7 +1455,6 @@ addsub(char *ins, xed_decoded_inst_t *xptr, xed_iclass_enum_t iclass, long ins_o
   const xed_operand_t* op0 = xed_inst_operand(xi,0);
   const xed_operand_t* op1 = xed_inst_operand(xi,1);
   xed_operand_enum_t   op0_name = xed_operand_name(op0);
-  static long prologue_offset = 0;
 
   if ((op0_name == XED_OPERAND_REG0) &&
       x86_isReg_SP(xed_decoded_inst_get_reg(xptr, op0_name))) {
@@ -430,6 +430,7 @@ realmain(int argc, char* const* argv)
     Analysis::CallPath::makeDatabase(*profGbl, args);
   }
   else {
+    profGbl->upgradeTraceFiles();
     Analysis::Util::copyTraceFiles(args.db_dir, profGbl->traceFileNameSet());
   }
 
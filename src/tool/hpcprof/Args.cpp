@@ -66,6 +66,8 @@ using std::endl;
 #include <string>
 using std::string;
 
+#include <unistd.h>
+
 //*************************** User Include Files ****************************
 
 #include "Args.hpp"
@@ -90,6 +92,7 @@ Args::Args()
 {
   hpcprof_isMetricArg = false;
   hpcprof_forceMetrics = false;
+  hpcprof_numThreads = 1;
 }
 
 
@@ -111,6 +114,18 @@ Args::parse(int argc, const char* const argv[])
     hpcprof_forceMetrics = true;
   }
 
+  if (parser.isOpt("jobs")) {
+    const string& arg = parser.getOptArg("jobs");
+    long numThreads = CmdLineParser::toLong(arg);
+    if (numThreads < 0) {
+      ARG_ERROR("--jobs/-j option: the number of threads must not be negative");
+    }
+    if (numThreads == 0) {
+      numThreads = sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    hpcprof_numThreads = (numThreads > 0) ? (uint)numThreads : 1;
+  }
+
   // Currently, hpcprof does not generate thread-level metric db
   db_makeMetricDB = false;
 }
@@ -73,13 +73,16 @@
 #include <stdbool.h>
 #include <assert.h>
 
+#include <sys/mman.h>
+
 //*************************** User Include Files ****************************
 
 #include <memory/hpcrun-malloc.h>
+#include <memory/mmap.h>
 #include <hpcrun/metrics.h>
 #include <messages/messages.h>
 #include <lib/prof-lean/splay-macros.h>
-#include <lib/prof-lean/hpcrun-fmt.h>
+#include <lib/prof-lean/hpcio-buffer.h>
 #include <lib/prof-lean/hpcrun-fmt.h>
 #include <hpcrun/hpcrun_return_codes.h>
 
@@ -104,6 +107,9 @@ struct cct_node_t {
   cct_addr_t addr;
 
   bool is_leaf;
+
+  // metrics attributed to this node (NULL until the first one is)
+  metric_set_t* metrics;
   
   // ---------------------------------------------------------
   // tree structure
@@ -171,6 +177,7 @@ cct_node_create(cct_addr_t* addr, cct_node_t* parent)
   node->right = NULL;
 
   node->is_leaf = false;
+  node->metrics = NULL;
 
   return node;
 }
@@ -254,11 +261,17 @@ walk_path_l(cct_node_t* node, cct_op_t op, cct_op_arg_t arg, size_t level)
 // Writing helpers
 //
 
+// size of the buffer that cct nodes are encoded into before they are
+// written to the profile file
+#define CCT_WRITE_BUFFER_SIZE (1 << 20)
+
 typedef struct {
   hpcfmt_uint_t num_metrics;
   FILE* fs;
+  hpcio_outbuf_t* outbuf; // if non-NULL, used instead of fs
   epoch_flags_t flags;
   hpcrun_fmt_cct_node_t* tmp_node;
+  int ret;
 } write_arg_t;
 
 
@@ -293,7 +306,12 @@ lwrite(cct_node_t* node, cct_op_arg_t arg, size_t level)
   tmp->num_metrics = my_arg->num_metrics;
   hpcrun_metric_set_dense_copy(tmp->metrics, hpcrun_get_metric_set(node),
 			       my_arg->num_metrics);
-  hpcrun_fmt_cct_node_fwrite(tmp, flags, my_arg->fs);
+  int ret = my_arg->outbuf
+    ? hpcrun_fmt_cct_node_outbuf(tmp, flags, my_arg->outbuf)
+    : hpcrun_fmt_cct_node_fwrite(tmp, flags, my_arg->fs);
+  if (ret != HPCFMT_OK) {
+    my_arg->ret = HPCRUN_ERR;
+  }
 }
 
 //
@@ -353,6 +371,12 @@ hpcrun_cct_addr(cct_node_t* node)
   return node ? &(node->addr) : NULL;
 }
 
+metric_set_t*
+hpcrun_cct_metrics(cct_node_t* node)
+{
+  return node ? node->metrics : NULL;
+}
+
 bool
 hpcrun_cct_is_leaf(cct_node_t* node)
 {
@@ -438,6 +462,16 @@ hpcrun_cct_terminate_path(cct_node_t* node)
   node->is_leaf = true;
 }
 
+//
+// Attach a metric set to a node. Only the thread that owns the cct
+// updates it, so no synchronization is needed.
+//
+void
+hpcrun_cct_metrics_assoc(cct_node_t* node, metric_set_t* metrics)
+{
+  node->metrics = metrics;
+}
+
 //
 // Special purpose mutator:
 // This operation is somewhat akin to concatenation.
@@ -598,16 +632,41 @@ hpcrun_cct_fwrite(cct_node_t* cct, FILE* fs, epoch_flags_t flags)
   write_arg_t write_arg = {
     .num_metrics = num_metrics,
     .fs          = fs,
+    .outbuf      = NULL,
     .flags       = flags,
     .tmp_node    = &tmp_node,
+    .ret         = HPCRUN_OK,
   };
   
   hpcrun_metricVal_t metrics[num_metrics];
   tmp_node.metrics = &(metrics[0]);
 
+  //
+  // the nodes are the bulk of the profile: encode them into a large
+  // buffer that is written straight to the file descriptor, rather than
+  // through stdio one field at a time. fall back to stdio if no buffer.
+  //
+  hpcio_outbuf_t outbuf;
+  void* buf = NULL;
+  if (fflush(fs) == 0) {
+    buf = hpcrun_mmap_anon(CCT_WRITE_BUFFER_SIZE);
+  }
+  if (buf != NULL
+      && hpcio_outbuf_attach(&outbuf, fileno(fs), buf, CCT_WRITE_BUFFER_SIZE,
+			     HPCIO_OUTBUF_UNLOCKED) == HPCFMT_OK) {
+    write_arg.outbuf = &outbuf;
+  }
+
   hpcrun_cct_walk_node_1st(cct, lwrite, &write_arg);
 
-  return HPCRUN_OK;
+  if (write_arg.outbuf && hpcio_outbuf_flush(&outbuf) != HPCFMT_OK) {
+    write_arg.ret = HPCRUN_ERR;
+  }
+  if (buf != NULL) {
+    munmap(buf, CCT_WRITE_BUFFER_SIZE);
+  }
+
+  return write_arg.ret;
 }
 
 //
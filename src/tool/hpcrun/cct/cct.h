@@ -130,6 +130,7 @@ extern cct_node_t* hpcrun_cct_top_new(uint16_t lmid, uintptr_t lmip);
 extern cct_node_t* hpcrun_cct_parent(cct_node_t* node);
 extern int32_t hpcrun_cct_persistent_id(cct_node_t* node);
 extern cct_addr_t* hpcrun_cct_addr(cct_node_t* node);
+extern metric_set_t* hpcrun_cct_metrics(cct_node_t* node);
 extern bool hpcrun_cct_is_leaf(cct_node_t* node);
 //
 // NOTE: having no children is not exactly the same as being a leaf
@@ -157,6 +158,11 @@ extern cct_node_t* hpcrun_cct_insert_addr(cct_node_t* cct, cct_addr_t* addr);
 //   it is the last node of a path
 //
 extern void hpcrun_cct_terminate_path(cct_node_t* node);
+
+//
+// attach a metric set to a node (see cct2metrics.h)
+//
+extern void hpcrun_cct_metrics_assoc(cct_node_t* node, metric_set_t* metrics);
 //
 // Special purpose mutator:
 // This operation is somewhat akin to concatenation.
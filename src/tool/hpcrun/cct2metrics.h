@@ -11,21 +11,9 @@
 
 
 //
-// ******** Typedef ********
+// Metric sets are stored in the cct nodes themselves (see
+// hpcrun_cct_metrics), so there is no per-thread map to initialize.
 //
-//
-typedef struct cct2metrics_t cct2metrics_t;
-//
-// ******** initialization
-//
-// The cct2metrics map gets explicit reference
-// only at initialization time.
-//
-// Thereafter, the interface ops refer to it
-// implicitly.
-// [Singleton pattern for GangOf4 enthusiasts]
-
-extern void hpcrun_cct2metrics_init(cct2metrics_t** map);
 
 // ******** Interface operations **********
 // 
@@ -51,8 +39,6 @@ extern bool hpcrun_has_metric_set(cct_node_id_t cct_id);
 
 extern void cct2metrics_assoc(cct_node_t* node, metric_set_t* metrics);
 
-//extern cct2metrics_t* cct2metrics_new(cct_node_id_t node, metric_set_t* metrics);
-
 typedef enum {SET, INCR} update_metric_t;
 
 static inline void
@@ -60,10 +46,7 @@ cct_metric_data_update(int metric_id,
 			  cct_node_t* x, update_metric_t type,
 			  cct_metric_data_t incr)
 {
-  if (! hpcrun_has_metric_set(x)) {
-    cct2metrics_assoc(x, hpcrun_metric_set_new());
-  }
-  metric_set_t* set = hpcrun_get_metric_set(x);
+  metric_set_t* set = hpcrun_reify_metric_set(x);
   
   if (type == SET)
     hpcrun_metric_std_set(metric_id, set, incr);
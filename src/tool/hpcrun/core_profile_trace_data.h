@@ -19,15 +19,12 @@ typedef struct core_profile_trace_data_t {
   // ----------------------------------------
   epoch_t* epoch;
 
-  //metrics: this is needed otherwise 
-  //hpcprof does not pick them up
-  cct2metrics_t* cct2metrics_map;
-
   // ----------------------------------------
   // tracing
   // ----------------------------------------
   uint64_t trace_min_time_us;
   uint64_t trace_max_time_us;
+  uint64_t trace_last_time;  // last record written, in trace clock ticks
 
   // ----------------------------------------
   // IO support
@@ -35,6 +32,8 @@ typedef struct core_profile_trace_data_t {
   FILE* hpcrun_file;
   void* trace_buffer;
   hpcio_outbuf_t trace_outbuf;
+  struct trace_async_channel_t* trace_channel; // HPCRUN_TRACE_ASYNC only
+  struct hpctrace_fmt_block_t* trace_block;    // HPCRUN_TRACE_COMPACT only
 
   // ----------------------------------------
   // Perf support
@@ -75,6 +75,12 @@
 // 6. The bottom of this file has code for an interactive, stand-alone
 // client for testing hpcfnbounds in server mode.
 //
+// 7. If HPCRUN_FNBOUNDS_CACHE names a directory, the answers from the
+// server are also saved there, one file per load module, and later
+// queries for the same file (same path, device, inode, size and mtime) mmap
+// the saved answer instead of asking the server.  The server is then
+// launched only on the first query that misses the cache.
+//
 // Todo:
 //
 
@@ -108,6 +114,7 @@ int zero_fcn(void) { return 0; }
 #include <err.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <limits.h>
 #include <signal.h>
 #include <stdbool.h>
 #include <stdint.h>
@@ -137,6 +144,9 @@ int zero_fcn(void) { return 0; }
 #define FAILURE  -1
 #define END_OF_FILE  -2
 
+#define FNBOUNDS_CACHE_MAGIC    0x666e62636163ULL
+#define FNBOUNDS_CACHE_VERSION  1
+
 enum {
   SYSERV_ACTIVE = 1,
   SYSERV_INACTIVE
@@ -156,6 +166,27 @@ static long mem_limit = SERVER_MEM_LIMIT * 1024;
 static int  num_queries = 0;
 static int  mem_warning = 0;
 
+static int  cache_enabled = 0;
+static char cache_dir[PATH_MAX];
+
+// A cache file holds the array of addresses from the server, then the
+// file name (including \0, padded to 8 bytes) and then this trailer,
+// so that the array starts at the beginning of the mapping.
+//
+struct fnbounds_cache_trailer {
+  uint64_t magic;
+  int32_t  version;
+  int32_t  is_relocatable;
+  uint64_t num_entries;
+  uint64_t reference_offset;
+  uint64_t name_len;
+  uint64_t dev;
+  uint64_t ino;
+  uint64_t size;
+  uint64_t mtime_sec;
+  uint64_t mtime_nsec;
+};
+
 extern char **environ;
 
 
@@ -293,6 +324,191 @@ mmap_anon(size_t size)
 }
 
 
+//*****************************************************************
+// Persistent Cache
+//*****************************************************************
+
+// Fill in the cache file name for 'fname' with status 'st'.
+// Returns: SUCCESS or FAILURE (name too long).
+//
+static int
+cache_path(char *path, const char *fname, const struct stat *st)
+{
+  // FNV-1a hash of the name and the file identity
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  uint64_t key[4] = { st->st_dev, st->st_ino, st->st_size, st->st_mtime };
+
+  for (const char *p = fname; *p != 0; p++) {
+    hash = (hash ^ (unsigned char) *p) * 0x100000001b3ULL;
+  }
+  for (size_t k = 0; k < sizeof(key); k++) {
+    hash = (hash ^ ((unsigned char *) key)[k]) * 0x100000001b3ULL;
+  }
+
+  int n = snprintf(path, PATH_MAX, "%s/%016llx.fnb", cache_dir,
+		   (unsigned long long) hash);
+
+  return (n > 0 && n < PATH_MAX) ? SUCCESS : FAILURE;
+}
+
+
+static size_t
+cache_name_len(const char *fname)
+{
+  return ((strlen(fname) + 1 + 7)/8) * 8;
+}
+
+
+// Returns: mmap of the cached array of addresses for 'fname' and fills
+// in the file header, or else NULL if there is no valid entry.
+//
+static void *
+cache_lookup(const char *fname, const struct stat *st,
+	     struct fnbounds_file_header *fh)
+{
+  char path[PATH_MAX];
+  struct stat cst;
+  struct fnbounds_cache_trailer *tr;
+  size_t name_len = cache_name_len(fname);
+  void *addr;
+  int fd;
+
+  if (cache_path(path, fname, st) != SUCCESS) {
+    return NULL;
+  }
+  fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    return NULL;
+  }
+  if (fstat(fd, &cst) != 0
+      || cst.st_size < (off_t) (name_len + sizeof(*tr))) {
+    close(fd);
+    return NULL;
+  }
+
+  size_t file_size = cst.st_size;
+  addr = mmap(NULL, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (addr == MAP_FAILED) {
+    return NULL;
+  }
+
+  // the key is checked in full: the file name is only a hash
+  char *name = (char *) addr + file_size - sizeof(*tr) - name_len;
+  tr = (struct fnbounds_cache_trailer *) ((char *) addr + file_size - sizeof(*tr));
+  if (tr->magic != FNBOUNDS_CACHE_MAGIC
+      || tr->version != FNBOUNDS_CACHE_VERSION
+      || tr->name_len != name_len
+      || tr->num_entries * sizeof(void *) + name_len + sizeof(*tr) != file_size
+      || tr->dev != (uint64_t) st->st_dev
+      || tr->ino != (uint64_t) st->st_ino
+      || tr->size != (uint64_t) st->st_size
+      || tr->mtime_sec != (uint64_t) st->st_mtim.tv_sec
+      || tr->mtime_nsec != (uint64_t) st->st_mtim.tv_nsec
+      || strncmp(name, fname, name_len) != 0)
+  {
+    TMSG(SYSTEM_SERVER, "cache: stale entry %s for %s", path, fname);
+    munmap(addr, file_size);
+    return NULL;
+  }
+
+  fh->num_entries = tr->num_entries;
+  fh->reference_offset = tr->reference_offset;
+  fh->is_relocatable = tr->is_relocatable;
+  fh->mmap_size = page_align(file_size);
+
+  TMSG(SYSTEM_SERVER, "cache: hit %s for %s", path, fname);
+
+  return addr;
+}
+
+
+// Save the answer from the server for 'fname'.  The entry is written
+// to a temporary file and renamed, so that concurrent processes never
+// see a partial entry.
+//
+static void
+cache_store(const char *fname, const struct stat *st,
+	    void *addr, const struct fnbounds_file_header *fh)
+{
+  char path[PATH_MAX], tmp_path[PATH_MAX];
+  char name[PATH_MAX + 8];
+  struct fnbounds_cache_trailer tr;
+  size_t name_len = cache_name_len(fname);
+  int fd;
+
+  if (name_len > sizeof(name) || cache_path(path, fname, st) != SUCCESS) {
+    return;
+  }
+  int n = snprintf(tmp_path, PATH_MAX, "%s.%d", path, (int) getpid());
+  if (n <= 0 || n >= PATH_MAX) {
+    return;
+  }
+
+  memset(name, 0, name_len);
+  strcpy(name, fname);
+
+  memset(&tr, 0, sizeof(tr));
+  tr.magic = FNBOUNDS_CACHE_MAGIC;
+  tr.version = FNBOUNDS_CACHE_VERSION;
+  tr.is_relocatable = fh->is_relocatable;
+  tr.num_entries = fh->num_entries;
+  tr.reference_offset = fh->reference_offset;
+  tr.name_len = name_len;
+  tr.dev = st->st_dev;
+  tr.ino = st->st_ino;
+  tr.size = st->st_size;
+  tr.mtime_sec = st->st_mtim.tv_sec;
+  tr.mtime_nsec = st->st_mtim.tv_nsec;
+
+  fd = open(tmp_path, O_WRONLY | O_CREAT | O_EXCL, 0644);
+  if (fd < 0) {
+    TMSG(SYSTEM_SERVER, "cache: unable to create %s", tmp_path);
+    return;
+  }
+  int ret = write_all(fd, addr, fh->num_entries * sizeof(void *));
+  if (ret == SUCCESS) {
+    ret = write_all(fd, name, name_len);
+  }
+  if (ret == SUCCESS) {
+    ret = write_all(fd, &tr, sizeof(tr));
+  }
+  if (close(fd) != 0) {
+    ret = FAILURE;
+  }
+
+  if (ret != SUCCESS || rename(tmp_path, path) != 0) {
+    TMSG(SYSTEM_SERVER, "cache: unable to write %s", path);
+    unlink(tmp_path);
+    return;
+  }
+
+  TMSG(SYSTEM_SERVER, "cache: saved %s for %s", path, fname);
+}
+
+
+// Returns: 0 on success (the cache is enabled), else -1.
+static int
+cache_init(void)
+{
+  char *str = getenv("HPCRUN_FNBOUNDS_CACHE");
+
+  if (str == NULL || *str == 0 || strlen(str) >= PATH_MAX - 32) {
+    return -1;
+  }
+  if (mkdir(str, 0755) != 0 && errno != EEXIST) {
+    EMSG("SYSTEM_SERVER: unable to create fnbounds cache %s", str);
+    return -1;
+  }
+  strcpy(cache_dir, str);
+  cache_enabled = 1;
+
+  TMSG(SYSTEM_SERVER, "cache: %s", cache_dir);
+
+  return 0;
+}
+
+
 //*****************************************************************
 // Signal Handler
 //*****************************************************************
@@ -458,6 +674,12 @@ hpcrun_syserv_init(void)
     EMSG("SYSTEM_SERVER ERROR: unable to install handler for SIGPIPE");
   }
 
+  // with a cache, many processes never need the server, so wait for
+  // the first query that misses the cache.
+  if (cache_init() == 0) {
+    return 0;
+  }
+
   launch_server();
 
   // check that the server answers ACK
@@ -506,17 +728,12 @@ hpcrun_syserv_fini(void)
 // Returns: pointer to array of void * and fills in the file header,
 // or else NULL on error.
 //
-void *
-hpcrun_syserv_query(const char *fname, struct fnbounds_file_header *fh)
+static void *
+server_query(const char *fname, struct fnbounds_file_header *fh)
 {
   struct syserv_mesg mesg;
   void *addr;
 
-  if (fname == NULL || fh == NULL) {
-    EMSG("SYSTEM_SERVER ERROR: passed NULL pointer to %s", __func__);
-    return NULL;
-  }
-
   if (client_status != SYSERV_ACTIVE || my_pid != getpid()) {
     launch_server();
   }
@@ -621,6 +838,38 @@ hpcrun_syserv_query(const char *fname, struct fnbounds_file_header *fh)
 }
 
 
+// Returns: pointer to array of void * and fills in the file header,
+// or else NULL on error.
+//
+void *
+hpcrun_syserv_query(const char *fname, struct fnbounds_file_header *fh)
+{
+  struct stat st;
+  void *addr;
+
+  if (fname == NULL || fh == NULL) {
+    EMSG("SYSTEM_SERVER ERROR: passed NULL pointer to %s", __func__);
+    return NULL;
+  }
+
+  if (! cache_enabled || stat(fname, &st) != 0) {
+    return server_query(fname, fh);
+  }
+
+  addr = cache_lookup(fname, &st, fh);
+  if (addr != NULL) {
+    return addr;
+  }
+
+  addr = server_query(fname, fh);
+  if (addr != NULL) {
+    cache_store(fname, &st, addr, fh);
+  }
+
+  return addr;
+}
+
+
 //*****************************************************************
 // Stand Alone Client
 //*****************************************************************
@@ -120,6 +120,16 @@
 #define MAPPING_END(addr, length) \
 	((void *) (((unsigned long) addr) + ((unsigned long) length)))
 
+// number of function bounds remembered by each thread
+#define FNBOUNDS_CACHE_SIZE 8
+
+typedef struct fnbounds_cache_entry_t {
+  void *start;
+  void *end;
+  load_module_t *lm;
+  uint64_t version;   // version of the loadmap the bounds come from
+} fnbounds_cache_entry_t;
+
 
 //*********************************************************************
 // local variables
@@ -140,6 +150,12 @@ static spinlock_t fnbounds_lock = SPINLOCK_UNLOCKED;
 	TD_GET(fnbounds_lock) = 0;		\
 } while (0)
 
+// per-thread cache of the most recent function bounds.
+// samples (and LBR entries) tend to hit the same few functions.
+
+static __thread fnbounds_cache_entry_t fnbounds_cache[FNBOUNDS_CACHE_SIZE];
+static __thread int fnbounds_cache_next = 0;
+
 
 //*********************************************************************
 // forward declarations
@@ -154,6 +170,13 @@ fnbounds_compute(const char *filename, void *start, void *end);
 static void
 fnbounds_map_executable();
 
+static bool
+fnbounds_dso_lookup(dso_info_t *dso, void *ip, void **start, void **end);
+
+static int
+fnbounds_enclosing_addr_lockfree(void *ip, void **start, void **end,
+				 load_module_t **lm);
+
 
 //*********************************************************************
 // interface operations
@@ -187,35 +210,18 @@ fnbounds_init()
 bool
 fnbounds_enclosing_addr(void* ip, void** start, void** end, load_module_t** lm)
 {
+  // common case: the loadmap is stable, no need to lock
+  int found = fnbounds_enclosing_addr_lockfree(ip, start, end, lm);
+  if (found >= 0) {
+    return found;
+  }
+
   FNBOUNDS_LOCK;
 
-  bool ret = false; // failure unless otherwise reset to 0 below
-  
   load_module_t* lm_ = fnbounds_get_loadModule(ip);
   dso_info_t* dso = (lm_) ? lm_->dso_info : NULL;
   
-  if (dso && dso->nsymbols > 0) {
-    void* ip_norm = ip;
-    if (dso->is_relocatable) {
-      ip_norm = (void*) (((unsigned long) ip_norm) - dso->start_to_ref_dist);
-    }
-
-     // no dso table means no enclosing addr
-
-    if (dso->table) {
-      // N.B.: works on normalized IPs
-      int rv = fnbounds_table_lookup(dso->table, dso->nsymbols, ip_norm, 
-				     (void**) start, (void**) end);
-
-      ret = (rv == 0);
-      // Convert 'start' and 'end' into unnormalized IPs since they are
-      // currently normalized.
-      if (rv == 0 && dso->is_relocatable) {
-	*start = PERFORM_RELOCATION(*start, dso->start_to_ref_dist);
-	*end   = PERFORM_RELOCATION(*end  , dso->start_to_ref_dist);
-      }
-    }
-  }
+  bool ret = (dso) ? fnbounds_dso_lookup(dso, ip, start, end) : false;
 
   if (lm) {
     *lm = lm_;
@@ -485,6 +491,102 @@ fnbounds_compute(const char* incoming_filename, void* start, void* end)
 }
 
 
+// fnbounds_dso_lookup(): Given the (unnormalized) IP 'ip', find
+// the bounds of the enclosing function in the table of 'dso'.
+static bool
+fnbounds_dso_lookup(dso_info_t *dso, void *ip, void **start, void **end)
+{
+  bool ret = false; // failure unless otherwise reset to 0 below
+
+  if (dso->nsymbols > 0) {
+    void* ip_norm = ip;
+    if (dso->is_relocatable) {
+      ip_norm = (void*) (((unsigned long) ip_norm) - dso->start_to_ref_dist);
+    }
+
+     // no dso table means no enclosing addr
+
+    if (dso->table) {
+      // N.B.: works on normalized IPs
+      int rv = fnbounds_table_lookup(dso->table, dso->nsymbols, ip_norm, 
+				     (void**) start, (void**) end);
+
+      ret = (rv == 0);
+      // Convert 'start' and 'end' into unnormalized IPs since they are
+      // currently normalized.
+      if (rv == 0 && dso->is_relocatable) {
+	*start = PERFORM_RELOCATION(*start, dso->start_to_ref_dist);
+	*end   = PERFORM_RELOCATION(*end  , dso->start_to_ref_dist);
+      }
+    }
+  }
+  return ret;
+}
+
+
+// fnbounds_enclosing_addr_lockfree(): look up the bounds of the
+// function enclosing 'ip' without taking fnbounds_lock, first in the
+// per-thread cache, then in a snapshot of the loadmap.
+// Returns 1 if found, 0 if not found, and -1 if the loadmap is being
+// updated (or may need to be) and the caller has to lock.
+static int
+fnbounds_enclosing_addr_lockfree(void *ip, void **start, void **end,
+				 load_module_t **lm)
+{
+  uint64_t version;
+
+  if (! hpcrun_loadmap_read_begin(&version)) {
+    return -1;
+  }
+
+  for (int i = 0; i < FNBOUNDS_CACHE_SIZE; i++) {
+    fnbounds_cache_entry_t *e = &fnbounds_cache[i];
+    if (e->version == version && e->start <= ip && ip < e->end) {
+      *start = e->start;
+      *end   = e->end;
+      if (lm) *lm = e->lm;
+      return 1;
+    }
+  }
+
+  // copy the dso descriptor: it may be recycled by a concurrent unmap,
+  // and it may only be used once the version has been validated.
+  load_module_t *lm_ = hpcrun_loadmap_findByAddr(ip, ip);
+  dso_info_t *dso_ptr = (lm_) ? lm_->dso_info : NULL;
+  dso_info_t dso;
+  if (dso_ptr) {
+    dso = *dso_ptr;
+  }
+
+  if (! hpcrun_loadmap_read_validate(version)) {
+    return -1;
+  }
+
+  if (! dso_ptr) {
+    // the module may be in the middle of a dlopen: see
+    // fnbounds_get_loadModule()
+    if (ENABLED(DLOPEN_RISKY) && hpcrun_dlopen_pending() > 0) {
+      return -1;
+    }
+    if (lm) *lm = lm_;
+    return 0;
+  }
+
+  bool ret = fnbounds_dso_lookup(&dso, ip, start, end);
+  if (lm) *lm = lm_;
+
+  if (ret) {
+    fnbounds_cache_entry_t *e = &fnbounds_cache[fnbounds_cache_next];
+    fnbounds_cache_next = (fnbounds_cache_next + 1) % FNBOUNDS_CACHE_SIZE;
+    e->start   = *start;
+    e->end     = *end;
+    e->lm      = lm_;
+    e->version = version;
+  }
+  return ret;
+}
+
+
 // fnbounds_get_loadModule(): Given the (unnormalized) IP 'ip',
 // attempt to return the enclosing load module.  Note that the
 // function may fail.
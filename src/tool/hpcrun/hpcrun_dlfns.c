@@ -93,9 +93,28 @@
 // sampling will never be blocked in this case.  But we keep the write
 // locks for the benefit of the fnbounds functions.
 //
+// Readers take a read lock on every sample, so they never touch
+// 'dlopen_lock'.  A reader counts itself in one of several reader
+// counts, picked by its thread number and each in its own cache line,
+// and then checks that no writer came in meanwhile.  A writer first
+// announces itself in 'dlopen_num_writers' and then waits for the sum
+// of the reader counts to drop to zero.  Both sides write and then read
+// with sequentially consistent atomics, so at least one of them sees
+// the other one.
+//
+#define DLOPEN_NUM_READER_SLOTS  64
+#define DLOPEN_CACHE_LINE_SZ     64
+
+typedef struct dlopen_reader_slot_s {
+  atomic_long num_readers;
+  char pad[DLOPEN_CACHE_LINE_SZ - sizeof(atomic_long)];
+} dlopen_reader_slot_t;
+
+static dlopen_reader_slot_t dlopen_readers[DLOPEN_NUM_READER_SLOTS]
+  __attribute__ ((aligned (DLOPEN_CACHE_LINE_SZ)));
+
 static spinlock_t dlopen_lock = SPINLOCK_UNLOCKED;
-static atomic_long dlopen_num_readers = ATOMIC_VAR_INIT(0);
-static volatile long dlopen_num_writers = 0;
+static atomic_long dlopen_num_writers = ATOMIC_VAR_INIT(0);
 static int  dlopen_writer_tid = -1;
 static atomic_long num_dlopen_pending = ATOMIC_VAR_INIT(0);
 
@@ -108,6 +127,29 @@ hpcrun_dlopen_pending(void)
 }
 
 
+// The reader count of the calling thread.  A thread always unlocks
+// in the slot where it locked.
+static inline atomic_long *
+dlopen_reader_slot(void)
+{
+  unsigned int tid = (unsigned int) monitor_get_thread_num();
+  return &dlopen_readers[tid % DLOPEN_NUM_READER_SLOTS].num_readers;
+}
+
+
+static long
+dlopen_num_readers(void)
+{
+  long sum = 0;
+  int i;
+
+  for (i = 0; i < DLOPEN_NUM_READER_SLOTS; i++) {
+    sum += atomic_load(&dlopen_readers[i].num_readers);
+  }
+  return sum;
+}
+
+
 // Writers always wait until they acquire the lock.  Now allow writers
 // to lock against themselves, but only in the same thread.
 static void
@@ -118,8 +160,9 @@ hpcrun_dlopen_write_lock(void)
 
   do {
     spinlock_lock(&dlopen_lock);
-    if (dlopen_num_writers == 0 || tid == dlopen_writer_tid) {
-      dlopen_num_writers++;
+    if (atomic_load_explicit(&dlopen_num_writers, memory_order_relaxed) == 0
+	|| tid == dlopen_writer_tid) {
+      atomic_fetch_add(&dlopen_num_writers, 1L);
       dlopen_writer_tid = tid;
       acquire = 1;
     }
@@ -128,7 +171,7 @@ hpcrun_dlopen_write_lock(void)
 
   // Wait for any readers to finish.
   if (! ENABLED(DLOPEN_RISKY)) {
-    while (atomic_load_explicit(&dlopen_num_readers, memory_order_relaxed) > 0) ;
+    while (dlopen_num_readers() > 0) ;
   }
 }
 
@@ -136,7 +179,7 @@ hpcrun_dlopen_write_lock(void)
 static void
 hpcrun_dlopen_write_unlock(void)
 {
-  dlopen_num_writers--;
+  atomic_fetch_add_explicit(&dlopen_num_writers, -1L, memory_order_release);
 }
 
 
@@ -145,33 +188,49 @@ hpcrun_dlopen_write_unlock(void)
 static void
 hpcrun_dlopen_downgrade_lock(void)
 {
-  atomic_fetch_add_explicit(&dlopen_num_readers, 1L, memory_order_relaxed);
-  dlopen_num_writers = 0;
+  atomic_fetch_add_explicit(dlopen_reader_slot(), 1L, memory_order_relaxed);
+  atomic_store_explicit(&dlopen_num_writers, 0L, memory_order_release);
 }
 
 
 // Readers try to acquire a lock, but they don't wait if that fails.
+// With no writer around, that is a relaxed load of 'dlopen_num_writers'
+// (to give up early), a seq_cst fetch_add on the reader slot, which
+// few other threads use, and a seq_cst reload of 'dlopen_num_writers'.
+// The last two pair Dekker-style with the writer's seq_cst increment of
+// 'dlopen_num_writers' and seq_cst loads of the slots: the reader sees
+// the writer, or the writer sees the reader, or both.  The uncontended
+// cost is thus one locked read-modify-write on a mostly private line.
 // Returns: 1 if acquired, else 0 if not.
 int
 hpcrun_dlopen_read_lock(void)
 {
-  int acquire = 0;
+  atomic_long *slot = dlopen_reader_slot();
+
+  if (ENABLED(DLOPEN_RISKY)) {
+    atomic_fetch_add_explicit(slot, 1L, memory_order_relaxed);
+    return 1;
+  }
+
+  if (atomic_load_explicit(&dlopen_num_writers, memory_order_relaxed) != 0) {
+    return 0;
+  }
 
-  spinlock_lock(&dlopen_lock);
-  if (dlopen_num_writers == 0 || ENABLED(DLOPEN_RISKY)) {
-    atomic_fetch_add_explicit(&dlopen_num_readers, 1L, memory_order_relaxed);
-    acquire = 1;
+  atomic_fetch_add(slot, 1L);
+  if (atomic_load(&dlopen_num_writers) != 0) {
+    // lost the race with a writer
+    atomic_fetch_add_explicit(slot, -1L, memory_order_release);
+    return 0;
   }
-  spinlock_unlock(&dlopen_lock);
 
-  return (acquire);
+  return 1;
 }
 
 
 void
 hpcrun_dlopen_read_unlock(void)
 {
-  atomic_fetch_add_explicit(&dlopen_num_readers, -1L, memory_order_relaxed);
+  atomic_fetch_add_explicit(dlopen_reader_slot(), -1L, memory_order_release);
 }
 
 
@@ -192,7 +251,8 @@ hpcrun_pre_dlopen(const char *path, int flags)
 void 
 hpcrun_dlopen(const char *module_name, int flags, void *handle)
 {
-  int outermost = (dlopen_num_writers == 1);
+  int outermost =
+    (atomic_load_explicit(&dlopen_num_writers, memory_order_relaxed) == 1);
 
   TMSG(LOADMAP, "dlopen: handle = %p, name = %s", handle, module_name);
   if (outermost) {
@@ -224,7 +284,8 @@ hpcrun_dlclose(void *handle)
 void
 hpcrun_post_dlclose(void *handle, int ret)
 {
-  int outermost = (dlopen_num_writers == 1);
+  int outermost =
+    (atomic_load_explicit(&dlopen_num_writers, memory_order_relaxed) == 1);
 
   TMSG(LOADMAP, "dlclose: handle = %p", handle);
   fnbounds_unmap_closed_dsos();
@@ -79,6 +79,10 @@ static atomic_long trolled = ATOMIC_VAR_INIT(0);
 static atomic_long frames_total = ATOMIC_VAR_INIT(0);
 static atomic_long trolled_frames = ATOMIC_VAR_INIT(0);
 
+static atomic_long shadow_memory = ATOMIC_VAR_INIT(0);
+
+static atomic_long trace_records_dropped = ATOMIC_VAR_INIT(0);
+
 //***************************************************************************
 // interface operations
 //***************************************************************************
@@ -97,6 +101,8 @@ hpcrun_stats_reinit(void)
   atomic_store_explicit(&trolled, 0, memory_order_relaxed);
   atomic_store_explicit(&frames_total, 0, memory_order_relaxed);
   atomic_store_explicit(&trolled_frames, 0, memory_order_relaxed);
+  atomic_store_explicit(&shadow_memory, 0, memory_order_relaxed);
+  atomic_store_explicit(&trace_records_dropped, 0, memory_order_relaxed);
 }
 
 
@@ -331,6 +337,38 @@ hpcrun_stats_num_samples_yielded(void)
   return atomic_load_explicit(&num_samples_yielded, memory_order_relaxed);
 }
 
+//----------------------------
+// bytes reserved for false-sharing shadow memory
+//----------------------------
+
+void
+hpcrun_stats_shadow_memory_inc(long amt)
+{
+  atomic_fetch_add_explicit(&shadow_memory, amt, memory_order_relaxed);
+}
+
+long
+hpcrun_stats_shadow_memory(void)
+{
+  return atomic_load_explicit(&shadow_memory, memory_order_relaxed);
+}
+
+//----------------------------
+// trace records dropped because the trace writer fell behind
+//----------------------------
+
+void
+hpcrun_stats_trace_records_dropped_inc(long amt)
+{
+  atomic_fetch_add_explicit(&trace_records_dropped, amt, memory_order_relaxed);
+}
+
+long
+hpcrun_stats_trace_records_dropped(void)
+{
+  return atomic_load_explicit(&trace_records_dropped, memory_order_relaxed);
+}
+
 //-----------------------------
 // print summary
 //-----------------------------
@@ -350,6 +388,11 @@ hpcrun_stats_print_summary(void)
 
   hpcrun_memory_summary();
 
+  long shadow = atomic_load_explicit(&shadow_memory, memory_order_relaxed);
+  if (shadow > 0) {
+    AMSG("SHADOW MEMORY: %.1f meg reserved", ((double) shadow) / 1048576.0);
+  }
+
   AMSG("SAMPLE ANOMALIES: blocks: %ld (async: %ld, dlopen: %ld), "
        "errors: %ld (segv: %ld, soft: %ld)",
        blocked, num_samples_blocked_async, num_samples_blocked_dlopen,
@@ -362,6 +405,11 @@ hpcrun_stats_print_summary(void)
        frames_total, trolled_frames,
        num_unwind_intervals_total,  num_unwind_intervals_suspicious);
 
+  long trace_dropped = atomic_load_explicit(&trace_records_dropped, memory_order_relaxed);
+  if (trace_dropped > 0) {
+    AMSG("TRACE: %ld records dropped (trace writer fell behind)", trace_dropped);
+  }
+
   if (hpcrun_get_disabled()) {
     AMSG("SAMPLING HAS BEEN DISABLED");
   }
@@ -158,6 +158,20 @@ long hpcrun_stats_frames_total(void);
 void hpcrun_stats_trolled_frames_inc(long amt);
 long hpcrun_stats_trolled_frames(void);
 
+//----------------------------
+// bytes reserved for false-sharing shadow memory
+//----------------------------
+
+void hpcrun_stats_shadow_memory_inc(long amt);
+long hpcrun_stats_shadow_memory(void);
+
+//----------------------------
+// trace records dropped because the trace writer fell behind
+//----------------------------
+
+void hpcrun_stats_trace_records_dropped_inc(long amt);
+long hpcrun_stats_trace_records_dropped(void);
+
 //-----------------------------
 // print summary
 //-----------------------------
@@ -57,6 +57,7 @@
 
 #include <lib/prof-lean/hpcfmt.h>
 #include <lib/prof-lean/spinlock.h>
+#include <lib/prof-lean/stdatomic.h>
 
 #define LOADMAP_DEBUG 0
 
@@ -71,6 +72,51 @@ static dso_info_t* s_dso_free_list = NULL;
 /* locking functions to ensure that loadmaps are consistent */
 static spinlock_t loadmap_lock = SPINLOCK_UNLOCKED;
 
+/* 
+ * seqlock-style publication of loadmap updates for lock-free readers:
+ * an update increments s_update_begin before modifying the loadmap and
+ * s_update_end afterwards. the loadmap is stable while both are equal.
+ * load modules are never freed and dso_info_t are only recycled, so a
+ * reader racing with an update never follows a dangling pointer; it
+ * only has to discard what it read.
+ */
+static atomic_ulong s_update_begin = ATOMIC_VAR_INIT(0);
+static atomic_ulong s_update_end   = ATOMIC_VAR_INIT(0);
+
+/*
+ * index of the address ranges of the mapped load modules, sorted by
+ * start address, for hpcrun_loadmap_findByAddr(). an update rebuilds
+ * the buffer that is not published and then publishes it. a reader
+ * may still be searching that buffer, so it validates what it found
+ * with the seqlock above and otherwise scans the load modules. a
+ * buffer only grows (by doubling), and its capacity never changes, so
+ * even a racing reader stays within it. if some ranges overlap, the
+ * index is not used and the load modules are scanned as before.
+ */
+typedef struct loadmap_interval_t {
+  void* start;
+  void* end;
+  load_module_t* lm;
+} loadmap_interval_t;
+
+typedef struct loadmap_index_t {
+  unsigned long version;  // changes with each rebuild
+  bool has_overlap;
+  int size;
+  int capacity;           // fixed when the buffer is allocated
+  loadmap_interval_t ivals[];
+} loadmap_index_t;
+
+static loadmap_index_t* s_index[2];
+static atomic_uintptr_t s_index_ptr = ATOMIC_VAR_INIT(0);
+static unsigned long s_index_version = 0; // never reset (cf. fork)
+
+/* per-thread copy of the last range found in the index */
+static __thread unsigned long s_lastHit_version = 0;
+static __thread void* s_lastHit_start = NULL;
+static __thread void* s_lastHit_end = NULL;
+static __thread load_module_t* s_lastHit_lm = NULL;
+
 static loadmap_notify_t *notification_recipients = NULL;
 
 void
@@ -103,6 +149,39 @@ hpcrun_loadmap_notify_unmap(void *start, void *end)
 }
 
 
+static void
+hpcrun_loadmap_update_begin()
+{
+  atomic_fetch_add_explicit(&s_update_begin, 1, memory_order_seq_cst);
+}
+
+
+static void
+hpcrun_loadmap_update_end()
+{
+  atomic_fetch_add_explicit(&s_update_end, 1, memory_order_release);
+}
+
+
+bool
+hpcrun_loadmap_read_begin(uint64_t *version)
+{
+  unsigned long end   = atomic_load_explicit(&s_update_end, memory_order_acquire);
+  unsigned long begin = atomic_load_explicit(&s_update_begin, memory_order_acquire);
+
+  *version = begin;
+  return (begin == end);
+}
+
+
+bool
+hpcrun_loadmap_read_validate(uint64_t version)
+{
+  atomic_thread_fence(memory_order_acquire);
+  return (atomic_load_explicit(&s_update_begin, memory_order_relaxed) == version);
+}
+
+
 //***************************************************************************
 // 
 //***************************************************************************
@@ -284,10 +363,119 @@ hpcrun_loadmap_print(hpcrun_loadmap_t* loadmap)
 
 //***************************************************************************
 
+// rebuild the index of address ranges after an update of the loadmap.
+// updates are serialized by their callers, between
+// hpcrun_loadmap_update_begin() and hpcrun_loadmap_update_end().
+static void
+hpcrun_loadmap_index_rebuild()
+{
+  loadmap_index_t* cur = (loadmap_index_t*)
+    atomic_load_explicit(&s_index_ptr, memory_order_relaxed);
+  int b = (cur == s_index[0]) ? 1 : 0;
+
+  int n = 0;
+  for (load_module_t* x = s_loadmap_ptr->lm_head; (x); x = x->next) {
+    if (x->dso_info) n++;
+  }
+
+  if (s_index[b] == NULL || n > s_index[b]->capacity) {
+    int capacity = (s_index[b] != NULL) ? s_index[b]->capacity : 64;
+    while (capacity < n) capacity *= 2;
+    // the smaller buffer cannot be freed, but doubling bounds the waste
+    loadmap_index_t* buf = hpcrun_malloc(sizeof(loadmap_index_t)
+					 + capacity * sizeof(loadmap_interval_t));
+    if (buf == NULL) {
+      // keep scanning the load modules
+      atomic_store_explicit(&s_index_ptr, 0, memory_order_release);
+      return;
+    }
+    buf->capacity = capacity;
+    s_index[b] = buf;
+  }
+  loadmap_index_t* idx = s_index[b];
+
+  // insertion sort: modules are mostly added at increasing addresses,
+  // and qsort() may call malloc()
+  int size = 0;
+  for (load_module_t* x = s_loadmap_ptr->lm_head; (x); x = x->next) {
+    dso_info_t* dso = x->dso_info;
+    if (dso == NULL) continue;
+    int i = size++;
+    while (i > 0 && idx->ivals[i - 1].start > dso->start_addr) {
+      idx->ivals[i] = idx->ivals[i - 1];
+      i--;
+    }
+    idx->ivals[i] = (loadmap_interval_t) {
+      .start = dso->start_addr, .end = dso->end_addr, .lm = x };
+  }
+
+  idx->has_overlap = false;
+  for (int i = 1; i < size; i++) {
+    if (idx->ivals[i].start <= idx->ivals[i - 1].end) {
+      idx->has_overlap = true;
+    }
+  }
+  idx->size = size;
+  idx->version = ++s_index_version;
+
+  atomic_store_explicit(&s_index_ptr, (uintptr_t) idx, memory_order_release);
+}
+
+
 load_module_t*
 hpcrun_loadmap_findByAddr(void* begin, void* end)
 {
   TMSG(LOADMAP, "find by address %p -- %p", begin, end);
+
+  // the index is only used outside of an update, and what was found in
+  // it only if no update started meanwhile
+  uint64_t version;
+  loadmap_index_t* idx = NULL;
+  if (hpcrun_loadmap_read_begin(&version)) {
+    idx = (loadmap_index_t*) atomic_load_explicit(&s_index_ptr,
+						  memory_order_acquire);
+  }
+
+  if (idx && ! idx->has_overlap) {
+    unsigned long idx_version = idx->version;
+    if (s_lastHit_version == idx_version
+	&& s_lastHit_start <= begin && end <= s_lastHit_end
+	&& hpcrun_loadmap_read_validate(version)) {
+      return s_lastHit_lm;
+    }
+
+    // find the last range that starts at or before 'begin'
+    int size = idx->size;
+    if (size > idx->capacity) size = idx->capacity;
+    int lo = 0, hi = size;
+    while (lo < hi) {
+      int mid = lo + (hi - lo) / 2;
+      if (idx->ivals[mid].start <= begin) {
+	lo = mid + 1;
+      }
+      else {
+	hi = mid;
+      }
+    }
+
+    loadmap_interval_t ival = { NULL, NULL, NULL };
+    if (lo > 0) {
+      ival = idx->ivals[lo - 1];
+    }
+    if (hpcrun_loadmap_read_validate(version)) {
+      if (lo > 0 && end <= ival.end) {
+	s_lastHit_version = idx_version;
+	s_lastHit_start = ival.start;
+	s_lastHit_end = ival.end;
+	s_lastHit_lm = ival.lm;
+	return ival.lm;
+      }
+      TMSG(LOADMAP, "       --->(NOT FOUND)");
+      return NULL;
+    }
+    // raced with an update: scan the load modules
+  }
+
   for (load_module_t* x = s_loadmap_ptr->lm_head; (x); x = x->next) {
     TMSG(LOADMAP, "\tload module %s", x->name);
     if (x->dso_info) {
@@ -418,6 +606,8 @@ hpcrun_loadmap_map(dso_info_t* dso)
   const char* msg = "";
 
   TMSG(LOADMAP, "map in dso %s", dso->name);
+  hpcrun_loadmap_update_begin();
+
   // -------------------------------------------------------
   // Find or create a load_module_t: if a load module exists
   // with same name, reuse it; otherwise create a new entry
@@ -449,6 +639,9 @@ hpcrun_loadmap_map(dso_info_t* dso)
                                   lm->dso_info->end_addr);
   }
 
+  hpcrun_loadmap_index_rebuild();
+  hpcrun_loadmap_update_end();
+
   TMSG(LOADMAP, "hpcrun_loadmap_map: '%s' size=%d %s",
        dso->name, s_loadmap_ptr->size, msg);
 
@@ -468,6 +661,8 @@ hpcrun_loadmap_unmap(load_module_t* lm)
   void *start_addr = old_dso->start_addr;
   void *end_addr = old_dso->end_addr;
 
+  hpcrun_loadmap_update_begin();
+
   lm->dso_info = NULL;
 
   // tallent: For now, do not move the loadmap to the back of the
@@ -483,6 +678,10 @@ hpcrun_loadmap_unmap(load_module_t* lm)
     s_dso_free_list->prev = old_dso;
   }
   s_dso_free_list = old_dso;
+
+  hpcrun_loadmap_index_rebuild();
+  hpcrun_loadmap_update_end();
+
   TMSG(LOADMAP, "Deleting unw intervals");
 
 #if LOADMAP_DEBUG
@@ -502,8 +701,10 @@ hpcrun_loadmap_unmap(load_module_t* lm)
 uint16_t 
 hpcrun_loadModule_add(const char* name)
 {
+  hpcrun_loadmap_update_begin();
   load_module_t *lm = hpcrun_loadModule_new(name);
   hpcrun_loadmap_pushFront(lm);
+  hpcrun_loadmap_update_end();
   return lm->id;
 }
 
@@ -521,6 +722,10 @@ hpcrun_initLoadmap()
   hpcrun_loadmap_init(s_loadmap_ptr);
 
   s_dso_free_list = NULL;
+
+  hpcrun_loadmap_update_begin();
+  hpcrun_loadmap_index_rebuild();
+  hpcrun_loadmap_update_end();
 }
 
 
@@ -47,6 +47,8 @@
 #ifndef LOADMAP_H
 #define LOADMAP_H
 
+#include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 
 /* an "loadmap" is an interval of time during which no two dynamic 
@@ -168,6 +170,17 @@ int
 hpcrun_loadmap_isLocked();
 
 
+// lock-free readers: take the version of the loadmap before reading it,
+// and validate the version once done. what was read is consistent only
+// if both calls return true. updates (map, unmap) remain serialized by
+// their callers.
+bool
+hpcrun_loadmap_read_begin(uint64_t *version);
+
+bool
+hpcrun_loadmap_read_validate(uint64_t version);
+
+
 // ---------------------------------------------------------
 // 
 // ---------------------------------------------------------
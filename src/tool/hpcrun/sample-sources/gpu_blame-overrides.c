@@ -744,11 +744,11 @@ static inline core_profile_trace_data_t *hpcrun_stream_data_alloc_init(int id) {
     hpcrun_cct_bundle_init(&(st->epoch->csdata), (st->epoch->csdata).ctxt);
     st->epoch->loadmap = hpcrun_getLoadmap();
     st->epoch->next  = NULL;
-    hpcrun_cct2metrics_init(&(st->cct2metrics_map)); //this just does st->map = NULL;
     
     
     st->trace_min_time_us = 0;
     st->trace_max_time_us = 0;
+    st->trace_last_time = 0;
     st->hpcrun_file  = NULL;
     
     return st;
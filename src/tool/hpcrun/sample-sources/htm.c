@@ -1,10 +1,16 @@
 #include "htm.h"
 
+#include <stdlib.h>
+#include <string.h>
+#include <linux/version.h>
+
 #include "fnbounds/fnbounds_interface.h"
 #include "sample-sources/perf/perf-util.h"
 #include "sample-sources/shadow-memory.h"
 #include "unwind/x86-family/x86-decoder.h"
 
+#define HPCRUN_OPTION_HTM_LBR "HPCRUN_HTM_LBR"
+
 htm_metric_abort_t htm_metric_abort = {-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1};
 htm_metric_cyc_t htm_metric_cyc = {-1,-1,-1,-1};
 htm_metric_mem_t htm_metric_mem = {-1,-1,-1};
@@ -24,6 +30,64 @@ static uint64_t get_next_ip(uint64_t ip) {
   return 0;
 }
 
+int htm_lbr_is_enabled(void)
+{
+  static int lbr_enabled = -1;
+  if (lbr_enabled < 0) {
+    const char *val = getenv(HPCRUN_OPTION_HTM_LBR);
+    lbr_enabled = (val == NULL || atoi(val) != 0);
+  }
+  return lbr_enabled;
+}
+
+htm_event_role_t htm_event_role(const char *event_name)
+{
+  if (strstr(event_name, "cycles")) {
+    return HTM_ROLE_CYCLES;
+  }
+  if (strstr(event_name, "RTM_RETIRED:ABORTED")) {
+    return HTM_ROLE_RTM_ABORT;
+  }
+  if (strstr(event_name, "MEM_UOPS_RETIRED:ALL_LOADS")) {
+    return HTM_ROLE_LOAD;
+  }
+  if (strstr(event_name, "MEM_UOPS_RETIRED:ALL_STORES")) {
+    return HTM_ROLE_STORE;
+  }
+  return HTM_ROLE_OTHER;
+}
+
+u64 htm_sample_type(htm_event_role_t role)
+{
+  u64 sample_type = 0;
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(3,4,0)
+  if (htm_lbr_is_enabled()) {
+    // call path recovery of any sample taken in an aborted transaction,
+    // and in-HTM cycles attribution if available
+    sample_type |= PERF_SAMPLE_BRANCH_STACK;
+  }
+#endif
+  switch (role) {
+    case HTM_ROLE_RTM_ABORT:
+      // abort latency and abort reason
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(3,10,0)
+      sample_type |= PERF_SAMPLE_WEIGHT;
+#endif
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(3,13,0)
+      sample_type |= PERF_SAMPLE_TRANSACTION;
+#endif
+      break;
+    case HTM_ROLE_LOAD:
+    case HTM_ROLE_STORE:
+      // false sharing detection
+      sample_type |= PERF_SAMPLE_ADDR | PERF_SAMPLE_TID;
+      break;
+    default:
+      break;
+  }
+  return sample_type;
+}
+
 /*
  * Constructs a call path from LBRs.
  * input: lbr, bnr, current_ip (IP of the current sample)
@@ -100,76 +164,97 @@ cct_node_t * htm_add_missing_call_path_from_lbr(
   return node;
 }
 
-void htm_attribute_derived_metrics(
-  char *event_name,
+static void htm_attribute_cycles(
   perf_mmap_data_t *mmap_data,
   cct_node_t *node,
   double increment
 ){
-  if (strstr(event_name, "cycles")) {
-    unsigned int status_id = get_tsx_status(0);
-    if (mmap_data->bnr > 0 && mmap_data->bnr <= MAX_LBR_ENTRIES) {
-      if (mmap_data->lbr[0].abort == 1) {
-        cct_metric_data_increment(htm_metric_cyc.in_htm_metric_id, node, (hpcrun_metricVal_t){.r = increment});
-        return;
-      }
-    } else {
-      if ((status_id & 0b11) == 0b11 ) {
-        cct_metric_data_increment(htm_metric_cyc.in_htm_metric_id, node, (hpcrun_metricVal_t){.r = increment});
-        return;
-      }
-    }
-    if ((status_id & 0b101) == 0b101){
-      cct_metric_data_increment(htm_metric_cyc.in_fallback_metric_id, node, (hpcrun_metricVal_t){.r = increment});
-      return;
-    }
-    if ((status_id & 0b1001) == 0b1001){
-      cct_metric_data_increment(htm_metric_cyc.in_lockwaiting_metric_id, node, (hpcrun_metricVal_t){.r = increment});
+  unsigned int status_id = get_tsx_status(0);
+  if (mmap_data->bnr > 0 && mmap_data->bnr <= MAX_LBR_ENTRIES) {
+    if (mmap_data->lbr[0].abort == 1) {
+      cct_metric_data_increment(htm_metric_cyc.in_htm_metric_id, node, (hpcrun_metricVal_t){.r = increment});
       return;
     }
-    if ( (status_id & 0b1) == 0b1 ) {
-      cct_metric_data_increment(htm_metric_cyc.in_other_metric_id, node, (hpcrun_metricVal_t){.r = increment});
+  } else {
+    if ((status_id & 0b11) == 0b11 ) {
+      cct_metric_data_increment(htm_metric_cyc.in_htm_metric_id, node, (hpcrun_metricVal_t){.r = increment});
       return;
     }
   }
-    
-  if (strstr(event_name, "RTM_RETIRED:ABORTED")) {
-    // update the weight metric of the transaction
-    cct_metric_data_increment(htm_metric_abort.weight_metric_id, node, (hpcrun_metricVal_t){.r = increment * mmap_data->weight});
-    // attribute based on the abort reason
-    if (mmap_data->transaction & PERF_TXN_CONFLICT) {
-      cct_metric_data_increment(htm_metric_abort.conflict_metric_id, node, (hpcrun_metricVal_t) {.r = increment});
-      cct_metric_data_increment(htm_metric_abort.conflict_weight_metric_id, node, (hpcrun_metricVal_t) {.r = increment * mmap_data->weight});
-    }
-    if (mmap_data->transaction & PERF_TXN_CAPACITY_READ) {
-      cct_metric_data_increment(htm_metric_abort.capacity_read_metric_id, node, (hpcrun_metricVal_t) {.r = increment});
-      cct_metric_data_increment(htm_metric_abort.capacity_read_weight_metric_id, node, (hpcrun_metricVal_t) {.r = increment * mmap_data->weight});
-    }
-    if (mmap_data->transaction & PERF_TXN_CAPACITY_WRITE) {
-      cct_metric_data_increment(htm_metric_abort.capacity_write_metric_id, node, (hpcrun_metricVal_t) {.r = increment});
-      cct_metric_data_increment(htm_metric_abort.capacity_write_weight_metric_id, node, (hpcrun_metricVal_t) {.r = increment * mmap_data->weight});
-    }
-    if (mmap_data->transaction & PERF_TXN_SYNC) {
-      cct_metric_data_increment(htm_metric_abort.sync_metric_id, node, (hpcrun_metricVal_t) {.r = increment});
-      cct_metric_data_increment(htm_metric_abort.sync_weight_metric_id, node, (hpcrun_metricVal_t) {.r = increment * mmap_data->weight});
-    }
-    if (mmap_data->transaction & PERF_TXN_ASYNC) {
-      cct_metric_data_increment(htm_metric_abort.async_metric_id, node, (hpcrun_metricVal_t) {.r = increment});
-      cct_metric_data_increment(htm_metric_abort.async_weight_metric_id, node, (hpcrun_metricVal_t) {.r = increment * mmap_data->weight});
-    }
+  if ((status_id & 0b101) == 0b101){
+    cct_metric_data_increment(htm_metric_cyc.in_fallback_metric_id, node, (hpcrun_metricVal_t){.r = increment});
+    return;
   }
-     
-  if (strstr(event_name, "MEM_UOPS_RETIRED:ALL_LOADS")) {
-    int count = htm_record_and_get_contention(mmap_data->addr, mmap_data->tid, 0 /*is_write*/);
-    cct_metric_data_increment(htm_metric_mem.false_sharing_id, node, (hpcrun_metricVal_t) {.r = increment * count});
+  if ((status_id & 0b1001) == 0b1001){
+    cct_metric_data_increment(htm_metric_cyc.in_lockwaiting_metric_id, node, (hpcrun_metricVal_t){.r = increment});
     return;
   }
-
-  if (strstr(event_name, "MEM_UOPS_RETIRED:ALL_STORES")) {
-    int count = htm_record_and_get_contention(mmap_data->addr, mmap_data->tid, 1 /*is_write*/);
-    cct_metric_data_increment(htm_metric_mem.false_sharing_id, node, (hpcrun_metricVal_t) {.r = increment * count});
+  if ( (status_id & 0b1) == 0b1 ) {
+    cct_metric_data_increment(htm_metric_cyc.in_other_metric_id, node, (hpcrun_metricVal_t){.r = increment});
     return;
   }
-} 
+}
 
+static void htm_attribute_abort(
+  perf_mmap_data_t *mmap_data,
+  cct_node_t *node,
+  double increment
+){
+  // update the weight metric of the transaction
+  cct_metric_data_increment(htm_metric_abort.weight_metric_id, node, (hpcrun_metricVal_t){.r = increment * mmap_data->weight});
+  // attribute based on the abort reason
+  if (mmap_data->transaction & PERF_TXN_CONFLICT) {
+    cct_metric_data_increment(htm_metric_abort.conflict_metric_id, node, (hpcrun_metricVal_t) {.r = increment});
+    cct_metric_data_increment(htm_metric_abort.conflict_weight_metric_id, node, (hpcrun_metricVal_t) {.r = increment * mmap_data->weight});
+  }
+  if (mmap_data->transaction & PERF_TXN_CAPACITY_READ) {
+    cct_metric_data_increment(htm_metric_abort.capacity_read_metric_id, node, (hpcrun_metricVal_t) {.r = increment});
+    cct_metric_data_increment(htm_metric_abort.capacity_read_weight_metric_id, node, (hpcrun_metricVal_t) {.r = increment * mmap_data->weight});
+  }
+  if (mmap_data->transaction & PERF_TXN_CAPACITY_WRITE) {
+    cct_metric_data_increment(htm_metric_abort.capacity_write_metric_id, node, (hpcrun_metricVal_t) {.r = increment});
+    cct_metric_data_increment(htm_metric_abort.capacity_write_weight_metric_id, node, (hpcrun_metricVal_t) {.r = increment * mmap_data->weight});
+  }
+  if (mmap_data->transaction & PERF_TXN_SYNC) {
+    cct_metric_data_increment(htm_metric_abort.sync_metric_id, node, (hpcrun_metricVal_t) {.r = increment});
+    cct_metric_data_increment(htm_metric_abort.sync_weight_metric_id, node, (hpcrun_metricVal_t) {.r = increment * mmap_data->weight});
+  }
+  if (mmap_data->transaction & PERF_TXN_ASYNC) {
+    cct_metric_data_increment(htm_metric_abort.async_metric_id, node, (hpcrun_metricVal_t) {.r = increment});
+    cct_metric_data_increment(htm_metric_abort.async_weight_metric_id, node, (hpcrun_metricVal_t) {.r = increment * mmap_data->weight});
+  }
+}
 
+static void htm_attribute_mem(
+  perf_mmap_data_t *mmap_data,
+  cct_node_t *node,
+  double increment,
+  int is_write
+){
+  int count = htm_record_and_get_contention(mmap_data->addr, mmap_data->tid, is_write);
+  cct_metric_data_increment(htm_metric_mem.false_sharing_id, node, (hpcrun_metricVal_t) {.r = increment * count});
+}
+
+void htm_attribute_derived_metrics(
+  htm_event_role_t role,
+  perf_mmap_data_t *mmap_data,
+  cct_node_t *node,
+  double increment
+){
+  switch (role) {
+    case HTM_ROLE_CYCLES:
+      htm_attribute_cycles(mmap_data, node, increment);
+      break;
+    case HTM_ROLE_RTM_ABORT:
+      htm_attribute_abort(mmap_data, node, increment);
+      break;
+    case HTM_ROLE_LOAD:
+      htm_attribute_mem(mmap_data, node, increment, 0 /*is_write*/);
+      break;
+    case HTM_ROLE_STORE:
+      htm_attribute_mem(mmap_data, node, increment, 1 /*is_write*/);
+      break;
+    default:
+      break;
+  }
+}
@@ -44,13 +44,25 @@ unsigned int get_tsx_status(int opt);
 }
 #endif
 
+// Returns true if the call path inside transactions is recovered from LBRs.
+// It can be turned off by setting HPCRUN_HTM_LBR to 0.
+int htm_lbr_is_enabled(void);
+
+// Returns the role of an event in the HTM attribution, based on its name.
+// It is meant to be called once when the event is registered.
+htm_event_role_t htm_event_role(const char *event_name);
+
+// Returns the perf sample_type fields needed to attribute the HTM metrics of
+// an event, beyond the ones every event collects (IP, TIME, PERIOD).
+u64 htm_sample_type(htm_event_role_t role);
+
 int htm_get_call_chain_from_lbr(struct perf_branch_entry lbr[], uint64_t bnr,
                             uint64_t current_ip, uint64_t call_chain[]);
 
 cct_node_t *htm_add_missing_call_path_from_lbr(uint64_t call_chain[], int depth,
                                                uint64_t current_ip, cct_node_t *node);
 
-void htm_attribute_derived_metrics(char *event_name, perf_mmap_data_t *mmap_data,
+void htm_attribute_derived_metrics(htm_event_role_t role, perf_mmap_data_t *mmap_data,
                                    cct_node_t *node, double increment);
 
 #endif /* HTM_H */
@@ -89,6 +89,7 @@
 #include "sample-sources/sample_source_obj.h"
 #include "sample-sources/common.h"
 #include "sample-sources/htm.h"
+#include "sample-sources/shadow-memory.h"
 
 #include <hpcrun/cct_insert_backtrace.h>
 #include <hpcrun/files.h>
@@ -383,7 +384,8 @@ perf_init()
 static bool
 perf_thread_init(event_info_t *event, event_thread_t *et)
 {
-  et->event = event;
+  et->event      = event;
+  et->record_buf = NULL;
   // ask sys to "create" the event
   // it returns -1 if it fails.
   et->fd = perf_util_event_open(&event->attr,
@@ -550,7 +552,7 @@ record_sample(event_thread_t *current, perf_mmap_data_t *mmap_data,
   // ----------------------------------------------------------------------------
   // update the cct and add callchain if necessary
   // ----------------------------------------------------------------------------
-  sampling_info_t info = {.sample_clock = 0, .sample_data = mmap_data};
+  sampling_info_t info = {.sample_clock = mmap_data->time, .sample_data = mmap_data};
 
   uint64_t call_chain[MAX_LBR_ENTRIES];
   int depth = htm_get_call_chain_from_lbr(mmap_data->lbr, mmap_data->bnr, mmap_data->ip, call_chain);
@@ -566,7 +568,7 @@ record_sample(event_thread_t *current, perf_mmap_data_t *mmap_data,
           (hpcrun_metricVal_t) {.r=counter},
           0/*skipInner*/, 0/*isSync*/, &info);
   }  
-  htm_attribute_derived_metrics(current->event->metric_desc->name, mmap_data, sv->sample_node, counter);
+  htm_attribute_derived_metrics(current->event->htm_role, mmap_data, sv->sample_node, counter);
 
   blame_shift_apply(current->event->metric, sv->sample_node, 
                     counter /*metricIncr*/);
@@ -861,11 +863,15 @@ METHOD_FN(process_event_list, int lush_metrics)
 
     bool is_period = (period_type == 1);
 
+    event_desc[i].htm_role = htm_event_role(name);
+
     // ------------------------------------------------------------
     // initialize the generic perf event attributes for this event
     // all threads and file descriptor will reuse the same attributes.
+    // only ask for the sample fields this event is attributed with.
     // ------------------------------------------------------------
-    perf_util_attr_init(event_attr, is_period, threshold, 0);
+    perf_util_attr_init(event_attr, is_period, threshold,
+                        htm_sample_type(event_desc[i].htm_role));
 
     // ------------------------------------------------------------
     // initialize the property of the metric
@@ -905,7 +911,8 @@ METHOD_FN(process_event_list, int lush_metrics)
     event_desc[i].metric_desc = m;
     METHOD_CALL(self, store_event, event_attr->config, threshold);
 
-    if (strstr(name, "cycles")) {
+    switch (event_desc[i].htm_role) {
+    case HTM_ROLE_CYCLES:
       htm_metric_cyc.in_htm_metric_id = hpcrun_new_metric();
       hpcrun_set_metric_info_and_period(htm_metric_cyc.in_htm_metric_id, "TIME_IN_HTM",
   				        MetricFlags_ValFmt_Real, threshold, metric_property_none);
@@ -918,8 +925,8 @@ METHOD_FN(process_event_list, int lush_metrics)
       htm_metric_cyc.in_other_metric_id = hpcrun_new_metric();
       hpcrun_set_metric_info_and_period(htm_metric_cyc.in_other_metric_id, "TIMEIN_OTHER_TX",
   				        MetricFlags_ValFmt_Real, threshold, metric_property_none);
-    }
-    if (strstr(name, "RTM_RETIRED:ABORTED")) {
+      break;
+    case HTM_ROLE_RTM_ABORT:
       htm_metric_abort.weight_metric_id = hpcrun_new_metric(); // the latency caused by the transaction abort
       hpcrun_set_metric_info_and_period(htm_metric_abort.weight_metric_id, "HTM_WEIGHT",
                                         MetricFlags_ValFmt_Real, threshold, metric_property_none);
@@ -953,11 +960,16 @@ METHOD_FN(process_event_list, int lush_metrics)
       htm_metric_abort.async_weight_metric_id = hpcrun_new_metric();
       hpcrun_set_metric_info_and_period(htm_metric_abort.async_weight_metric_id, "HTM_ASYNC_WEIGHT",
   				        MetricFlags_ValFmt_Real, threshold, metric_property_none);
-    }
-    if (strstr(name, "MEM_UOPS_RETIRED:ALL_LOADS") || strstr(name, "MEM_UOPS_RETIRED:ALL_STORES")){
+      break;
+    case HTM_ROLE_LOAD:
+    case HTM_ROLE_STORE:
+      shadow_memory_init();
       htm_metric_mem.false_sharing_id = hpcrun_new_metric();
       hpcrun_set_metric_info_and_period(htm_metric_mem.false_sharing_id, "FALSE_SHARING",
                                         MetricFlags_ValFmt_Real,threshold, metric_property_none);
+      break;
+    default:
+      break;
     }
   }
 
@@ -1156,14 +1168,17 @@ perf_event_handler(
   // parse the buffer until it finishes reading all buffers
   // ----------------------------------------------------------------------------
 
-  int more_data = 0;
-  do {
-    perf_mmap_data_t mmap_data;
-    memset(&mmap_data, 0, sizeof(perf_mmap_data_t));
+  perf_mmap_batch_t batch;
+  perf_mmap_data_t  mmap_data;
 
-    // reading info from mmapped buffer
-    more_data = read_perf_buffer(current, &mmap_data);
+  // records are parsed in place: the batch releases their space
+  // in the buffer only once all of them have been handled.
+  // N.B.: every record is attributed to the calling context unwound
+  // from this signal, even one sampled before it and still pending
+  // (cf. HPCRUN_PERF_WAKEUP and HPCRUN_PERF_WATERMARK)
+  perf_mmap_batch_begin(current, &batch);
 
+  while (perf_mmap_batch_next(&batch, &mmap_data)) {
     sample_val_t sv;
     memset(&sv, 0, sizeof(sample_val_t));
 
@@ -1171,8 +1186,9 @@ perf_event_handler(
       record_sample(current, &mmap_data, context, &sv);
 
     kernel_block_handler(current, sv, &mmap_data);
+  }
 
-  } while (more_data);
+  perf_mmap_batch_end(&batch);
 
   perf_start_all(nevents, event_thread);
 
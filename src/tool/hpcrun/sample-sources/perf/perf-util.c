@@ -47,16 +47,19 @@
  *****************************************************************************/
 
 #include <linux/version.h>
+#include <time.h>
 
 /******************************************************************************
  * local includes
  *****************************************************************************/
 
 #include <hpcrun/cct_insert_backtrace.h>
+#include <hpcrun/trace.h>
 #include <lib/support-lean/OSUtil.h>     // hostid
 
 #include <include/linux_info.h>
 #include "perf-util.h"
+#include "perf_mmap.h"
 
 // -----------------------------------------------------
 // precise ip / skid options
@@ -495,22 +498,17 @@ perf_util_attr_init(
   // some PMUs is sensitive to the sample type.
   // For instance, IDLE-CYCLES-BACKEND will fail if we set PERF_SAMPLE_ADDR.
   // By default, we need to initialize sample_type as minimal as possible.
-  unsigned int sample_type = sampletype 
-                             | PERF_SAMPLE_PERIOD | PERF_SAMPLE_TIME
-                             | PERF_SAMPLE_IP | PERF_SAMPLE_ADDR
-                             | PERF_SAMPLE_CPU | PERF_SAMPLE_TID
-                             #if LINUX_VERSION_CODE >= KERNEL_VERSION(3,4,0)
-                             | PERF_SAMPLE_BRANCH_STACK
-                             #endif
-                             #if LINUX_VERSION_CODE >= KERNEL_VERSION(3,10,0)
-                             | PERF_SAMPLE_WEIGHT | PERF_SAMPLE_DATA_SRC
-                             #endif
-                             #if LINUX_VERSION_CODE >= KERNEL_VERSION(3,13,0)
-                             | PERF_SAMPLE_TRANSACTION;
-                             #endif
+  // Anything else (address, branch stack, weight, ...) has to be requested
+  // by the caller for the events that need it.
+  u64 sample_type = sampletype 
+                    | PERF_SAMPLE_PERIOD | PERF_SAMPLE_TIME
+                    | PERF_SAMPLE_IP;
+
   #if LINUX_VERSION_CODE >= KERNEL_VERSION(3,4,0)
-  attr->branch_sample_type = PERF_SAMPLE_BRANCH_USER | PERF_SAMPLE_BRANCH_ANY_CALL
-                             | PERF_SAMPLE_BRANCH_ANY_RETURN | PERF_SAMPLE_BRANCH_ABORT_TX;
+  if (sample_type & PERF_SAMPLE_BRANCH_STACK) {
+    attr->branch_sample_type = PERF_SAMPLE_BRANCH_USER | PERF_SAMPLE_BRANCH_ANY_CALL
+                               | PERF_SAMPLE_BRANCH_ANY_RETURN | PERF_SAMPLE_BRANCH_ABORT_TX;
+  }
   #endif
 
   attr->size   = sizeof(struct perf_event_attr); /* Size of attribute structure */
@@ -529,6 +527,8 @@ perf_util_attr_init(
   attr->disabled      = 1;                 /* the counter will be enabled later  */
   attr->sample_type   = sample_type;
 
+  perf_mmap_attr_wakeup(attr);             /* when to be notified of new samples */
+
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(3,7,0)
   attr->exclude_callchain_user   = EXCLUDE_CALLCHAIN;
   attr->exclude_callchain_kernel = EXCLUDE_CALLCHAIN;
@@ -549,6 +549,18 @@ perf_util_attr_init(
   attr->precise_ip    = get_precise_ip(attr);   /* the precision is either detected automatically
                                               as precise as possible or  on the user's variable.  */
 
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4,1,0)
+  if (hpcrun_trace_clock() == HPCRUN_TRACE_CLOCK_PERF) {
+    // trace records are stamped with the sample time, which the
+    // trace header maps from CLOCK_MONOTONIC to wall-clock time
+    attr->use_clockid = 1;
+    attr->clockid     = CLOCK_MONOTONIC;
+  }
+#else
+  // no clockid: hpcrun_trace_clock_init() reports it and falls back to
+  // gettimeofday, since the trace header is written before this
+#endif
+
   return true;
 }
 
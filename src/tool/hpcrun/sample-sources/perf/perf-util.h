@@ -76,15 +76,13 @@ typedef __u32 u32;
 typedef __u64 u64;
 #endif
 
-// the number of maximum frames (call chains)
-// For kernel only call chain, I think 32 is a good number.
-// If we include user call chains, it should be bigger than that.
-#define MAX_CALLCHAIN_FRAMES 32
-
 // the number of maximum LBRs supported
 #define MAX_LBR_ENTRIES 32 // TODO: the actual number should be decided by the CPU architecture
 
 // data from perf's mmap. See perf_event_open man page
+// variable-length fields (call chain, raw data, branch stack, registers)
+// are views into the mmapped record: they are only valid until the
+// record is consumed by perf_mmap_batch_next or perf_mmap_batch_end.
 typedef struct perf_mmap_data_s {
   struct perf_event_header header;
   u64    sample_id;  /* if PERF_SAMPLE_IDENTIFIER */
@@ -98,11 +96,11 @@ typedef struct perf_mmap_data_s {
   u64    period;     /* if PERF_SAMPLE_PERIOD */
                      /* if PERF_SAMPLE_READ */
   u64    nr;         /* if PERF_SAMPLE_CALLCHAIN */
-  u64    ips[MAX_CALLCHAIN_FRAMES];       /* if PERF_SAMPLE_CALLCHAIN */
+  u64    *ips;       /* if PERF_SAMPLE_CALLCHAIN */
   u32    size;       /* if PERF_SAMPLE_RAW */
   char   *data;      /* if PERF_SAMPLE_RAW */
   u64    bnr;        /* if PERF_SAMPLE_BRANCH_STACK */
-  struct perf_branch_entry lbr[MAX_LBR_ENTRIES];
+  struct perf_branch_entry *lbr;
                      /* if PERF_SAMPLE_BRANCH_STACK */
   u64    abi;        /* if PERF_SAMPLE_REGS_USER */
   u64    *regs;
@@ -128,6 +126,19 @@ typedef struct perf_mmap_data_s {
 } perf_mmap_data_t;
 
 
+// --------------------------------------------------------------
+// role of an event in the attribution of the derived HTM metrics.
+// it is resolved from the event name once, at registration.
+// --------------------------------------------------------------
+typedef enum htm_event_role_e {
+  HTM_ROLE_OTHER = 0,  // no derived metric
+  HTM_ROLE_CYCLES,     // time in HTM, fallback, lock waiting
+  HTM_ROLE_RTM_ABORT,  // abort weight and reasons
+  HTM_ROLE_LOAD,       // false sharing (reads)
+  HTM_ROLE_STORE       // false sharing (writes)
+} htm_event_role_t;
+
+
 // --------------------------------------------------------------
 // main data structure to store the information of an event.
 // this structure is designed to be created once during the initialization.
@@ -142,6 +153,8 @@ typedef struct event_info_s {
   // predefined metric
   event_custom_t *metric_custom;	// pointer to the predefined metric
 
+  htm_event_role_t htm_role;    // which HTM metrics are derived from the event
+
 } event_info_t;
 
 
@@ -158,6 +171,8 @@ typedef struct event_thread_s {
   int          fd;     // file descriptor of the event
   event_info_t *event; // pointer to main event description
 
+  char         *record_buf; // scratch copy of a record wrapping around the ring
+
 } event_thread_t;
 
 
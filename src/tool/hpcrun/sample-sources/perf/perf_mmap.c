@@ -51,6 +51,8 @@
 
 #include <assert.h>
 #include <errno.h>
+#include <limits.h>
+#include <stdlib.h>
 #include <sys/mman.h>
 #include <string.h>
 #include <unistd.h>
@@ -68,6 +70,8 @@
  *****************************************************************************/
 
 #include <hpcrun/messages/messages.h>
+#include <hpcrun/memory/hpcrun-malloc.h>
+#include <hpcrun/hpcrun_stats.h>
 
 /******************************************************************************
  * local include
@@ -83,11 +87,25 @@
 
 #define MMAP_OFFSET_0            0
 
-#define PERF_DATA_PAGE_EXP        1      // use 2^PERF_DATA_PAGE_EXP pages
-#define PERF_DATA_PAGES           (1 << PERF_DATA_PAGE_EXP)
+// number of data pages of the ring buffer of each event.
+// the kernel requires a power of 2.
+#define HPCRUN_OPTION_MMAP_PAGES  "HPCRUN_PERF_MMAP_PAGES"
 
-#define PERF_MMAP_SIZE(pagesz)    ((pagesz) * (PERF_DATA_PAGES + 1))
-#define PERF_TAIL_MASK(pagesz)    (((pagesz) * PERF_DATA_PAGES) - 1)
+// number of samples (or bytes, with HPCRUN_PERF_WATERMARK) to
+// accumulate in the ring buffer before the kernel wakes up its readers.
+// N.B.: the overflow signal (O_ASYNC) is still sent at every overflow.
+#define HPCRUN_OPTION_WAKEUP      "HPCRUN_PERF_WAKEUP"
+#define HPCRUN_OPTION_WATERMARK   "HPCRUN_PERF_WATERMARK"
+
+#define PERF_DATA_PAGE_EXP        1      // use 2^PERF_DATA_PAGE_EXP pages by default
+#define PERF_DATA_PAGES_DEFAULT   (1 << PERF_DATA_PAGE_EXP)
+#define PERF_DATA_PAGES_MAX       (1 << 14)
+
+#define PERF_MMAP_SIZE(pagesz)    ((pagesz) * (data_pages + 1))
+#define PERF_TAIL_MASK(pagesz)    (((pagesz) * data_pages) - 1)
+
+// the size of a record is stored in a 16-bit field of its header
+#define PERF_RECORD_MAX_SIZE      (1 << 16)
 
 
 /******************************************************************************
@@ -96,22 +114,54 @@
 
 static int pagesize      = 0;
 static size_t tail_mask  = 0;
+static size_t data_pages = PERF_DATA_PAGES_DEFAULT;
+
+static u32 wakeup_events    = PERF_WAKEUP_EACH_SAMPLE;
+static u32 wakeup_watermark = 0;
 
 
 /******************************************************************************
  * local methods
  *****************************************************************************/
 
+
 /*
- * Not the data we need? Skip the data.
+ * get the value of an environment variable as a positive number.
+ * If the variable is not set or invalid, return the default value
  */
-/*static void skip_perf_data(pe_mmap_t *hdr, size_t sz)
+static long
+perf_mmap_getenv(const char *env_var, long default_value)
 {
-  if ((hdr->data_tail + sz) > hdr->data_head)
-    sz = hdr->data_head - hdr->data_tail;
+  const char *str_val = getenv(env_var);
+
+  if (str_val) {
+    char *end_ptr;
+    long val = strtol(str_val, &end_ptr, 10);
+    if (end_ptr != str_val && val > 0 && val < LONG_MAX) {
+      return val;
+    }
+    EMSG("Invalid value for %s: %s", env_var, str_val);
+  }
+  return default_value;
+}
 
-  hdr->data_tail += sz;
-} */
+
+/*
+ * round the requested number of data pages to a power of 2
+ */
+static size_t
+perf_mmap_data_pages(long requested)
+{
+  size_t pages = 1;
+
+  if (requested > PERF_DATA_PAGES_MAX)
+    requested = PERF_DATA_PAGES_MAX;
+
+  while (pages < requested)
+    pages <<= 1;
+
+  return pages;
+}
 
 
 static u64
@@ -122,381 +172,417 @@ perf_mmap_read_head(pe_mmap_t *hdr)
 	return head;
 }
 
-/***
- * number of reminder data in the buffer
- */
-static int
-num_of_more_perf_data(pe_mmap_t *hdr)
-{
-  u64 head = perf_mmap_read_head(hdr);
-  return (head - hdr->data_tail);
-}
 
-/***
- * return true if we have more data to read
- */
-static int
-has_more_perf_data(pe_mmap_t *hdr)
+//----------------------------------------------------------
+// tell the kernel that the space up to tail can be reused.
+// all reads of the records must complete before the store.
+//----------------------------------------------------------
+static void
+perf_mmap_write_tail(pe_mmap_t *hdr, u64 tail)
 {
-  return (num_of_more_perf_data(hdr) > 0);
+  __sync_synchronize();
+  hdr->data_tail = tail;
 }
 
 
+//----------------------------------------------------------
+// cursor over a record that is contiguous in memory, either
+// in place in the ring buffer or in the record scratch buffer
+//----------------------------------------------------------
+typedef struct record_cursor_s {
+  const char *pos;
+  const char *end;
+} record_cursor_t;
 
 
 //----------------------------------------------------------
-// read from perf_events mmap'ed buffer
+// return a pointer to the next bytes of the record and skip
+// over them. return NULL if the record is truncated.
 //----------------------------------------------------------
-
-static int
-perf_read(
-  pe_mmap_t *current_perf_mmap,
-  void *buf,
-  size_t bytes_wanted
-)
+static inline const void *
+record_take(record_cursor_t *rec, size_t bytes)
 {
-  if (current_perf_mmap == NULL)
-    return -1;
-
-  // front of the circular data buffer
-  char *data = BUFFER_FRONT(current_perf_mmap);
-
-  // compute bytes available in the circular buffer
-  u64 data_head = perf_mmap_read_head(current_perf_mmap);
+  const char *ptr = rec->pos;
 
-  size_t bytes_available = data_head - current_perf_mmap->data_tail;
-
-  if (bytes_wanted > bytes_available) return -1;
-
-  // compute offset of tail in the circular buffer
-  unsigned long tail = BUFFER_OFFSET(current_perf_mmap->data_tail);
-
-  long bytes_at_right = BUFFER_SIZE - tail;
-
-  // bytes to copy to the right of tail
-  size_t right = bytes_at_right < bytes_wanted ? bytes_at_right : bytes_wanted;
-
-  // copy bytes from tail position
-  memcpy(buf, data + tail, right);
-
-  // if necessary, wrap and continue copy from left edge of buffer
-  if (bytes_wanted > right) {
-    size_t left = bytes_wanted - right;
-    memcpy(buf + right, data, left);
+  if (bytes > (size_t) (rec->end - ptr)) {
+    rec->pos = rec->end;
+    return NULL;
   }
-
-  // update tail after consuming bytes_wanted
-  current_perf_mmap->data_tail += bytes_wanted;
-
-  return 0;
+  rec->pos += bytes;
+  return ptr;
 }
 
 
-static inline int
-perf_read_header(
-  pe_mmap_t *current_perf_mmap,
-  pe_header_t *hdr
-)
+static inline void
+record_read_u32(record_cursor_t *rec, u32 *val)
 {
-  return perf_read(current_perf_mmap, hdr, sizeof(pe_header_t));
+  const u32 *ptr = record_take(rec, sizeof(u32));
+  if (ptr) *val = *ptr;
 }
 
 
-static inline int
-perf_read_u32(
-  pe_mmap_t *current_perf_mmap,
-  u32 *val
-)
+static inline void
+record_read_u64(record_cursor_t *rec, u64 *val)
 {
-  return perf_read(current_perf_mmap, val, sizeof(u32));
+  const u64 *ptr = record_take(rec, sizeof(u64));
+  if (ptr) *val = *ptr;
 }
 
 
-static inline int
-perf_read_u64(
-  pe_mmap_t *current_perf_mmap,
-  u64 *val
-)
+//----------------------------------------------------------
+// a record wrapping around the end of the ring buffer is copied
+// into a per-event scratch buffer so that it can be parsed as
+// if it were contiguous. this is the only copy we make.
+//----------------------------------------------------------
+static const char *
+record_linearize(event_thread_t *current, size_t offset, size_t size)
 {
-  return perf_read(current_perf_mmap, val, sizeof(u64));
+  if (current->record_buf == NULL) {
+    size_t bufsize = BUFFER_SIZE < PERF_RECORD_MAX_SIZE ?
+                     BUFFER_SIZE : PERF_RECORD_MAX_SIZE;
+    current->record_buf = hpcrun_malloc(bufsize);
+    if (current->record_buf == NULL)
+      return NULL;
+  }
+  char *data   = BUFFER_FRONT(current->mmap);
+  size_t right = BUFFER_SIZE - offset;
+
+  memcpy(current->record_buf, data + offset, right);
+  memcpy(current->record_buf + right, data, size - right);
+
+  return current->record_buf;
 }
 
 
 //----------------------------------------------------------
 // special mmap buffer reading for PERF_SAMPLE_READ
+// we don't use the values, so we just skip over them
 //----------------------------------------------------------
 static void
-handle_struct_read_format( pe_mmap_t *perf_mmap, int read_format)
+handle_struct_read_format(record_cursor_t *rec, u64 read_format)
 {
-  u64 value, id, nr, time_enabled, time_running;
+  u64 nr = 1;
+  size_t words = 0;
 
   if (read_format & PERF_FORMAT_GROUP) {
-    perf_read_u64(perf_mmap, &nr);
-  } else {
-    perf_read_u64(perf_mmap, &value);
-  }
-
-  if (read_format & PERF_FORMAT_TOTAL_TIME_ENABLED) {
-    perf_read_u64(perf_mmap, &time_enabled);
-  }
-  if (read_format & PERF_FORMAT_TOTAL_TIME_RUNNING) {
-    perf_read_u64(perf_mmap, &time_running);
+    record_read_u64(rec, &nr);
   }
+  if (read_format & PERF_FORMAT_TOTAL_TIME_ENABLED) words++;
+  if (read_format & PERF_FORMAT_TOTAL_TIME_RUNNING) words++;
 
-  if (read_format & PERF_FORMAT_GROUP) {
-    for(int i=0;i<nr;i++) {
-      perf_read_u64(perf_mmap, &value);
+  // one value (and one id) per counter in the group
+  words += nr * ((read_format & PERF_FORMAT_ID) ? 2 : 1);
 
-      if (read_format & PERF_FORMAT_ID) {
-        perf_read_u64(perf_mmap, &id);
-      }
-    }
-  }
-  else {
-    if (read_format & PERF_FORMAT_ID) {
-      perf_read_u64(perf_mmap, &id);
-    }
-  }
+  record_take(rec, words * sizeof(u64));
 }
 
 
-
 //----------------------------------------------------------
 // processing of kernel callchains
 //----------------------------------------------------------
 
 static int
-perf_sample_callchain(pe_mmap_t *current_perf_mmap, perf_mmap_data_t* mmap_data)
+perf_sample_callchain(record_cursor_t *rec, perf_mmap_data_t* mmap_data)
 {
-  mmap_data->nr = 0;     // initialze the number of records to be 0
   u64 num_records = 0;
 
-  // determine how many frames in the call chain
-  if (perf_read_u64( current_perf_mmap, &num_records) == 0) {
-    if (num_records > 0) {
-
-      // warning: if the number of frames is bigger than the storage (MAX_CALLCHAIN_FRAMES)
-      // we have to truncate them. This is not a good practice, but so far it's the only
-      // simplest solution I can come up.
-      mmap_data->nr = (num_records < MAX_CALLCHAIN_FRAMES ? num_records : MAX_CALLCHAIN_FRAMES);
-
-      // read the IPs for the frames
-      if (perf_read( current_perf_mmap, mmap_data->ips, num_records * sizeof(u64)) != 0) {
-        // the data seems invalid
-        mmap_data->nr = 0;
-        TMSG(LINUX_PERF, "unable to read all %d frames", mmap_data->nr);
-      }
-    }
-  } else {
-    TMSG(LINUX_PERF, "unable to read the number of frames" );
+  record_read_u64(rec, &num_records);
+
+  mmap_data->ips = (u64 *) record_take(rec, num_records * sizeof(u64));
+  mmap_data->nr  = (mmap_data->ips != NULL ? num_records : 0);
+
+  if (num_records > 0 && mmap_data->nr == 0) {
+    TMSG(LINUX_PERF, "unable to read all %d frames", num_records);
   }
   return mmap_data->nr;
 }
 
 
 //----------------------------------------------------------
-// part of the buffer to be skipped
+// register dump of PERF_SAMPLE_REGS_USER or PERF_SAMPLE_REGS_INTR
 //----------------------------------------------------------
 static void
-skip_perf_data(pe_mmap_t *current_perf_mmap, size_t sz)
+perf_sample_regs(record_cursor_t *rec, u64 mask, u64 *abi, u64 **regs)
 {
-  struct perf_event_mmap_page *hdr = current_perf_mmap;
-  u64 data_head = perf_mmap_read_head(current_perf_mmap);
-  rmb();
-
-  if ((hdr->data_tail + sz) > data_head)
-     sz = data_head - hdr->data_tail;
-
-  hdr->data_tail += sz;
+  record_read_u64(rec, abi);
+  if (*abi != PERF_SAMPLE_REGS_ABI_NONE) {
+    *regs = (u64 *) record_take(rec, __builtin_popcountll(mask) * sizeof(u64));
+  }
 }
 
+
 /**
- * parse mmapped buffer and copy the values into perf_mmap_data_t mmap_info.
+ * parse a sample record and point the fields of mmap_info into it.
  * we assume mmap_info is already initialized.
  * returns the number of read event attributes
  */
 static int
-parse_buffer(int sample_type, event_thread_t *current, perf_mmap_data_t *mmap_info )
+parse_buffer(u64 sample_type, event_thread_t *current,
+    record_cursor_t *rec, perf_mmap_data_t *mmap_info)
 {
-	pe_mmap_t *current_perf_mmap = current->mmap;
-
 	int data_read = 0;
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(3,12,0)
 	if (sample_type & PERF_SAMPLE_IDENTIFIER) {
-	  perf_read_u64(current_perf_mmap, &mmap_info->sample_id);
+	  record_read_u64(rec, &mmap_info->sample_id);
 	  data_read++;
 	}
 #endif
 	if (sample_type & PERF_SAMPLE_IP) {
 	  // to be used by datacentric event
-	  perf_read_u64(current_perf_mmap, &mmap_info->ip);
+	  record_read_u64(rec, &mmap_info->ip);
 	  data_read++;
 	}
 	if (sample_type & PERF_SAMPLE_TID) {
-	  perf_read_u32(current_perf_mmap, &mmap_info->pid);
-	  perf_read_u32(current_perf_mmap, &mmap_info->tid);
+	  record_read_u32(rec, &mmap_info->pid);
+	  record_read_u32(rec, &mmap_info->tid);
 	  data_read++;
 	}
 	if (sample_type & PERF_SAMPLE_TIME) {
-	  perf_read_u64(current_perf_mmap, &mmap_info->time);
+	  record_read_u64(rec, &mmap_info->time);
 	  data_read++;
 	}
 	if (sample_type & PERF_SAMPLE_ADDR) {
 	  // to be used by datacentric event
-	  perf_read_u64(current_perf_mmap, &mmap_info->addr);
+	  record_read_u64(rec, &mmap_info->addr);
 	  data_read++;
 	}
 	if (sample_type & PERF_SAMPLE_ID) {
-	  perf_read_u64(current_perf_mmap, &mmap_info->id);
+	  record_read_u64(rec, &mmap_info->id);
 	  data_read++;
 	}
 	if (sample_type & PERF_SAMPLE_STREAM_ID) {
-	  perf_read_u64(current_perf_mmap, &mmap_info->stream_id);
+	  record_read_u64(rec, &mmap_info->stream_id);
 	  data_read++;
 	}
 	if (sample_type & PERF_SAMPLE_CPU) {
-	  perf_read_u32(current_perf_mmap, &mmap_info->cpu);
-	  perf_read_u32(current_perf_mmap, &mmap_info->res);
+	  record_read_u32(rec, &mmap_info->cpu);
+	  record_read_u32(rec, &mmap_info->res);
 	  data_read++;
 	}
 	if (sample_type & PERF_SAMPLE_PERIOD) {
-	  perf_read_u64(current_perf_mmap, &mmap_info->period);
+	  record_read_u64(rec, &mmap_info->period);
 	  data_read++;
 	}
 	if (sample_type & PERF_SAMPLE_READ) {
 	  // to be used by datacentric event
-	  handle_struct_read_format(current_perf_mmap,
-	      current->event->attr.read_format);
+	  handle_struct_read_format(rec, current->event->attr.read_format);
 	  data_read++;
 	}
 	if (sample_type & PERF_SAMPLE_CALLCHAIN) {
 	  // add call chain from the kernel
-	  perf_sample_callchain(current_perf_mmap, mmap_info);
+	  perf_sample_callchain(rec, mmap_info);
 	  data_read++;
 	}
 	if (sample_type & PERF_SAMPLE_RAW) {
-	  perf_read_u32(current_perf_mmap, &mmap_info->size);
-	  mmap_info->data = alloca( sizeof(char) * mmap_info->size );
-	  perf_read( current_perf_mmap, mmap_info->data, mmap_info->size) ;
+	  record_read_u32(rec, &mmap_info->size);
+	  mmap_info->data = (char *) record_take(rec, mmap_info->size);
 	  data_read++;
 	}
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(3,4,0)
 	if (sample_type & PERF_SAMPLE_BRANCH_STACK) {
-          perf_read_u64(current_perf_mmap, &mmap_info->bnr);
-          perf_read(current_perf_mmap, mmap_info->lbr, sizeof(struct perf_branch_entry) * mmap_info->bnr);
+	  record_read_u64(rec, &mmap_info->bnr);
+	  mmap_info->lbr = (struct perf_branch_entry *)
+	    record_take(rec, sizeof(struct perf_branch_entry) * mmap_info->bnr);
+	  if (mmap_info->lbr == NULL) mmap_info->bnr = 0;
 	  data_read++;
 	}
 #endif
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(3,7,0)
 	if (sample_type & PERF_SAMPLE_REGS_USER) {
+	  perf_sample_regs(rec, current->event->attr.sample_regs_user,
+	      &mmap_info->abi, &mmap_info->regs);
 	  data_read++;
 	}
 	if (sample_type & PERF_SAMPLE_STACK_USER) {
+	  record_read_u64(rec, &mmap_info->stack_size);
+	  mmap_info->stack_data = (char *) record_take(rec, mmap_info->stack_size);
+	  if (mmap_info->stack_size != 0) {
+	    record_read_u64(rec, &mmap_info->stack_dyn_size);
+	  }
 	  data_read++;
 	}
 #endif
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(3,10,0)
 	if (sample_type & PERF_SAMPLE_WEIGHT) {
-          perf_read_u64(current_perf_mmap, &mmap_info->weight);
+	  record_read_u64(rec, &mmap_info->weight);
 	  data_read++;
 	}
 	if (sample_type & PERF_SAMPLE_DATA_SRC) {
-	  perf_read_u64(current_perf_mmap, &mmap_info->data_src);
+	  record_read_u64(rec, &mmap_info->data_src);
 	  data_read++;
 	}
 #endif
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(3,13,0)
 	// only available since kernel 3.19
 	if (sample_type & PERF_SAMPLE_TRANSACTION) {
-          perf_read_u64(current_perf_mmap, &mmap_info->transaction);
+	  record_read_u64(rec, &mmap_info->transaction);
 	  data_read++;
 	}
 #endif
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(3,19,0)
 	// only available since kernel 3.19
 	if (sample_type & PERF_SAMPLE_REGS_INTR) {
+	  perf_sample_regs(rec, current->event->attr.sample_regs_intr,
+	      &mmap_info->intr_abi, &mmap_info->intr_regs);
 	  data_read++;
 	}
 #endif
 	return data_read;
 }
 
+
+//----------------------------------------------------------
+// parse the sample_id trailer of a non-sample record
+// (only present if the event has sample_id_all set)
+//----------------------------------------------------------
+static void
+parse_sample_id(event_thread_t *current, record_cursor_t *rec,
+    perf_mmap_data_t *mmap_info)
+{
+  u64 sample_type = current->event->attr.sample_type;
+
+  if (!current->event->attr.sample_id_all)
+    return;
+
+  if (sample_type & PERF_SAMPLE_TID) {
+    record_read_u32(rec, &mmap_info->pid);
+    record_read_u32(rec, &mmap_info->tid);
+  }
+  if (sample_type & PERF_SAMPLE_TIME) {
+    record_read_u64(rec, &mmap_info->context_switch_time);
+  }
+  if (sample_type & PERF_SAMPLE_ID) {
+    record_read_u64(rec, &mmap_info->id);
+  }
+  if (sample_type & PERF_SAMPLE_STREAM_ID) {
+    record_read_u64(rec, &mmap_info->stream_id);
+  }
+  if (sample_type & PERF_SAMPLE_CPU) {
+    record_read_u32(rec, &mmap_info->cpu);
+    record_read_u32(rec, &mmap_info->res);
+  }
+}
+
+
+//----------------------------------------------------------
+// parse a single record of any type
+//----------------------------------------------------------
+static void
+parse_record(event_thread_t *current, const pe_header_t *hdr,
+    record_cursor_t *rec, perf_mmap_data_t *mmap_info)
+{
+  mmap_info->header_type = hdr->type;
+  mmap_info->header_misc = hdr->misc;
+
+  if (hdr->type == PERF_RECORD_SAMPLE) {
+    u64 sample_type = current->event->attr.sample_type;
+    parse_buffer(sample_type, current, rec, mmap_info);
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4,3,0)
+  } else if (hdr->type == PERF_RECORD_SWITCH) {
+    // only available since kernel 4.3
+    parse_sample_id(current, rec, mmap_info);
+#endif
+
+  } else if (hdr->type == PERF_RECORD_LOST) {
+    u64 id = 0, lost = 0;
+    record_read_u64(rec, &id);
+    record_read_u64(rec, &lost);
+    TMSG(LINUX_PERF, "[%d] lost samples %d",
+         current->fd, lost);
+
+  } else {
+    // not a record we are interested in: skip it
+    TMSG(LINUX_PERF, "[%d] skip header %d  %d : %d bytes",
+         current->fd,
+         hdr->type, hdr->misc, hdr->size);
+  }
+}
+
 //----------------------------------------------------------------------
 // Public Interfaces
 //----------------------------------------------------------------------
 
 
 //----------------------------------------------------------
-// reading mmap buffer from the kernel
-// in/out: mmapped data of type perf_mmap_data_t.
-// return true if there are more data to be read,
-//        false otherwise
+// start reading the records pending in the mmap buffer.
+// data_head is read only once for the whole batch.
+//----------------------------------------------------------
+void
+perf_mmap_batch_begin(event_thread_t *current, perf_mmap_batch_t *batch)
+{
+  batch->current = current;
+  batch->tail    = current->mmap->data_tail;
+  batch->head    = perf_mmap_read_head(current->mmap);
+}
+
+
+//----------------------------------------------------------
+// parse the next record of the batch in place.
+// in/out: mmapped data of type perf_mmap_data_t, whose
+//         variable-length fields point into the record.
+//         they stay valid until the next call.
+// return true if a record has been read,
+//        false if there is no more record in the batch
 //----------------------------------------------------------
 int
-read_perf_buffer(event_thread_t *current, perf_mmap_data_t *mmap_info)
+perf_mmap_batch_next(perf_mmap_batch_t *batch, perf_mmap_data_t *mmap_info)
 {
-  pe_header_t hdr;
-  pe_mmap_t *current_perf_mmap = current->mmap;
+  event_thread_t *current = batch->current;
+  const char *record = NULL;
+  size_t size = 0;
+
+  while (record == NULL) {
+    if (batch->head - batch->tail < sizeof(pe_header_t))
+      return 0;
+
+    // records are 8-byte aligned, hence a header never wraps around
+    size_t offset = BUFFER_OFFSET(batch->tail);
+    const pe_header_t *hdr =
+      (const pe_header_t *) (BUFFER_FRONT(current->mmap) + offset);
+
+    size = hdr->size;
+    if (size < sizeof(pe_header_t) || size > batch->head - batch->tail) {
+      // corrupted or incomplete record: drop the rest of the batch
+      TMSG(LINUX_PERF, "[%d] invalid record size %d", current->fd, size);
+      batch->tail = batch->head;
+      return 0;
+    }
 
-  int read_successfully = perf_read_header(current_perf_mmap, &hdr);
-  if (read_successfully != 0) {
-    return 0;
+    record = (const char *) hdr;
+    if (offset + size > BUFFER_SIZE) {
+      record = record_linearize(current, offset, size);
+    }
+    batch->tail += size;
+
+    if (record == NULL && hdr->type == PERF_RECORD_SAMPLE) {
+      // no memory for the scratch buffer: skip the record
+      hpcrun_stats_num_samples_dropped_inc();
+    }
   }
 
-  mmap_info->header_type = hdr.type;
-  mmap_info->header_misc = hdr.misc;
+  memset(mmap_info, 0, sizeof(perf_mmap_data_t));
 
-  if (hdr.type == PERF_RECORD_SAMPLE) {
-      if (hdr.size <= 0) {
-        return 0;
-      }
-      int sample_type = current->event->attr.sample_type;
-      parse_buffer(sample_type, current, mmap_info);
+  record_cursor_t rec = {
+    .pos = record + sizeof(pe_header_t),
+    .end = record + size
+  };
+  parse_record(current, (const pe_header_t *) record, &rec, mmap_info);
 
-#if LINUX_VERSION_CODE >= KERNEL_VERSION(4,3,0)
-  } else if (hdr.type == PERF_RECORD_SWITCH) {
-      // only available since kernel 4.3
-
-      u64 type;
-      struct { uint32_t pid, tid; } pid;
-      struct { uint32_t cpu, reserved; } cpu;
-
-      type = current->event->attr.sample_type;
-
-      if (type & PERF_SAMPLE_TID) {
-        perf_read( current_perf_mmap, &pid, sizeof(pid)) ;
-      }
-
-      if (type & PERF_SAMPLE_TIME) {
-        perf_read_u64( current_perf_mmap, &(mmap_info->context_switch_time) ) ;
-      }
-      if (type & PERF_SAMPLE_CPU) {
-        perf_read( current_perf_mmap, &cpu, sizeof(cpu) ) ;
-      }
-#elif LINUX_VERSION_CODE >= KERNEL_VERSION(4,2,0)
-  } else if (hdr.type == PERF_RECORD_LOST_SAMPLES) {
-     u64 lost_samples;
-     perf_read_u64(current_perf_mmap, &lost_samples);
-     TMSG(LINUX_PERF, "[%d] lost samples %d",
-    		 current->fd, lost_samples);
-     skip_perf_data(current_perf_mmap, hdr.size-sizeof(lost_samples))
-#endif
+  return 1;
+}
 
-  } else {
-      // not a PERF_RECORD_SAMPLE nor PERF_RECORD_SWITCH
-      // skip it
-      if (hdr.size <= 0) {
-        return 0;
-      }
-      //skip_perf_data(current_perf_mmap, hdr.size);
-      TMSG(LINUX_PERF, "[%d] skip header %d  %d : %d bytes",
-    		  current->fd,
-    		  hdr.type, hdr.misc, hdr.size);
-  }
 
-  return (has_more_perf_data(current_perf_mmap));
+//----------------------------------------------------------
+// release the space of the records consumed by the batch
+//----------------------------------------------------------
+void
+perf_mmap_batch_end(perf_mmap_batch_t *batch)
+{
+  perf_mmap_write_tail(batch->current->mmap, batch->tail);
 }
 
+
 //----------------------------------------------------------
 // allocate mmap for a given file descriptor
 //----------------------------------------------------------
@@ -511,7 +597,9 @@ set_mmap(int perf_fd)
      MAP_SHARED, perf_fd, MMAP_OFFSET_0);
 
   if (map_result == MAP_FAILED) {
-    EMSG("Linux perf mmap failed: %s", strerror(errno));
+    EMSG("Linux perf mmap of %d data pages failed: %s"
+         " (see %s and /proc/sys/kernel/perf_event_mlock_kb)",
+         data_pages, strerror(errno), HPCRUN_OPTION_MMAP_PAGES);
     return NULL;
   }
 
@@ -542,8 +630,54 @@ perf_unmmap(pe_mmap_t *mmap)
 void
 perf_mmap_init()
 {
-  pagesize = sysconf(_SC_PAGESIZE);
-  tail_mask = PERF_TAIL_MASK(pagesize);
+  pagesize   = sysconf(_SC_PAGESIZE);
+  data_pages = perf_mmap_data_pages(
+                 perf_mmap_getenv(HPCRUN_OPTION_MMAP_PAGES, PERF_DATA_PAGES_DEFAULT));
+  tail_mask  = PERF_TAIL_MASK(pagesize);
+
+  // notification: either every n samples, or every n bytes of data.
+  // the watermark has to stay below the size of the buffer,
+  // otherwise the kernel drops records before notifying us
+  long watermark = perf_mmap_getenv(HPCRUN_OPTION_WATERMARK, 0);
+  if (watermark > 0) {
+    if (watermark >= BUFFER_SIZE)
+      watermark = BUFFER_SIZE / 2;
+    wakeup_watermark = watermark;
+  } else {
+    wakeup_events = perf_mmap_getenv(HPCRUN_OPTION_WAKEUP, PERF_WAKEUP_EACH_SAMPLE);
+  }
+
+  TMSG(LINUX_PERF, "mmap data pages: %d, wakeup events: %d, watermark: %d",
+       data_pages, wakeup_events, wakeup_watermark);
+
+  if (wakeup_watermark > 0 || wakeup_events > PERF_WAKEUP_EACH_SAMPLE) {
+    EMSG("WARNING: with %s or %s, pending perf records are attributed "
+	 "to the calling context of the signal that reads them",
+	 HPCRUN_OPTION_WAKEUP, HPCRUN_OPTION_WATERMARK);
+  }
+}
+
+
+/**
+ * set when the kernel wakes up readers of the buffer. this does not
+ * change the overflow signals, which come at every overflow. records
+ * still pending when a signal is handled are attributed to the context
+ * of that signal (cf. perf_event_handler).
+ */
+void
+perf_mmap_attr_wakeup(struct perf_event_attr *attr)
+{
+  if (pagesize == 0) {
+    perf_mmap_init();
+  }
+
+  if (wakeup_watermark > 0) {
+    attr->watermark        = 1;
+    attr->wakeup_watermark = wakeup_watermark;
+  } else {
+    attr->watermark        = 0;
+    attr->wakeup_events    = wakeup_events;
+  }
 }
 
 
@@ -72,17 +72,32 @@
 
 typedef struct perf_event_header pe_header_t;
 
+// --------------------------------------------------------------
+// a batch of records pending in the ring buffer of an event.
+// data_head is read once when the batch begins, and data_tail is
+// published once when the batch ends, so that records can be
+// parsed in place without racing against the kernel.
+// --------------------------------------------------------------
+typedef struct perf_mmap_batch_s {
+  event_thread_t *current; // event owning the ring buffer
+  u64            head;     // snapshot of data_head
+  u64            tail;     // local (unpublished) data_tail
+} perf_mmap_batch_t;
+
 
 /******************************************************************************
  *  interfaces
  *****************************************************************************/
 
 void perf_mmap_init();
+void perf_mmap_attr_wakeup(struct perf_event_attr *attr);
 
 pe_mmap_t* set_mmap(int perf_fd);
 void perf_unmmap(pe_mmap_t *mmap);
 
-int read_perf_buffer(event_thread_t *current, perf_mmap_data_t *mmap_info);
+void perf_mmap_batch_begin(event_thread_t *current, perf_mmap_batch_t *batch);
+int  perf_mmap_batch_next(perf_mmap_batch_t *batch, perf_mmap_data_t *mmap_info);
+void perf_mmap_batch_end(perf_mmap_batch_t *batch);
 
 
 #endif
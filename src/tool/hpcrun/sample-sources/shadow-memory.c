@@ -1,9 +1,16 @@
 #include "shadow-memory.h"
 
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/mman.h>
 
-#include "memory/hpcrun-malloc.h"
+#include "hpcrun_stats.h"
+#include "memory/mmap.h"
+#include "messages/messages.h"
+#include <lib/prof-lean/spinlock.h>
+#include <lib/prof-lean/stdatomic.h>
 
 /* MACROs */
 // 64KB shadow pages
@@ -36,76 +43,275 @@
 
 #define COMPOSE_SHADOW_DATA(tid, isWrite) ( tid | ((uint64_t)isWrite << 63))
 
-uint8_t ** gL1PageTable[LEVEL_1_PAGE_TABLE_SIZE];
-uint8_t ** gL1CachePageTable[LEVEL_1_PAGE_TABLE_SIZE];
+// compact mode: a set-associative table of sampled cache lines whose
+// size is capped by HPCRUN_SHADOW_MEMORY (in megabytes)
+#define HPCRUN_OPTION_SHADOW_MEMORY "HPCRUN_SHADOW_MEMORY"
+
+#define CACHELINE_SIZE (64)
+#define CACHELINE_OFFSET(addr) ((addr) & (CACHELINE_SIZE - 1))
+
+#define COMPACT_WAYS (8)
+#define COMPACT_LOCK_ATTEMPTS (64)
+
+// thread indices are 16 bits; index 0 marks an untouched location
+#define COMPACT_THREAD_SLOTS (1 << 16)
+#define COMPACT_WRITE_BIT (1U << 16)
+#define COMPOSE_COMPACT_DATA(index, isWrite) ((uint32_t)(index) | ((isWrite) ? COMPACT_WRITE_BIT : 0))
+#define GET_COMPACT_INDEX(compact_data) ((compact_data) & (COMPACT_WRITE_BIT - 1))
+
+// Both tables are shared by every sampling thread.  Second-level tables
+// and shadow pages come from hpcrun's anonymous mmap allocator and are
+// published with a compare-and-swap; a thread that loses the race
+// unmaps its copy and uses the winner's.  Entries are swapped atomically
+// so concurrent samples on the same line never lose each other's history.
+
+typedef _Atomic(void *) shadow_slot_t;
+typedef _Atomic(uint64_t) shadow_data_t;
+
+static shadow_slot_t gL1PageTable[LEVEL_1_PAGE_TABLE_ENTRIES];
+static shadow_slot_t gL1CachePageTable[LEVEL_1_PAGE_TABLE_ENTRIES];
 
 /* helper functions for shadow memory */
-static uint8_t* get_shadow_base_address_from_byte_table(uint64_t address) {
-  uint8_t *shadowPage;
-  uint8_t ***l1Ptr = &gL1PageTable[LEVEL_1_PAGE_TABLE_SLOT(address)];
-  if(*l1Ptr == 0) {
-    *l1Ptr = (uint8_t **) hpcrun_malloc(LEVEL_2_PAGE_TABLE_SIZE);
-    memset(*l1Ptr, 0, LEVEL_2_PAGE_TABLE_SIZE);
-    shadowPage = (*l1Ptr)[LEVEL_2_PAGE_TABLE_SLOT(address)] =  (uint8_t *) mmap(0, PAGE_SIZE * sizeof(SHADOWDATATYPE_BYTE), PROT_WRITE | PROT_READ, MAP_NORESERVE | MAP_PRIVATE | MAP_ANONYMOUS, 0, 0);
-  }
-  else if((shadowPage = (*l1Ptr)[LEVEL_2_PAGE_TABLE_SLOT(address)]) == 0 ){
-    shadowPage = (*l1Ptr)[LEVEL_2_PAGE_TABLE_SLOT(address)] =  (uint8_t *) mmap(0, PAGE_SIZE * sizeof(SHADOWDATATYPE_BYTE), PROT_WRITE | PROT_READ, MAP_NORESERVE | MAP_PRIVATE | MAP_ANONYMOUS, 0, 0);
-  }
-  return shadowPage;
-}
+static void *
+shadow_get_or_install(shadow_slot_t *slot, size_t size)
+{
+  void *table = atomic_load_explicit(slot, memory_order_acquire);
+  if (table != NULL) {
+    return table;
+  }
 
-static uint8_t* get_shadow_base_address_from_cacheline_table(uint64_t address) {
-  uint8_t *shadowPage;
-  uint8_t ***l1Ptr = &gL1CachePageTable[LEVEL_1_PAGE_TABLE_SLOT(address)];
-  if(*l1Ptr == 0) {
-    *l1Ptr = (uint8_t **) hpcrun_malloc(LEVEL_2_PAGE_TABLE_SIZE);
-    memset(*l1Ptr, 0, LEVEL_2_PAGE_TABLE_SIZE);
-    shadowPage = (*l1Ptr)[LEVEL_2_PAGE_TABLE_SLOT(address)] =  (uint8_t *) mmap(0, PAGE_SIZE * sizeof(SHADOWDATATYPE_CACHELINE), PROT_WRITE | PROT_READ, MAP_NORESERVE | MAP_PRIVATE | MAP_ANONYMOUS, 0, 0);
+  // zero-filled, and only committed as samples touch it
+  void *new_table = hpcrun_mmap_anon(size);
+  if (new_table == NULL) {
+    return NULL;
   }
-  else if((shadowPage = (*l1Ptr)[LEVEL_2_PAGE_TABLE_SLOT(address)]) == 0 ){
-    shadowPage = (*l1Ptr)[LEVEL_2_PAGE_TABLE_SLOT(address)] =  (uint8_t *) mmap(0, PAGE_SIZE * sizeof(SHADOWDATATYPE_CACHELINE), PROT_WRITE | PROT_READ, MAP_NORESERVE | MAP_PRIVATE | MAP_ANONYMOUS, 0, 0);
+
+  void *expected = NULL;
+  if (atomic_compare_exchange_strong_explicit(slot, &expected, new_table,
+                                              memory_order_acq_rel,
+                                              memory_order_acquire)) {
+    hpcrun_stats_shadow_memory_inc((long) size);
+    return new_table;
   }
-  return shadowPage;
+
+  // another thread installed the table first
+  munmap(new_table, size);
+  return expected;
 }
 
+static shadow_data_t *
+shadow_get_page(shadow_slot_t *l1_table, uint64_t address)
+{
+  shadow_slot_t *l2_table =
+    shadow_get_or_install(&l1_table[LEVEL_1_PAGE_TABLE_SLOT(address)],
+                          LEVEL_2_PAGE_TABLE_ENTRIES * sizeof(shadow_slot_t));
+  if (l2_table == NULL) {
+    return NULL;
+  }
+  return shadow_get_or_install(&l2_table[LEVEL_2_PAGE_TABLE_SLOT(address)],
+                               PAGE_SIZE * sizeof(shadow_data_t));
+}
 
 /* get the stored data from the shadow memory and store the new one */
-static SHADOWDATATYPE_BYTE get_and_store_in_byte_table(uint64_t addr, unsigned long tid, unsigned short store_flag){
-  uint8_t* status = get_shadow_base_address_from_byte_table(addr);
-  SHADOWDATATYPE_BYTE *prevAddr = (SHADOWDATATYPE_BYTE *)(status + PAGE_OFFSET(addr) * sizeof(SHADOWDATATYPE_BYTE));
-  SHADOWDATATYPE_BYTE ret_value = *prevAddr;
-  if (store_flag != 0){
-    *prevAddr = (SHADOWDATATYPE_BYTE) tid;
-  }
-  return ret_value;
+static uint64_t
+shadow_exchange(shadow_slot_t *l1_table, uint64_t address, uint64_t data)
+{
+  shadow_data_t *page = shadow_get_page(l1_table, address);
+  if (page == NULL) {
+    // out of address space: report the location as never touched
+    return 0;
+  }
+  return atomic_exchange_explicit(&page[PAGE_OFFSET(address)], data,
+                                  memory_order_relaxed);
 }
 
-static SHADOWDATATYPE_CACHELINE get_and_store_in_cacheline_table(uint64_t addr, unsigned long tid, unsigned short store_flag){
-    uint8_t* status = get_shadow_base_address_from_cacheline_table(CACHELINE(addr));
-    SHADOWDATATYPE_CACHELINE *prevAddr = (SHADOWDATATYPE_CACHELINE *)(status + PAGE_OFFSET(CACHELINE(addr)) * sizeof(SHADOWDATATYPE_CACHELINE));
-    SHADOWDATATYPE_CACHELINE ret_value = *prevAddr;
-    if (store_flag != 0){
-      *prevAddr = (SHADOWDATATYPE_CACHELINE) tid;
-    }
-    return ret_value;
+static SHADOWDATATYPE_BYTE get_and_store_in_byte_table(uint64_t addr, uint64_t data){
+  return (SHADOWDATATYPE_BYTE) shadow_exchange(gL1PageTable, addr, data);
 }
 
-int htm_record_and_get_contention(uint64_t addr, unsigned long tid, int is_write){
-  //add into cache line map
-  unsigned long cacheline_ret = get_and_store_in_cacheline_table(addr, COMPOSE_SHADOW_DATA(tid, is_write), 1);
-  //add into byte map
-  unsigned long byte_ret = get_and_store_in_byte_table(addr, COMPOSE_SHADOW_DATA(tid, is_write), 1);
+static SHADOWDATATYPE_CACHELINE get_and_store_in_cacheline_table(uint64_t addr, uint64_t data){
+  return (SHADOWDATATYPE_CACHELINE) shadow_exchange(gL1CachePageTable, CACHELINE(addr), data);
+}
 
-  //False sharing: 1. another thread has touched the cache line; 2. the touched byte is NOT accessed by another thread
-  if (cacheline_ret == 0) { //the cache line first-time touched
+//False sharing: 1. another thread has touched the cache line; 2. the touched byte is NOT accessed by another thread
+//A thread id of 0 means the location has not been touched yet.
+static int
+is_false_sharing(uint64_t line_tid, int line_is_write, uint64_t byte_tid,
+                 uint64_t tid, int is_write)
+{
+  if (line_tid == 0) { //the cache line first-time touched
+    return 0;
+  }
+  if (line_is_write == 0 && is_write == 0){ //both READ, no false sharing
     return 0;
   }
-  if (GET_WRITE_BIT(cacheline_ret) == 0 && is_write == 0){ //both READ, no false sharing
+  return (line_tid != tid) && (byte_tid == 0 || byte_tid == tid);
+}
+
+//------------------------------------------------------------------
+// compact mode
+//
+// Only cache lines that have been sampled are tracked.  Each line
+// keeps the 16-bit index of the last thread that touched it (plus the
+// write bit) and of the last thread that touched each of its bytes,
+// i.e. 144 bytes per line instead of 8 bytes per byte of the program.
+// Lines live in a set-associative table allocated once at
+// initialization; when a set is full its least recently sampled line
+// is evicted, which only forgets history and never reports a false
+// positive.
+//------------------------------------------------------------------
+
+typedef struct {
+  uint64_t line;                        // cache line number + 1, 0 if empty
+  uint32_t stamp;                       // set clock at the last access
+  uint32_t line_data;                   // COMPOSE_COMPACT_DATA of the last access
+  uint16_t byte_data[CACHELINE_SIZE];   // thread index of the last access
+} compact_way_t;
+
+typedef struct {
+  spinlock_t lock;
+  uint32_t clock;
+  compact_way_t way[COMPACT_WAYS];
+} compact_set_t;
+
+static compact_set_t *compact_sets = NULL;
+static uint64_t compact_set_mask = 0;
+
+// open-addressed map from OS thread id to a 16-bit thread index
+static _Atomic(uint32_t) compact_thread_tids[COMPACT_THREAD_SLOTS];
+
+static uint16_t
+compact_thread_index(unsigned long tid)
+{
+  uint32_t key = (uint32_t) tid;
+  uint32_t slot = (key * 2654435761U) & (COMPACT_THREAD_SLOTS - 1);
+
+  for (int probe = 0; probe < COMPACT_THREAD_SLOTS; probe++) {
+    if (slot != 0) {
+      uint32_t cur = atomic_load_explicit(&compact_thread_tids[slot], memory_order_relaxed);
+      if (cur == 0) {
+        uint32_t expected = 0;
+        if (atomic_compare_exchange_strong_explicit(&compact_thread_tids[slot], &expected, key,
+                                                    memory_order_relaxed,
+                                                    memory_order_relaxed)) {
+          return (uint16_t) slot;
+        }
+        cur = expected;
+      }
+      if (cur == key) {
+        return (uint16_t) slot;
+      }
+    }
+    slot = (slot + 1) & (COMPACT_THREAD_SLOTS - 1);
+  }
+  // more than 64K threads: share an index
+  return (uint16_t) ((key % (COMPACT_THREAD_SLOTS - 1)) + 1);
+}
+
+static compact_way_t *
+compact_find_way(compact_set_t *set, uint64_t tag)
+{
+  compact_way_t *victim = &set->way[0];
+  for (int i = 0; i < COMPACT_WAYS; i++) {
+    compact_way_t *way = &set->way[i];
+    if (way->line == tag) {
+      return way;
+    }
+    if (victim->line != 0 &&
+        (way->line == 0 || (set->clock - way->stamp) > (set->clock - victim->stamp))) {
+      victim = way;
+    }
+  }
+  memset(victim, 0, sizeof(*victim));
+  victim->line = tag;
+  return victim;
+}
+
+static int
+compact_record_and_get_contention(uint64_t addr, unsigned long tid, int is_write)
+{
+  uint64_t line = CACHELINE(addr);
+  uint16_t index = compact_thread_index(tid);
+  compact_set_t *set = &compact_sets[(line * 0x9E3779B97F4A7C15ULL >> 32) & compact_set_mask];
+
+  if (!limit_spinlock_lock(&set->lock, COMPACT_LOCK_ATTEMPTS, SPINLOCK_LOCKED_VALUE)) {
+    // another thread is updating this set: drop the access
     return 0;
   }
-  if ((GET_TID(cacheline_ret) != tid) && (byte_ret == 0 || GET_TID(byte_ret) == tid)) {
-    return 1;
+
+  compact_way_t *way = compact_find_way(set, line + 1);
+  uint32_t line_ret = way->line_data;
+  uint16_t byte_ret = way->byte_data[CACHELINE_OFFSET(addr)];
+
+  way->stamp = ++set->clock;
+  way->line_data = COMPOSE_COMPACT_DATA(index, is_write);
+  way->byte_data[CACHELINE_OFFSET(addr)] = index;
+
+  spinlock_unlock(&set->lock);
+
+  return is_false_sharing(GET_COMPACT_INDEX(line_ret), (line_ret & COMPACT_WRITE_BIT) != 0,
+                          byte_ret, index, is_write);
+}
+
+void
+shadow_memory_init(void)
+{
+  static bool init_done = false;
+  if (init_done) {
+    return;
+  }
+  init_done = true;
+
+  char *str = getenv(HPCRUN_OPTION_SHADOW_MEMORY);
+  if (str == NULL || *str == 0) {
+    return;
+  }
+
+  long megabytes = strtol(str, NULL, 10);
+  if (megabytes <= 0) {
+    EMSG("%s: invalid shadow memory limit '%s', ignored", HPCRUN_OPTION_SHADOW_MEMORY, str);
+    return;
+  }
+
+  // round the number of sets down to a power of 2 that fits the limit
+  size_t num_sets = ((size_t) megabytes << 20) / sizeof(compact_set_t);
+  size_t sets = 1;
+  while (sets * 2 <= num_sets) {
+    sets *= 2;
+  }
+
+  size_t size = sets * sizeof(compact_set_t);
+  compact_set_t *table = hpcrun_mmap_anon(size);
+  if (table == NULL) {
+    EMSG("shadow memory: unable to allocate %ld bytes for the compact table", (long) size);
+    return;
+  }
+  for (size_t i = 0; i < sets; i++) {
+    spinlock_init(&table[i].lock);
   }
-  return 0;
+
+  hpcrun_stats_shadow_memory_inc((long) size);
+  compact_set_mask = sets - 1;
+  compact_sets = table;
+
+  TMSG(LINUX_PERF, "shadow memory: compact table with %ld sets (%ld bytes)",
+       (long) sets, (long) size);
 }
 
+//------------------------------------------------------------------
+// interface operations
+//------------------------------------------------------------------
+
+int htm_record_and_get_contention(uint64_t addr, unsigned long tid, int is_write){
+  if (compact_sets != NULL) {
+    return compact_record_and_get_contention(addr, tid, is_write);
+  }
+
+  //add into cache line map
+  unsigned long cacheline_ret = get_and_store_in_cacheline_table(addr, COMPOSE_SHADOW_DATA(tid, is_write));
+  //add into byte map
+  unsigned long byte_ret = get_and_store_in_byte_table(addr, COMPOSE_SHADOW_DATA(tid, is_write));
+
+  return is_false_sharing(GET_TID(cacheline_ret), GET_WRITE_BIT(cacheline_ret),
+                          byte_ret == 0 ? 0 : GET_TID(byte_ret), tid, is_write);
+}
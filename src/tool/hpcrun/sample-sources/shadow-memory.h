@@ -3,6 +3,10 @@
 
 #include<stdint.h>
 
+// Select the shadow memory layout from the environment. Must be called
+// before any sample is recorded.
+void shadow_memory_init(void);
+
 int htm_record_and_get_contention(uint64_t addr, unsigned long tid, int is_write);
 
 #endif /* SHADOW_MEMORY_H */
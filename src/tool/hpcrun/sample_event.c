@@ -300,7 +300,8 @@ hpcrun_sample_callpath(void* context, int metricId,
     // so that the call path associated with the trace record can be recovered.
     hpcrun_cct_retain(func_proxy);
     TMSG(TRACE, "Changed persistent id to indicate mutation of func_proxy node");
-    hpcrun_trace_append(&td->core_profile_trace_data, hpcrun_cct_persistent_id(func_proxy), metricId);
+    hpcrun_trace_append_sample(&td->core_profile_trace_data, hpcrun_cct_persistent_id(func_proxy), metricId,
+			       data ? data->sample_clock : 0);
     TMSG(TRACE, "Appended func_proxy node to trace");
   }
 
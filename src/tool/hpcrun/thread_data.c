@@ -226,22 +226,20 @@ core_profile_trace_data_init(core_profile_trace_data_t * cptd, int id, cct_ctxt_
   cptd->epoch = hpcrun_malloc(sizeof(epoch_t));
   cptd->epoch->csdata_ctxt = copy_thr_ctxt(thr_ctxt);
 
-  // ----------------------------------------
-  // cct2metrics map: associate a metric_set with
-  //                  a cct node
-  hpcrun_cct2metrics_init(&(cptd->cct2metrics_map));
-
   // ----------------------------------------
   // tracing
   // ----------------------------------------
   cptd->trace_min_time_us = 0;
   cptd->trace_max_time_us = 0;
+  cptd->trace_last_time = 0;
 
   // ----------------------------------------
   // IO support
   // ----------------------------------------
   cptd->hpcrun_file  = NULL;
   cptd->trace_buffer = NULL;
+  cptd->trace_channel = NULL;
+  cptd->trace_block = NULL;
 
   // ----------------------------------------
   // perf event support
@@ -160,7 +160,6 @@ typedef struct thread_data_t {
   // ----------------------------------------
   // core_profile_trace_data contains the following
   // epoch: loadmap + cct + cct_ctxt
-  // cct2metrics map: associate a metric_set with
   // tracing: trace_min_time_us and trace_max_time_us
   // IO support file handle: hpcrun_file;
   // Perf event support
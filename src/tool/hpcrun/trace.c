@@ -49,9 +49,14 @@
 //*********************************************************************
 
 #include <stdio.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
 #include <sys/time.h>
+#include <time.h>
 #include <assert.h>
 #include <limits.h>
+#include <linux/version.h>
 
 
 //*********************************************************************
@@ -67,6 +72,7 @@
 #include "rank.h"
 #include "string.h"
 #include "trace.h"
+#include "trace_async.h"
 #include "thread_data.h"
 #include "sample_prob.h"
 
@@ -77,6 +83,7 @@
 #include <lib/prof-lean/hpcrun-fmt.h>
 #include <lib/prof-lean/hpcio.h>
 #include <lib/prof-lean/hpcio-buffer.h>
+#include <lib/support-lean/timer.h>
 
 
 //*********************************************************************
@@ -90,6 +97,9 @@
 //*********************************************************************
 
 static void hpcrun_trace_file_validate(int valid, char *op);
+static void hpcrun_trace_block_write(core_profile_trace_data_t *cptd);
+static void hpcrun_trace_clock_init(void);
+static inline uint64_t hpcrun_trace_clock_now(void);
 static inline void hpcrun_trace_append_with_time_real(core_profile_trace_data_t *cptd, unsigned int call_path_id, uint metric_id, uint64_t microtime);
 
 
@@ -99,6 +109,21 @@ static inline void hpcrun_trace_append_with_time_real(core_profile_trace_data_t
 
 static int tracing = 0;
 
+// write trace records from a background thread (HPCRUN_TRACE_ASYNC)
+static int trace_async = 0;
+
+// header flags of every trace file; isCompact is set by
+// HPCRUN_TRACE_COMPACT
+static hpctrace_hdr_flags_t trace_flags;
+
+// clock for trace record times (HPCRUN_TRACE_CLOCK) and its mapping
+// to nanoseconds, recorded in each trace file header
+static hpcrun_trace_clock_t trace_clock = HPCRUN_TRACE_CLOCK_GETTIMEOFDAY;
+static hpctrace_fmt_clock_t trace_clock_calib = { 1000000, 0, 0 };
+
+// sleep used to measure the TSC frequency at startup
+#define TRACE_TSC_CALIBRATION_NS (10 * 1000 * 1000)
+
 //*********************************************************************
 // interface operations
 //*********************************************************************
@@ -116,10 +141,31 @@ hpcrun_trace_init()
   if (getenv(HPCRUN_TRACE)) {
       tracing = 1;
       TMSG(TRACE, "Tracing is ON");
+      trace_async = hpcrun_trace_async_enabled();
+      TMSG(TRACE, "Asynchronous trace output is %s", trace_async ? "ON" : "OFF");
+      hpcrun_trace_clock_init();
+
+      trace_flags = hpctrace_hdr_flags_NULL;
+#ifdef DATACENTRIC_TRACE
+      trace_flags.fields.isDataCentric = true;
+#else
+      trace_flags.fields.isDataCentric = false;
+#endif
+      const char* compact = getenv(HPCRUN_TRACE_COMPACT);
+      trace_flags.fields.isCompact = (compact != NULL && atoi(compact) != 0);
+      TMSG(TRACE, "Compact trace records are %s",
+	   trace_flags.fields.isCompact ? "ON" : "OFF");
   }
 }
 
 
+hpcrun_trace_clock_t
+hpcrun_trace_clock()
+{
+  return trace_clock;
+}
+
+
 void
 hpcrun_trace_open(core_profile_trace_data_t * cptd)
 {
@@ -146,15 +192,28 @@ hpcrun_trace_open(core_profile_trace_data_t * cptd)
 			      HPCRUN_TraceBufferSz, HPCIO_OUTBUF_UNLOCKED);
     hpcrun_trace_file_validate(ret == HPCFMT_OK, "open");
 
-    hpctrace_hdr_flags_t flags = hpctrace_hdr_flags_NULL;
-#ifdef DATACENTRIC_TRACE
-    flags.fields.isDataCentric = true;
-#else
-    flags.fields.isDataCentric = false;
-#endif
-
-    ret = hpctrace_fmt_hdr_outbuf(flags, &cptd->trace_outbuf);
+    ret = hpctrace_fmt_hdr_outbuf(trace_flags, &trace_clock_calib,
+				  &cptd->trace_outbuf);
     hpcrun_trace_file_validate(ret == HPCFMT_OK, "write header to");
+
+    cptd->trace_block = NULL;
+    if (trace_flags.fields.isCompact) {
+      cptd->trace_block = hpcrun_malloc(sizeof(hpctrace_fmt_block_t));
+      hpctrace_fmt_block_init(cptd->trace_block);
+    }
+
+    // the header is written synchronously; from here on, the sample
+    // handler only copies records into the channel's buffers
+    cptd->trace_channel = NULL;
+    if (trace_async) {
+      ret = hpcio_outbuf_flush(&cptd->trace_outbuf);
+      hpcrun_trace_file_validate(ret == HPCFMT_OK, "write header to");
+      cptd->trace_channel =
+	hpcrun_trace_async_open(fd, cptd->trace_buffer, HPCRUN_TraceBufferSz);
+      if (cptd->trace_channel == NULL) {
+	EMSG("asynchronous trace output unavailable, writing synchronously");
+      }
+    }
   }
   TMSG(TRACE, "Trace open done");
 }
@@ -164,7 +223,14 @@ void
 hpcrun_trace_append_with_time(core_profile_trace_data_t *st, unsigned int call_path_id, uint metric_id, uint64_t microtime)
 {
 	if (tracing && hpcrun_sample_prob_active()) {
-        hpcrun_trace_append_with_time_real(st, call_path_id, metric_id, microtime);
+        uint64_t time = microtime;
+        if (trace_clock != HPCRUN_TRACE_CLOCK_GETTIMEOFDAY) {
+          // map microseconds since the epoch onto the trace clock
+          const hpctrace_fmt_clock_t* c = &trace_clock_calib;
+          int64_t ns = (int64_t)(microtime * 1000 - c->ns0);
+          time = c->tick0 + (int64_t)((double)ns * c->ticksPerSec / 1e9);
+        }
+        hpcrun_trace_append_with_time_real(st, call_path_id, metric_id, time);
 	}
 }
 
@@ -173,17 +239,27 @@ void
 hpcrun_trace_append(core_profile_trace_data_t *cptd, uint call_path_id, uint metric_id)
 {
   if (tracing && hpcrun_sample_prob_active()) {
-    struct timeval tv;
-    int ret = gettimeofday(&tv, NULL);
-    assert(ret == 0 && "in trace_append: gettimeofday failed!");
-    uint64_t microtime = ((uint64_t)tv.tv_usec
-			  + (((uint64_t)tv.tv_sec) * 1000000));
-
-    hpcrun_trace_append_with_time_real(cptd, call_path_id, metric_id, microtime);
+    uint64_t time = hpcrun_trace_clock_now();
+    hpcrun_trace_append_with_time_real(cptd, call_path_id, metric_id, time);
   }
 
 }
 
+
+void
+hpcrun_trace_append_sample(core_profile_trace_data_t *cptd, uint call_path_id, uint metric_id, uint64_t sample_clock)
+{
+  if (tracing && hpcrun_sample_prob_active()) {
+    // the sample source's own time stamp is only usable when it is
+    // the trace clock; otherwise read the clock here
+    uint64_t time = sample_clock;
+    if (trace_clock != HPCRUN_TRACE_CLOCK_PERF || time == 0) {
+      time = hpcrun_trace_clock_now();
+    }
+    hpcrun_trace_append_with_time_real(cptd, call_path_id, metric_id, time);
+  }
+}
+
 void
 hpcrun_trace_close(core_profile_trace_data_t * cptd)
 {
@@ -191,9 +267,21 @@ hpcrun_trace_close(core_profile_trace_data_t * cptd)
   if (tracing && hpcrun_sample_prob_active()) {
 
     TMSG(TRACE, "Trace active close code");
-    int ret = hpcio_outbuf_close(&cptd->trace_outbuf);
-    if (ret != HPCFMT_OK) {
-      EMSG("unable to flush and close trace file");
+    if (cptd->trace_block) {
+      hpcrun_trace_block_write(cptd);
+    }
+
+    if (cptd->trace_channel) {
+      if (! hpcrun_trace_async_close(cptd->trace_channel)) {
+	EMSG("unable to flush and close trace file");
+      }
+      cptd->trace_channel = NULL;
+    }
+    else {
+      int ret = hpcio_outbuf_close(&cptd->trace_outbuf);
+      if (ret != HPCFMT_OK) {
+        EMSG("unable to flush and close trace file");
+      }
     }
 
     int rank = hpcrun_get_rank();
@@ -208,8 +296,22 @@ hpcrun_trace_close(core_profile_trace_data_t * cptd)
 // private operations
 //*********************************************************************
 
-static inline void hpcrun_trace_append_with_time_real(core_profile_trace_data_t *cptd, unsigned int call_path_id, uint metric_id, uint64_t microtime)
+static inline void hpcrun_trace_append_with_time_real(core_profile_trace_data_t *cptd, unsigned int call_path_id, uint metric_id, uint64_t time)
 {
+    // keep the times of a trace increasing: with the perf clock, the
+    // records of several events or rings arrive in the order the rings
+    // are drained, not in time order.
+    if (time < cptd->trace_last_time) {
+        time = cptd->trace_last_time;
+    }
+    cptd->trace_last_time = time;
+
+    // the profile's trace bounds stay in microseconds
+    uint64_t microtime = time;
+    if (trace_clock != HPCRUN_TRACE_CLOCK_GETTIMEOFDAY) {
+        microtime = hpctrace_fmt_clock_to_ns(&trace_clock_calib, time) / 1000;
+    }
+
     if (cptd->trace_min_time_us == 0) {
         cptd->trace_min_time_us = microtime;
     }
@@ -220,23 +322,147 @@ static inline void hpcrun_trace_append_with_time_real(core_profile_trace_data_t
     }
     
     hpctrace_fmt_datum_t trace_datum;
-    trace_datum.time = microtime;
+    trace_datum.time = time;
     trace_datum.cpId = (uint32_t)call_path_id;
     //TODO: was not in GPU version
     trace_datum.metricId = (uint32_t)metric_id;
     
-    hpctrace_hdr_flags_t flags = hpctrace_hdr_flags_NULL;
-#ifdef DATACENTRIC_TRACE
-    flags.fields.isDataCentric = true;
-#else
-    flags.fields.isDataCentric = false;
-#endif
-    
-    int ret = hpctrace_fmt_datum_outbuf(&trace_datum, flags, &cptd->trace_outbuf);
+    if (cptd->trace_block) {
+      // records go out a block at a time
+      if (! hpctrace_fmt_block_append(cptd->trace_block, &trace_datum, trace_flags)) {
+        hpcrun_trace_block_write(cptd);
+        hpctrace_fmt_block_append(cptd->trace_block, &trace_datum, trace_flags);
+      }
+      return;
+    }
+
+    if (cptd->trace_channel) {
+      // no system call here: a full channel drops the record
+      unsigned char buf[HPCTRACE_FMT_DatumMaxLen];
+      int len = hpctrace_fmt_datum_encode(&trace_datum, trace_flags, buf);
+      hpcrun_trace_async_append(cptd->trace_channel, buf, len, 1);
+      return;
+    }
+
+    int ret = hpctrace_fmt_datum_outbuf(&trace_datum, trace_flags, &cptd->trace_outbuf);
     hpcrun_trace_file_validate(ret == HPCFMT_OK, "append");
 }
 
 
+static void
+hpcrun_trace_block_write(core_profile_trace_data_t *cptd)
+{
+    hpctrace_fmt_block_t* blk = cptd->trace_block;
+    int len = hpctrace_fmt_block_finish(blk);
+    if (len > 0) {
+      if (cptd->trace_channel) {
+        hpcrun_trace_async_append(cptd->trace_channel, blk->buf, len,
+				  blk->numRecords);
+      }
+      else {
+        int ret = hpcio_outbuf_write(&cptd->trace_outbuf, blk->buf, len);
+        hpcrun_trace_file_validate(ret == len, "append");
+      }
+    }
+    hpctrace_fmt_block_init(blk);
+}
+
+
+static uint64_t
+trace_clock_realtime_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+
+static uint64_t
+trace_clock_monotonic_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+
+// Select the trace clock and compute its mapping to nanoseconds since
+// the epoch.  The TSC is assumed to be invariant and synchronized
+// across cores; its rate is measured against CLOCK_REALTIME.  Perf
+// sample times are taken from CLOCK_MONOTONIC (cf. perf_util_attr_init).
+static void
+hpcrun_trace_clock_init(void)
+{
+  trace_clock = HPCRUN_TRACE_CLOCK_GETTIMEOFDAY;
+  trace_clock_calib = hpctrace_fmt_clock_USEC;
+
+  const char* str = getenv(HPCRUN_TRACE_CLOCK);
+  if (str == NULL || str[0] == '\0' || strcmp(str, "gettimeofday") == 0) {
+    return;
+  }
+
+  if (strcmp(str, "tsc") == 0) {
+    if (time_getTSC() == 0) {
+      EMSG("trace clock 'tsc' is unavailable, using gettimeofday");
+      return;
+    }
+    struct timespec delay = { 0, TRACE_TSC_CALIBRATION_NS };
+    uint64_t ns0  = trace_clock_realtime_ns();
+    uint64_t tsc0 = time_getTSC();
+    nanosleep(&delay, NULL);
+    uint64_t ns1  = trace_clock_realtime_ns();
+    uint64_t tsc1 = time_getTSC();
+    if (ns1 <= ns0 || tsc1 <= tsc0) {
+      EMSG("unable to calibrate trace clock 'tsc', using gettimeofday");
+      return;
+    }
+    trace_clock = HPCRUN_TRACE_CLOCK_TSC;
+    trace_clock_calib.ticksPerSec =
+      (uint64_t)((double)(tsc1 - tsc0) * 1e9 / (double)(ns1 - ns0));
+    trace_clock_calib.tick0 = tsc0;
+    trace_clock_calib.ns0   = ns0;
+  }
+  else if (strcmp(str, "perf") == 0) {
+#if LINUX_VERSION_CODE < KERNEL_VERSION(4,1,0)
+    // perf_event_attr.clockid is not available: perf sample times
+    // would not match the CLOCK_MONOTONIC calibration below
+    EMSG("trace clock 'perf' needs Linux 4.1 or later, using gettimeofday");
+    return;
+#endif
+    trace_clock = HPCRUN_TRACE_CLOCK_PERF;
+    trace_clock_calib.ticksPerSec = 1000000000;
+    trace_clock_calib.ns0   = trace_clock_realtime_ns();
+    trace_clock_calib.tick0 = trace_clock_monotonic_ns();
+  }
+  else {
+    EMSG("unknown trace clock '%s', using gettimeofday", str);
+    return;
+  }
+
+  TMSG(TRACE, "trace clock %s: %"PRIu64" ticks/s", str,
+       trace_clock_calib.ticksPerSec);
+}
+
+
+static inline uint64_t
+hpcrun_trace_clock_now(void)
+{
+  switch (trace_clock) {
+  case HPCRUN_TRACE_CLOCK_TSC:
+    return time_getTSC();
+  case HPCRUN_TRACE_CLOCK_PERF:
+    return trace_clock_monotonic_ns();
+  default:
+    break;
+  }
+
+  struct timeval tv;
+  int ret = gettimeofday(&tv, NULL);
+  assert(ret == 0 && "in trace_append: gettimeofday failed!");
+  return ((uint64_t)tv.tv_usec + (((uint64_t)tv.tv_sec) * 1000000));
+}
+
+
 static void
 hpcrun_trace_file_validate(int valid, char *op)
 {
@@ -52,10 +52,20 @@
 
 #include <include/uint.h>
 
+// clock for trace record times, selected by HPCRUN_TRACE_CLOCK
+typedef enum hpcrun_trace_clock_t {
+  HPCRUN_TRACE_CLOCK_GETTIMEOFDAY,
+  HPCRUN_TRACE_CLOCK_TSC,
+  HPCRUN_TRACE_CLOCK_PERF     // perf sample time (CLOCK_MONOTONIC)
+} hpcrun_trace_clock_t;
+
 void hpcrun_trace_init();
+hpcrun_trace_clock_t hpcrun_trace_clock();
 void hpcrun_trace_open(core_profile_trace_data_t * cptd);
 void hpcrun_trace_append(core_profile_trace_data_t * cptd, uint call_path_id, uint metric_id);
 void hpcrun_trace_append_with_time(core_profile_trace_data_t *st, unsigned int call_path_id, uint metric_id, uint64_t microtime);
+// sample_clock: the sample source's time stamp, or 0 if it has none
+void hpcrun_trace_append_sample(core_profile_trace_data_t *cptd, uint call_path_id, uint metric_id, uint64_t sample_clock);
 void hpcrun_trace_close(core_profile_trace_data_t * cptd);
 
 int hpcrun_trace_isactive();
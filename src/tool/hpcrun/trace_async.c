@@ -0,0 +1,400 @@
+// -*-Mode: C++;-*- // technically C99
+
+// * BeginRiceCopyright *****************************************************
+//
+// $HeadURL$
+// $Id$
+//
+// --------------------------------------------------------------------------
+// Part of HPCToolkit (hpctoolkit.org)
+//
+// Information about sources of support for research and development of
+// HPCToolkit is at 'hpctoolkit.org' and in 'README.Acknowledgments'.
+// --------------------------------------------------------------------------
+//
+// Copyright ((c)) 2002-2018, Rice University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// * Neither the name of Rice University (RICE) nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//
+// This software is provided by RICE and contributors "as is" and any
+// express or implied warranties, including, but not limited to, the
+// implied warranties of merchantability and fitness for a particular
+// purpose are disclaimed. In no event shall RICE or contributors be
+// liable for any direct, indirect, incidental, special, exemplary, or
+// consequential damages (including, but not limited to, procurement of
+// substitute goods or services; loss of use, data, or profits; or
+// business interruption) however caused and on any theory of liability,
+// whether in contract, strict liability, or tort (including negligence
+// or otherwise) arising in any way out of the use of this software, even
+// if advised of the possibility of such damage.
+//
+// ******************************************************* EndRiceCopyright *
+
+
+//*********************************************************************
+// global includes
+//*********************************************************************
+
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+
+
+//*********************************************************************
+// local includes
+//*********************************************************************
+
+#include <monitor.h>
+
+#include "env.h"
+#include "hpcrun_stats.h"
+#include "trace_async.h"
+
+#include <memory/hpcrun-malloc.h>
+#include <messages/messages.h>
+
+#include <lib/prof-lean/spinlock.h>
+#include <lib/prof-lean/stdatomic.h>
+
+
+//*********************************************************************
+// type declarations
+//*********************************************************************
+
+// buffer states: the owning thread fills a buffer, hands it to the
+// writer (FULL), which writes it out (WRITING) and gives it back (FREE).
+enum {
+  TRACE_BUF_FREE = 0,
+  TRACE_BUF_FILLING,
+  TRACE_BUF_FULL,
+  TRACE_BUF_WRITING
+};
+
+typedef _Atomic(trace_async_channel_t*) trace_async_link_t;
+
+struct trace_async_channel_t {
+  trace_async_link_t next;
+  int fd;
+  bool closed;
+
+  // owner only
+  int fill;
+
+  char* buf[2];
+  size_t size;
+  size_t len[2];
+  size_t nrecs[2]; // records in each buffer, for counting drops
+  atomic_int state[2];
+};
+
+
+//*********************************************************************
+// local variables
+//*********************************************************************
+
+// The open channels.  The writer walks the list without a lock; open
+// and close change it under 'channels_lock'.  A channel is never freed,
+// so the writer may still be on one that was just unlinked: its next
+// pointer still leads back into the list.
+static trace_async_link_t channels = ATOMIC_VAR_INIT(NULL);
+static spinlock_t channels_lock = SPINLOCK_UNLOCKED;
+
+// the process that started the writer; a forked child starts its own
+static _Atomic(pid_t) writer_pid = ATOMIC_VAR_INIT(0);
+
+// bumped whenever a buffer is handed to the writer, which sleeps on it
+// (as a futex) when there is nothing to write
+static atomic_int writer_wakeups = ATOMIC_VAR_INIT(0);
+
+
+//*********************************************************************
+// private operations
+//*********************************************************************
+
+// Sleep while '*addr' holds 'val'.  May return early.
+static void
+trace_futex_wait(atomic_int* addr, int val)
+{
+  syscall(SYS_futex, (int*) addr, FUTEX_WAIT_PRIVATE, val, NULL, NULL, 0);
+}
+
+
+// Wake the threads sleeping on 'addr'.  Safe inside signal handlers.
+static void
+trace_futex_wake(atomic_int* addr)
+{
+  int save_errno = errno;
+  syscall(SYS_futex, (int*) addr, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+  errno = save_errno;
+}
+
+
+static bool
+trace_write_all(int fd, const char* buf, size_t len)
+{
+  while (len > 0) {
+    ssize_t ret = write(fd, buf, len);
+    if (ret > 0) {
+      buf += ret;
+      len -= ret;
+    }
+    else if (ret < 0 && errno == EINTR) {
+      continue;
+    }
+    else {
+      return false;
+    }
+  }
+  return true;
+}
+
+
+// Write buffer 'i' of the channel if it is full.  Either the writer
+// or the closing owner may get here; the compare-and-swap decides who
+// writes it.  Returns true if something was written.
+static bool
+trace_channel_drain(trace_async_channel_t* ch, int i)
+{
+  int expected = TRACE_BUF_FULL;
+  if (! atomic_compare_exchange_strong_explicit(&ch->state[i], &expected, TRACE_BUF_WRITING,
+						memory_order_acquire, memory_order_relaxed)) {
+    return false;
+  }
+
+  if (! trace_write_all(ch->fd, ch->buf[i], ch->len[i])) {
+    EMSG("unable to write trace file: %s", strerror(errno));
+    hpcrun_stats_trace_records_dropped_inc(ch->nrecs[i]);
+  }
+  ch->len[i] = 0;
+  ch->nrecs[i] = 0;
+  atomic_store_explicit(&ch->state[i], TRACE_BUF_FREE, memory_order_release);
+
+  // the closing owner may be waiting for this buffer
+  trace_futex_wake(&ch->state[i]);
+  return true;
+}
+
+
+static void*
+trace_writer_main(void* arg)
+{
+  // the writer must never run a sample handler
+  sigset_t all;
+  sigfillset(&all);
+  monitor_real_pthread_sigmask(SIG_BLOCK, &all, NULL);
+
+  for (;;) {
+    // a buffer handed over after this load changes 'writer_wakeups',
+    // so the wait below returns at once instead of missing it
+    int seen = atomic_load(&writer_wakeups);
+    bool busy = false;
+    trace_async_channel_t* ch = atomic_load_explicit(&channels, memory_order_acquire);
+    for (; ch != NULL; ch = atomic_load_explicit(&ch->next, memory_order_acquire)) {
+      busy |= trace_channel_drain(ch, 0);
+      busy |= trace_channel_drain(ch, 1);
+    }
+    if (! busy) {
+      trace_futex_wait(&writer_wakeups, seen);
+    }
+  }
+  return NULL;
+}
+
+
+static void
+trace_writer_wake(void)
+{
+  atomic_fetch_add(&writer_wakeups, 1);
+  trace_futex_wake(&writer_wakeups);
+}
+
+
+static void
+trace_channel_unlink(trace_async_channel_t* ch)
+{
+  spinlock_lock(&channels_lock);
+  trace_async_link_t* link = &channels;
+  trace_async_channel_t* cur;
+  while ((cur = atomic_load_explicit(link, memory_order_relaxed)) != NULL) {
+    if (cur == ch) {
+      atomic_store_explicit(link, atomic_load_explicit(&ch->next, memory_order_relaxed),
+			    memory_order_release);
+      break;
+    }
+    link = &cur->next;
+  }
+  spinlock_unlock(&channels_lock);
+}
+
+
+// Start the writer unless this process already has one.  The check and
+// the start are done under 'channels_lock', so that two threads never
+// both start one.
+static bool
+trace_writer_start(void)
+{
+  pid_t pid = getpid();
+  if (atomic_load_explicit(&writer_pid, memory_order_acquire) == pid) {
+    return true;
+  }
+
+  spinlock_lock(&channels_lock);
+  if (atomic_load_explicit(&writer_pid, memory_order_relaxed) == pid) {
+    spinlock_unlock(&channels_lock);
+    return true;
+  }
+
+  // channels inherited across fork belong to the parent
+  atomic_store_explicit(&channels, NULL, memory_order_relaxed);
+
+  pthread_attr_t attr;
+  pthread_t thread;
+  pthread_attr_init(&attr);
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+
+  // the writer is internal to hpcrun: don't let libmonitor profile it
+  monitor_disable_new_threads();
+  int ret = pthread_create(&thread, &attr, trace_writer_main, NULL);
+  monitor_enable_new_threads();
+  pthread_attr_destroy(&attr);
+
+  if (ret == 0) {
+    atomic_store_explicit(&writer_pid, pid, memory_order_release);
+  }
+  spinlock_unlock(&channels_lock);
+
+  if (ret != 0) {
+    EMSG("unable to start the trace writer thread: %s", strerror(ret));
+    return false;
+  }
+  TMSG(TRACE, "trace writer thread started");
+  return true;
+}
+
+
+//*********************************************************************
+// interface operations
+//*********************************************************************
+
+bool
+hpcrun_trace_async_enabled(void)
+{
+  char* str = getenv(HPCRUN_TRACE_ASYNC);
+  return str != NULL && atoi(str) != 0;
+}
+
+
+trace_async_channel_t*
+hpcrun_trace_async_open(int fd, void* buf, size_t size)
+{
+  if (! trace_writer_start()) {
+    return NULL;
+  }
+
+  trace_async_channel_t* ch = hpcrun_malloc(sizeof(trace_async_channel_t));
+  ch->fd = fd;
+  ch->closed = false;
+  ch->fill = 0;
+  ch->size = size / 2;
+  ch->buf[0] = (char*) buf;
+  ch->buf[1] = (char*) buf + ch->size;
+  ch->len[0] = ch->len[1] = 0;
+  ch->nrecs[0] = ch->nrecs[1] = 0;
+  atomic_init(&ch->state[0], TRACE_BUF_FILLING);
+  atomic_init(&ch->state[1], TRACE_BUF_FREE);
+
+  // publish the channel to the writer
+  spinlock_lock(&channels_lock);
+  atomic_init(&ch->next, atomic_load_explicit(&channels, memory_order_relaxed));
+  atomic_store_explicit(&channels, ch, memory_order_release);
+  spinlock_unlock(&channels_lock);
+  return ch;
+}
+
+
+bool
+hpcrun_trace_async_append(trace_async_channel_t* ch, const void* rec, size_t len,
+			  size_t nrecs)
+{
+  if (ch == NULL || ch->closed) {
+    return false;
+  }
+
+  // a record larger than a whole buffer never fits: writing it to the
+  // file here would put it out of order with the writer's buffers
+  if (len > ch->size) {
+    hpcrun_stats_trace_records_dropped_inc(nrecs);
+    return false;
+  }
+
+  int i = ch->fill;
+  if (ch->len[i] + len > ch->size) {
+    // hand the full buffer to the writer and switch to the other one,
+    // unless the writer has not drained it yet
+    int other = 1 - i;
+    if (atomic_load_explicit(&ch->state[other], memory_order_acquire) != TRACE_BUF_FREE) {
+      hpcrun_stats_trace_records_dropped_inc(nrecs);
+      return false;
+    }
+    atomic_store_explicit(&ch->state[other], TRACE_BUF_FILLING, memory_order_relaxed);
+    atomic_store_explicit(&ch->state[i], TRACE_BUF_FULL, memory_order_release);
+    ch->fill = i = other;
+    trace_writer_wake();
+  }
+
+  memcpy(ch->buf[i] + ch->len[i], rec, len);
+  ch->len[i] += len;
+  ch->nrecs[i] += nrecs;
+  return true;
+}
+
+
+bool
+hpcrun_trace_async_close(trace_async_channel_t* ch)
+{
+  if (ch == NULL || ch->closed) {
+    return false;
+  }
+  ch->closed = true;
+
+  int i = ch->fill;
+  int other = 1 - i;
+
+  // the other buffer holds older records: wait until the writer is
+  // done with it, or take it over if the writer has not started
+  for (;;) {
+    int state = atomic_load_explicit(&ch->state[other], memory_order_acquire);
+    if (state == TRACE_BUF_FREE) break;
+    if (state == TRACE_BUF_FULL && trace_channel_drain(ch, other)) break;
+    trace_futex_wait(&ch->state[other], TRACE_BUF_WRITING);
+  }
+
+  bool ok = trace_write_all(ch->fd, ch->buf[i], ch->len[i]);
+  ch->len[i] = 0;
+  ch->nrecs[i] = 0;
+  atomic_store_explicit(&ch->state[i], TRACE_BUF_FREE, memory_order_release);
+  trace_channel_unlink(ch);
+
+  return (close(ch->fd) == 0) && ok;
+}
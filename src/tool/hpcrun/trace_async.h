@@ -0,0 +1,84 @@
+// -*-Mode: C++;-*- // technically C99
+
+// * BeginRiceCopyright *****************************************************
+//
+// $HeadURL$
+// $Id$
+//
+// --------------------------------------------------------------------------
+// Part of HPCToolkit (hpctoolkit.org)
+//
+// Information about sources of support for research and development of
+// HPCToolkit is at 'hpctoolkit.org' and in 'README.Acknowledgments'.
+// --------------------------------------------------------------------------
+//
+// Copyright ((c)) 2002-2018, Rice University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// * Neither the name of Rice University (RICE) nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//
+// This software is provided by RICE and contributors "as is" and any
+// express or implied warranties, including, but not limited to, the
+// implied warranties of merchantability and fitness for a particular
+// purpose are disclaimed. In no event shall RICE or contributors be
+// liable for any direct, indirect, incidental, special, exemplary, or
+// consequential damages (including, but not limited to, procurement of
+// substitute goods or services; loss of use, data, or profits; or
+// business interruption) however caused and on any theory of liability,
+// whether in contract, strict liability, or tort (including negligence
+// or otherwise) arising in any way out of the use of this software, even
+// if advised of the possibility of such damage.
+//
+// ******************************************************* EndRiceCopyright *
+
+//
+// Asynchronous trace output.
+//
+// Each traced thread owns a channel with two buffers: the sample
+// handler fills one while a background writer thread drains the other,
+// so appending a record makes a system call only when it hands a full
+// buffer over, to wake the writer, which sleeps otherwise.  If the
+// writer falls behind and both buffers are full, records are dropped
+// and counted (see hpcrun_stats_trace_records_dropped).
+//
+
+#ifndef hpcrun_trace_async_h
+#define hpcrun_trace_async_h
+
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef struct trace_async_channel_t trace_async_channel_t;
+
+// true if HPCRUN_TRACE_ASYNC asks for asynchronous trace output
+bool hpcrun_trace_async_enabled(void);
+
+// Create a channel that writes to 'fd' using 'buf' (split in two
+// halves) and start the writer thread if needed.  Returns NULL on
+// failure.  Must not be called from a signal handler.
+trace_async_channel_t* hpcrun_trace_async_open(int fd, void* buf, size_t size);
+
+// Copy 'len' bytes holding 'nrecs' trace records into the channel.
+// Safe inside signal handlers; the owning thread is the only producer.
+// Returns false if the records were dropped.
+bool hpcrun_trace_async_append(trace_async_channel_t* ch, const void* rec, size_t len,
+			       size_t nrecs);
+
+// Write out everything still buffered and close the file descriptor.
+// Returns false if some data could not be written.
+bool hpcrun_trace_async_close(trace_async_channel_t* ch);
+
+#endif // hpcrun_trace_async_h
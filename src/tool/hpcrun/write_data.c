@@ -255,6 +255,10 @@ write_epochs(FILE* fs, core_profile_trace_data_t * cptd, epoch_t* epoch)
 
     epoch_flags.fields.isLogicalUnwind = hpcrun_isLogicalUnwind();
     TMSG(LUSH,"epoch lush flag set to %s", epoch_flags.fields.isLogicalUnwind ? "true" : "false");
+
+    // most nodes carry only a few of the metrics: only write the non-zero ones
+    epoch_flags.fields.isSparse =
+      (hpcrun_get_num_metrics() <= HPCRUN_FMT_SparseMetricsMax);
     
     TMSG(DATA_WRITE,"epoch flags = %"PRIx64"", epoch_flags.bits);
     hpcrun_fmt_epochHdr_fwrite(fs, epoch_flags,
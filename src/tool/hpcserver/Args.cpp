@@ -66,6 +66,8 @@ using std::endl;
 #include <string>
 using std::string;
 
+#include <unistd.h>
+
 //*************************** User Include Files ****************************
 
 #include <include/hpctoolkit-config.h>
@@ -120,6 +122,10 @@ Options: General\n\
                            indicates that the port will be auto-negotiated with\n\
                            the client. Specifying 1 indicates that the xml will\n\
                            be transferred on the main data port.\n\
+  -t, --threads        Sets the number of threads that extract and compress\n\
+                           timelines when hpcserver runs without MPI\n\
+                           (default is 1). Specifying 0 uses all online\n\
+                           processors.\n\
 \n\
 ";
 
@@ -149,6 +155,8 @@ CmdLineParser::OptArgDesc Args::optArgs[] = {
      CLP::isOptArg_long },
   {  'x' , "xmlport",       CLP::ARG_REQ,  CLP::DUPOPT_CLOB, NULL,
      CLP::isOptArg_long },
+  {  't' , "threads",       CLP::ARG_REQ,  CLP::DUPOPT_CLOB, NULL,
+     CLP::isOptArg_long },
   CmdLineParser_OptArgDesc_NULL_MACRO // SGI's compiler requires this version
 };
 
@@ -178,6 +186,7 @@ Args::Ctor()
   compression = true;
   mainPort = DEFAULT_PORT;//21590
   xmlPort = 0;
+  numThreads = 1;
 }
 
 
@@ -270,6 +279,14 @@ Args::parse(int argc, const char* const argv[])
       if (xmlPort < 1024 && xmlPort > 1)
     	   ARG_ERROR("Ports must be greater than 1024.")
     }
+    if (parser.isOpt("threads")) {
+      const string& arg = parser.getOptArg("threads");
+      numThreads = (int) CmdLineParser::toLong(arg);
+      if (numThreads < 0)
+         ARG_ERROR("The number of threads must not be negative.")
+      if (numThreads == 0)
+         numThreads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    }
   }
   catch (const CmdLineParser::ParseError& x) {
     ARG_ERROR(x.what());
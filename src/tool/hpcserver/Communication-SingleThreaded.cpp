@@ -57,9 +57,13 @@
 //
 //***************************************************************************
 
+#include <pthread.h>
 #include <stdint.h>                     // for uint64_t
+#include <algorithm>                    // for min
+#include <deque>                        // for deque
 #include <iostream>                     // for operator<<, basic_ostream, etc
 #include <string>                       // for string
+#include <utility>                      // for pair, make_pair
 #include <vector>                       // for vector, vector<>::iterator
 
 #include "Communication.hpp"            // for Communication
@@ -101,47 +105,148 @@ void Communication::sendStartGetData(SpaceTimeDataController* contr, int process
 
 
 }
-void Communication::sendEndGetData(DataSocketStream* stream, ProgressBar* prog, SpaceTimeDataController* controller)
+//Delta-encodes the samples of a timeline and compresses them
+static DataCompressionLayer* compressTimeline(ProcessTimeline* timeline)
 {
-	// TODO: Make this so that the Lines get sent as soon as they are
-	// filled.
+	const vector<TimeCPID>& data = *timeline->data->listCPID;
+	DataCompressionLayer* comprStr = new DataCompressionLayer();
 
-	controller->fillTraces();
-	for (int i = 0; i < controller->tracesLength; i++)
+	DEBUGCOUT(2) << "Compressing process timeline with " << data.size() << " entries" << endl;
+
+	Time currentTime = data[0].timestamp;
+	vector<TimeCPID>::const_iterator it;
+	for (it = data.begin(); it != data.end(); ++it)
+	{
+		comprStr->writeInt( (int)(it->timestamp - currentTime));
+		comprStr->writeInt( it->cpid);
+		currentTime = it->timestamp;
+	}
+	comprStr->flush();
+	return comprStr;
+}
+
+static void sendTimeline(DataSocketStream* stream, ProcessTimeline* timeline,
+		DataCompressionLayer* comprStr)
+{
+	const vector<TimeCPID>& data = *timeline->data->listCPID;
+	stream->writeInt( timeline->line());
+	stream->writeInt( data.size());
+	// Begin time
+	stream->writeLong( data[0].timestamp);
+	//End time
+	stream->writeLong( data[data.size() - 1].timestamp);
+
+	int outputBufferLen = comprStr->getOutputLength();
+	char* outputBuffer = (char*)comprStr->getOutputBuffer();
+
+	stream->writeInt(outputBufferLen);
+	stream->writeRawData(outputBuffer, outputBufferLen);
+	//Send each line as soon as it is done instead of holding on to all of them
+	stream->flush();
+}
+
+//State shared by the threads that read in and compress the timelines. The
+//workers hand finished lines to the main thread, which is the only one that
+//writes to the socket. The viewer places lines by their line number, so
+//they can go out in any order.
+struct TimelineWork
+{
+	SpaceTimeDataController* controller;
+	pthread_mutex_t lock;
+	pthread_cond_t ready;
+	int nextTrace;
+	deque<pair<ProcessTimeline*, DataCompressionLayer*> > done;
+};
+
+static void* timelineWorker(void* arg)
+{
+	TimelineWork* work = (TimelineWork*) arg;
+	while (true)
 	{
+		pthread_mutex_lock(&work->lock);
+		int i = work->nextTrace++;
+		pthread_mutex_unlock(&work->lock);
+		if (i >= work->controller->tracesLength)
+			break;
+
+		ProcessTimeline* timeline = work->controller->traces[i];
+		timeline->readInData();
+		DataCompressionLayer* comprStr = compressTimeline(timeline);
 
+		pthread_mutex_lock(&work->lock);
+		work->done.push_back(make_pair(timeline, comprStr));
+		pthread_cond_signal(&work->ready);
+		pthread_mutex_unlock(&work->lock);
+	}
+	return NULL;
+}
+
+static void sendTimelinesSerially(DataSocketStream* stream, ProgressBar* prog,
+		SpaceTimeDataController* controller)
+{
+	for (int i = 0; i < controller->tracesLength; i++)
+	{
 		ProcessTimeline* timeline = controller->traces[i];
-		stream->writeInt( timeline->line());
-		vector<TimeCPID> data = *timeline->data->listCPID;
-		stream->writeInt( data.size());
-		// Begin time
-		stream->writeLong( data[0].timestamp);
-		//End time
-		stream->writeLong( data[data.size() - 1].timestamp);
-
-		DataCompressionLayer comprStr;
-
-		vector<TimeCPID>::iterator it;
-		DEBUGCOUT(2) << "Sending process timeline with " << data.size() << " entries" << endl;
-
-
-		Time currentTime = data[0].timestamp;
-		for (it = data.begin(); it != data.end(); ++it)
-		{
-			comprStr.writeInt( (int)(it->timestamp - currentTime));
-			comprStr.writeInt( it->cpid);
-			currentTime = it->timestamp;
-		}
-		comprStr.flush();
-		int outputBufferLen = comprStr.getOutputLength();
-		char* outputBuffer = (char*)comprStr.getOutputBuffer();
-
-		stream->writeInt(outputBufferLen);
-
-		stream->writeRawData(outputBuffer, outputBufferLen);
+		timeline->readInData();
+		DataCompressionLayer* comprStr = compressTimeline(timeline);
+		sendTimeline(stream, timeline, comprStr);
+		delete comprStr;
 		prog->incrementProgress();
 	}
-	stream->flush();
+}
+
+void Communication::sendEndGetData(DataSocketStream* stream, ProgressBar* prog, SpaceTimeDataController* controller)
+{
+	controller->prepareTraces();
+
+	int nthreads = min(numThreads, controller->tracesLength);
+	if (nthreads <= 1)
+	{
+		sendTimelinesSerially(stream, prog, controller);
+		return;
+	}
+
+	TimelineWork work;
+	work.controller = controller;
+	work.nextTrace = 0;
+	pthread_mutex_init(&work.lock, NULL);
+	pthread_cond_init(&work.ready, NULL);
+
+	vector<pthread_t> threads(nthreads);
+	int started = 0;
+	for (int t = 0; t < nthreads; t++)
+	{
+		if (pthread_create(&threads[started], NULL, timelineWorker, &work) != 0)
+			break;
+		started++;
+	}
+	//Without any worker, nobody would fill the queue the main thread waits on
+	if (started == 0)
+	{
+		pthread_cond_destroy(&work.ready);
+		pthread_mutex_destroy(&work.lock);
+		sendTimelinesSerially(stream, prog, controller);
+		return;
+	}
+
+	for (int sent = 0; sent < controller->tracesLength; sent++)
+	{
+		pthread_mutex_lock(&work.lock);
+		while (work.done.empty())
+			pthread_cond_wait(&work.ready, &work.lock);
+		pair<ProcessTimeline*, DataCompressionLayer*> line = work.done.front();
+		work.done.pop_front();
+		pthread_mutex_unlock(&work.lock);
+
+		sendTimeline(stream, line.first, line.second);
+		delete line.second;
+		prog->incrementProgress();
+	}
+
+	for (int t = 0; t < started; t++)
+		pthread_join(threads[t], NULL);
+	pthread_cond_destroy(&work.ready);
+	pthread_mutex_destroy(&work.lock);
 }
 
 void Communication::sendStartFilter(int count, bool excludeMatches)
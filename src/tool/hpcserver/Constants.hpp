@@ -74,6 +74,29 @@ namespace TraceviewerServer
 #define SIZE_OF_TRACE_RECORD (SIZEOF_INT+SIZEOF_LONG)
 #define SIZEOF_END_OF_FILE_MARKER 4
 
+/**Trace headers start with an 18-byte magic string and a 5-byte version
+ * ("01.00"). Version 1.00 headers are 24 bytes long, 1.01 headers 32.*/
+#define TRACE_HEADER_VERSION_OFFSET 18
+#define TRACE_HEADER_VERSION_LENGTH 5
+#define TRACE_HEADER_SIZE_V1_00 24
+#define TRACE_HEADER_SIZE_V1_01 32
+
+/**Trace headers of version 1.02 and later end with the clock calibration:
+ * ticks per second, a tick and the nanoseconds it corresponds to (3 longs).*/
+#define TRACE_HEADER_CLOCK_OFFSET 32
+#define TRACE_HEADER_SIZE_WITH_CLOCK (TRACE_HEADER_CLOCK_OFFSET + 3*SIZEOF_LONG)
+
+/**The header flags (a long) of trace headers of version 1.01 and later.*/
+#define TRACE_HEADER_FLAGS_OFFSET 24
+#define TRACE_FLAG_DATA_CENTRIC 0x1
+#define TRACE_FLAG_COMPACT 0x2
+
+/**Compact traces are a sequence of blocks, each starting with its time
+ * (long), payload size (int) and number of records (int), followed by
+ * the records as varints (cf. hpctrace_fmt_block_t in lib/prof-lean).*/
+#define TRACE_BLOCK_HEADER_SIZE (SIZEOF_LONG + 2*SIZEOF_INT)
+#define TRACE_BLOCK_MAX_SIZE 4096
+
 	static const int DEFAULT_PORT = 21590;
 	static const unsigned int MAX_DB_PATH_LENGTH = 1023;
 
@@ -125,6 +125,14 @@ namespace TraceviewerServer
 				cerr << "Tried to get file size when file does not exist!" << endl;
 			return DirInfo.st_size;
 		}
+		//Gets the modification time of a file in nanoseconds, or 0 if it does not exist
+		static int64_t getModTime(string p)
+		{
+			struct stat DirInfo;
+			if (stat(p.c_str(), &DirInfo) != 0)
+				return 0;
+			return (int64_t) DirInfo.st_mtim.tv_sec * 1000000000 + DirInfo.st_mtim.tv_nsec;
+		}
 		//Gets a list of all files in the directory, excluding any subfolders in the directory
 		static vector<string> getAllFilesInDir(string directory)
 		{
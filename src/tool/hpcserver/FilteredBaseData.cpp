@@ -73,12 +73,19 @@ FilteredBaseData::FilteredBaseData(string filename, int _headerSize) {
 	baseDataFile = new BaseDataFile(filename, _headerSize);
 	headerSize = _headerSize;
 	baseOffsets = baseDataFile->getOffsets();
+	summary = new SummaryIndex(filename);
+	if (summary->isOpen() && summary->getNumberOfRanks() != baseDataFile->getNumberOfFiles())
+	{
+		cerr << "The trace summary does not match the trace file. Ignoring it." << endl;
+		summary->close();
+	}
 	//Filters are default, which is allow everything, so this will initialize the vector
 	filter();
 
 }
 
 FilteredBaseData::~FilteredBaseData() {
+	delete summary;
 	delete baseDataFile;
 }
 
@@ -120,6 +127,34 @@ int FilteredBaseData::getInt(FileOffset position)
 {
 	return baseDataFile->getMasterBuffer()->getInt(position);
 }
+void FilteredBaseData::getBytes(FileOffset position, char* dst, int len)
+{
+	baseDataFile->getMasterBuffer()->getBytes(position, dst, len);
+}
+
+int FilteredBaseData::getNumSummaryLevels(int pseudoRank)
+{
+	if (!summary->isOpen())
+		return 0;
+	assert((unsigned int)pseudoRank < rankMapping.size());
+	return summary->getNumLevels(rankMapping[pseudoRank]);
+}
+FileOffset FilteredBaseData::getSummaryMinLoc(int pseudoRank, int level)
+{
+	return summary->getMinLoc(rankMapping[pseudoRank], level);
+}
+FileOffset FilteredBaseData::getSummaryMaxLoc(int pseudoRank, int level)
+{
+	return summary->getMaxLoc(rankMapping[pseudoRank], level);
+}
+int64_t FilteredBaseData::getSummaryLong(FileOffset position)
+{
+	return summary->getLong(position);
+}
+int FilteredBaseData::getSummaryInt(FileOffset position)
+{
+	return summary->getInt(position);
+}
 
 int FilteredBaseData::getNumberOfRanks()
 {
@@ -62,6 +62,7 @@
 
 #include "ImageTraceAttributes.hpp"
 #include "BaseDataFile.hpp"
+#include "SummaryIndex.hpp"
 #include "FilterSet.hpp"
 #include "FileUtils.hpp"//For FileOffset
 
@@ -82,6 +83,14 @@ namespace TraceviewerServer
 		FileOffset getMaxLoc(int pseudoRank);
 		int64_t getLong(FileOffset position);
 		int getInt(FileOffset position);
+		void getBytes(FileOffset position, char* dst, int len);
+
+		//The levels of the summary index (none if the database has no summary)
+		int getNumSummaryLevels(int pseudoRank);
+		FileOffset getSummaryMinLoc(int pseudoRank, int level);
+		FileOffset getSummaryMaxLoc(int pseudoRank, int level);
+		int64_t getSummaryLong(FileOffset position);
+		int getSummaryInt(FileOffset position);
 		int getNumberOfRanks();
 		int* getProcessIDs();
 		short* getThreadIDs();
@@ -90,6 +99,7 @@ namespace TraceviewerServer
 		void filter();
 
 		BaseDataFile* baseDataFile;
+		SummaryIndex* summary;
 		OffsetPair* baseOffsets;
 		FilterSet currentlyAppliedFilter;
 		//Maps the pseudoranks the program asks for from the unfiltered
@@ -72,6 +72,7 @@
 
 #include <iostream>
 #include <algorithm> //For min of two longs
+#include <cstring>
 
 
 using namespace std;
@@ -113,6 +114,10 @@ namespace TraceviewerServer
 		numPages = FullPages + (PartialPageSize == 0 ? 0 : 1);
 		pageManagementList = new LRUList<VersatileMemoryPage>(numPages);
 
+		pthread_mutex_init(&pageLock, NULL);
+		allResident = (numPages <= MaxPages);
+		residentPages.assign(numPages, (char*) NULL);
+
 		FileDescriptor fd = open(sPath.c_str(), O_RDONLY);
 
 		FileOffset sizeRemaining = fileSize;
@@ -129,23 +134,68 @@ namespace TraceviewerServer
 
 	}
 
+	char* LargeByteBuffer::getResidentPage(int Page)
+	{
+		char* page = __atomic_load_n(&residentPages[Page], __ATOMIC_ACQUIRE);
+		if (page == NULL)
+		{
+			pthread_mutex_lock(&pageLock);
+			page = masterBuffer[Page].get();
+			__atomic_store_n(&residentPages[Page], page, __ATOMIC_RELEASE);
+			pthread_mutex_unlock(&pageLock);
+		}
+		return page;
+	}
+
 	int LargeByteBuffer::getInt(FileOffset pos)
 	{
 		int Page = pos / mmPageSize;
 		int loc = pos % mmPageSize;
+		if (allResident)
+			return ByteUtilities::readInt(getResidentPage(Page) + loc);
+
+		//Another thread could unmap the page: read it under the lock
+		pthread_mutex_lock(&pageLock);
 		char* p2D = masterBuffer[Page].get() + loc;
 		int val = ByteUtilities::readInt(p2D);
+		pthread_mutex_unlock(&pageLock);
 		return val;
 	}
 	Long LargeByteBuffer::getLong(FileOffset pos)
 	{
 		int Page = pos / mmPageSize;
 		int loc = pos % mmPageSize;
+		if (allResident)
+			return ByteUtilities::readLong(getResidentPage(Page) + loc);
+
+		pthread_mutex_lock(&pageLock);
 		char* p2D = masterBuffer[Page].get() + loc;
 		Long val = ByteUtilities::readLong(p2D);
+		pthread_mutex_unlock(&pageLock);
 		return val;
 
 	}
+	//Unlike getInt and getLong, the bytes may span two pages
+	void LargeByteBuffer::getBytes(FileOffset pos, char* dst, int len)
+	{
+		while (len > 0)
+		{
+			int Page = pos / mmPageSize;
+			FileOffset loc = pos % mmPageSize;
+			int n = min((FileOffset) len, mmPageSize - loc);
+			if (allResident)
+				memcpy(dst, getResidentPage(Page) + loc, n);
+			else
+			{
+				pthread_mutex_lock(&pageLock);
+				memcpy(dst, masterBuffer[Page].get() + loc, n);
+				pthread_mutex_unlock(&pageLock);
+			}
+			pos += n;
+			dst += n;
+			len -= n;
+		}
+	}
 	//Could very well be a template, but we only use it for uint64_t
 	uint64_t LargeByteBuffer::lcm(uint64_t _a, uint64_t _b)
 	{
@@ -196,6 +246,7 @@ namespace TraceviewerServer
 	{
 		masterBuffer.clear();
 		delete pageManagementList;
+		pthread_mutex_destroy(&pageLock);
 
 	}
 }
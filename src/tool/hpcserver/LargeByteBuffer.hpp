@@ -68,10 +68,12 @@
 #include <string>
 #include <vector>
 #include <stdint.h>
+#include <pthread.h>
 
 namespace TraceviewerServer
 {
 
+	//The accessors may be called from several threads at once
 	class LargeByteBuffer
 	{
 	public:
@@ -80,13 +82,22 @@ namespace TraceviewerServer
 		FileOffset size();
 		Long getLong(FileOffset);
 		int getInt(FileOffset);
+		void getBytes(FileOffset, char*, int);
 	private:
 		static uint64_t lcm(uint64_t, uint64_t);
 		static uint64_t getRamSize();
+		char* getResidentPage(int);
 		vector<VersatileMemoryPage> masterBuffer;
 		int numPages;
 		LRUList<VersatileMemoryPage>* pageManagementList;
 
+		//Guards mapping and unmapping pages and the LRU list
+		pthread_mutex_t pageLock;
+		//If every page fits in the mapping budget, pages are never unmapped
+		//once mapped and can be read without the lock
+		bool allResident;
+		vector<char*> residentPages;
+
 	};
 
 } /* namespace TraceviewerServer */
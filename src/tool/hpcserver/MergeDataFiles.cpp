@@ -64,6 +64,7 @@
 #include "FileUtils.hpp"
 #include "DebugUtils.hpp"
 #include "ProgressBar.hpp"
+#include "SummaryIndex.hpp"
 
 #include <string>
 #include <algorithm>
@@ -90,7 +91,11 @@ namespace TraceviewerServer
 			DEBUGCOUT(2) << "Exists" << endl;
 
 			if (isMergedFileCorrect(&outputFile))
+			{
+				// databases merged before there were summaries get one now
+				summarize(outputFile);
 				return SUCCESS_ALREADY_CREATED;
+			}
 			// the file exists but corrupted.
 			cout << "Database file may be corrupted. Continuing" << endl;
 			return STATUS_UNKNOWN;
@@ -105,6 +110,9 @@ namespace TraceviewerServer
 			return FAIL_NO_DATA;
 		}
 
+		// a summary left from an earlier merge does not describe the new file
+		SummaryIndex::remove(outputFile);
+
 		DataOutputFileStream dos(outputFile.c_str());
 
 		//-----------------------------------------------------
@@ -216,9 +224,62 @@ namespace TraceviewerServer
 		// 5. remove old files
 		//-----------------------------------------------------
 		removeFiles(filteredFileNames);
+
+		//-----------------------------------------------------
+		// 6. write the summary index used for zoomed-out views
+		//-----------------------------------------------------
+		summarize(outputFile);
 		return SUCCESS_MERGED;
 	}
 
+	/*********************************************************************************
+	 *	Builds the summary index of a merged file unless it already has a complete
+	 *	one. The server works without it, so failures are not fatal.
+	 ********************************************************************************/
+	void MergeDataFiles::summarize(string mergedFile)
+	{
+		if (SummaryIndex::exists(mergedFile))
+			return;
+		int headerSize = getTraceHeaderSize(mergedFile);
+		if (headerSize <= 0)
+			return;
+		if (!SummaryIndex::build(mergedFile, headerSize))
+			cout << "Could not write the trace summary. Continuing without it" << endl;
+	}
+
+	/*********************************************************************************
+	 *	Returns the header size of the traces in a merged file from the version
+	 *	in the header of the first one, or 0 if the file has no traces.
+	 ********************************************************************************/
+	int MergeDataFiles::getTraceHeaderSize(string mergedFile)
+	{
+		ifstream f(mergedFile.c_str(), ios_base::binary | ios_base::in);
+		char buffer[SIZEOF_LONG];
+		f.read(buffer, SIZEOF_INT * 2);
+		if (f.gcount() != SIZEOF_INT * 2 || ByteUtilities::readInt(buffer + SIZEOF_INT) <= 0)
+			return 0;
+
+		// the offset of the first trace, after its process and thread ids
+		f.seekg(4 * SIZEOF_INT, ios_base::beg);
+		f.read(buffer, SIZEOF_LONG);
+		Long firstTrace = ByteUtilities::readLong(buffer);
+
+		char version[TRACE_HEADER_VERSION_LENGTH + 1];
+		f.seekg(firstTrace + TRACE_HEADER_VERSION_OFFSET, ios_base::beg);
+		f.read(version, TRACE_HEADER_VERSION_LENGTH);
+		if (f.gcount() != TRACE_HEADER_VERSION_LENGTH)
+			return 0;
+		version[TRACE_HEADER_VERSION_LENGTH] = '\0';
+		f.close();
+
+		string v(version);
+		if (v < "01.01")
+			return TRACE_HEADER_SIZE_V1_00;
+		if (v == "01.01")
+			return TRACE_HEADER_SIZE_V1_01;
+		return TRACE_HEADER_SIZE_WITH_CLOCK;
+	}
+
 
 
 	void MergeDataFiles::insertMarker(DataOutputFileStream* dos)
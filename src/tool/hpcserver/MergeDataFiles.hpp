@@ -89,6 +89,8 @@ namespace TraceviewerServer
 		static bool removeFiles(vector<string>);
 		//This was in Util.java in a modified form but is more useful here
 		static bool atLeastOneValidFile(string);
+		static void summarize(string);
+		static int getTraceHeaderSize(string);
 
 
 
@@ -0,0 +1,291 @@
+// -*-Mode: C++;-*-
+
+// * BeginRiceCopyright *****************************************************
+//
+// $HeadURL$
+// $Id$
+//
+// --------------------------------------------------------------------------
+// Part of HPCToolkit (hpctoolkit.org)
+//
+// Information about sources of support for research and development of
+// HPCToolkit is at 'hpctoolkit.org' and in 'README.Acknowledgments'.
+// --------------------------------------------------------------------------
+//
+// Copyright ((c)) 2002-2018, Rice University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// * Neither the name of Rice University (RICE) nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//
+// This software is provided by RICE and contributors "as is" and any
+// express or implied warranties, including, but not limited to, the
+// implied warranties of merchantability and fitness for a particular
+// purpose are disclaimed. In no event shall RICE or contributors be
+// liable for any direct, indirect, incidental, special, exemplary, or
+// consequential damages (including, but not limited to, procurement of
+// substitute goods or services; loss of use, data, or profits; or
+// business interruption) however caused and on any theory of liability,
+// whether in contract, strict liability, or tort (including negligence
+// or otherwise) arising in any way out of the use of this software, even
+// if advised of the possibility of such damage.
+//
+// ******************************************************* EndRiceCopyright *
+
+//***************************************************************************
+//
+// File:
+//   $HeadURL$
+//
+// Purpose:
+//   Reads and writes the summary of a merged trace database
+//
+// Description:
+//   [The set of functions, macros, etc. defined in the file]
+//
+//***************************************************************************
+
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <fstream>
+#include <vector>
+
+#include "SummaryIndex.hpp"
+#include "ByteUtilities.hpp"
+#include "Constants.hpp"
+#include "DataOutputFileStream.hpp"
+#include "DebugUtils.hpp"
+#include "FilteredBaseData.hpp"
+#include "ProgressBar.hpp"
+#include "TraceDataByRank.hpp"
+
+using namespace std;
+namespace TraceviewerServer
+{
+	SummaryIndex::SummaryIndex(string traceFile)
+	{
+		mapping = NULL;
+		fileSize = 0;
+		numRanks = 0;
+
+		string summaryFile = getSummaryFile(traceFile);
+		if (!exists(traceFile))
+			return;
+
+		fileSize = FileUtils::getFileSize(summaryFile);
+		FileDescriptor fd = open(summaryFile.c_str(), O_RDONLY);
+		if (fd < 0)
+			return;
+		void* m = mmap(NULL, fileSize, PROT_READ, MAP_SHARED, fd, 0);
+		::close(fd);
+		if (m == MAP_FAILED)
+			return;
+		mapping = (char*) m;
+
+		if (getInt(0) != SUMMARY_VERSION || getInt(2 * SIZEOF_INT) != MIN_STRIDE_LOG)
+		{
+			DEBUGCOUT(1) << "Ignoring summary " << summaryFile << " of another version" << endl;
+			close();
+			return;
+		}
+		numRanks = getInt(SIZEOF_INT);
+		DEBUGCOUT(1) << "Using summary " << summaryFile << endl;
+	}
+
+	SummaryIndex::~SummaryIndex()
+	{
+		close();
+	}
+
+	void SummaryIndex::close()
+	{
+		if (mapping != NULL)
+			munmap(mapping, fileSize);
+		mapping = NULL;
+		numRanks = 0;
+	}
+
+	bool SummaryIndex::isOpen()
+	{
+		return mapping != NULL;
+	}
+
+	int SummaryIndex::getNumberOfRanks()
+	{
+		return numRanks;
+	}
+
+	int SummaryIndex::getNumLevels(int rank)
+	{
+		return getInt(getLong(HEADER_SIZE + rank * SIZEOF_LONG));
+	}
+
+	FileOffset SummaryIndex::getLevelEntry(int rank, int level)
+	{
+		FileOffset rankOffset = getLong(HEADER_SIZE + rank * SIZEOF_LONG);
+		return rankOffset + SIZEOF_INT + level * 2 * SIZEOF_LONG;
+	}
+
+	FileOffset SummaryIndex::getMinLoc(int rank, int level)
+	{
+		return getLong(getLevelEntry(rank, level));
+	}
+
+	FileOffset SummaryIndex::getMaxLoc(int rank, int level)
+	{
+		FileOffset entry = getLevelEntry(rank, level);
+		return getLong(entry) + (getLong(entry + SIZEOF_LONG) - 1) * SIZE_OF_TRACE_RECORD;
+	}
+
+	int64_t SummaryIndex::getLong(FileOffset position)
+	{
+		return ByteUtilities::readLong(mapping + position);
+	}
+
+	int SummaryIndex::getInt(FileOffset position)
+	{
+		return ByteUtilities::readInt(mapping + position);
+	}
+
+	string SummaryIndex::getSummaryFile(string traceFile)
+	{
+		return traceFile + ".summary";
+	}
+
+	//True if the summary of the trace file is complete and was made from the
+	//trace file as it is now (same size and modification time)
+	bool SummaryIndex::exists(string traceFile)
+	{
+		string summaryFile = getSummaryFile(traceFile);
+		if (!FileUtils::exists(summaryFile) || !FileUtils::exists(traceFile))
+			return false;
+
+		Long pos = FileUtils::getFileSize(summaryFile) - SIZEOF_LONG;
+		if (pos < HEADER_SIZE)
+			return false;
+		ifstream f(summaryFile.c_str(), ios_base::binary | ios_base::in);
+		char header[HEADER_SIZE];
+		f.read(header, HEADER_SIZE);
+		bool current = f.gcount() == HEADER_SIZE
+				&& ByteUtilities::readInt(header) == SUMMARY_VERSION
+				&& (FileOffset) ByteUtilities::readLong(header + 3 * SIZEOF_INT)
+					== FileUtils::getFileSize(traceFile)
+				&& ByteUtilities::readLong(header + 3 * SIZEOF_INT + SIZEOF_LONG)
+					== FileUtils::getModTime(traceFile);
+
+		f.seekg(pos, ios_base::beg);
+		char buffer[SIZEOF_LONG];
+		f.read(buffer, SIZEOF_LONG);
+		bool complete = f.gcount() == SIZEOF_LONG
+				&& (uint64_t) ByteUtilities::readLong(buffer) == MARKER_END_SUMMARY;
+		f.close();
+		if (complete && !current)
+		{
+			DEBUGCOUT(1) << "Ignoring summary " << summaryFile << " of another trace file" << endl;
+		}
+		return current && complete;
+	}
+
+	//Deletes the summary of the trace file, if there is one
+	void SummaryIndex::remove(string traceFile)
+	{
+		string summaryFile = getSummaryFile(traceFile);
+		if (FileUtils::exists(summaryFile))
+			::remove(summaryFile.c_str());
+	}
+
+	/*********************************************************************************
+	 *	Writes the summary of a merged trace file. Each rank is read once, in
+	 *	order, to collect its finest level; the coarser levels are then made
+	 *	by keeping every other record of the level below.
+	 ********************************************************************************/
+	bool SummaryIndex::build(string traceFile, int headerSize)
+	{
+		string summaryFile = getSummaryFile(traceFile);
+		FilteredBaseData data(traceFile, headerSize);
+		int ranks = data.getNumberOfRanks();
+
+		DataOutputFileStream dos(summaryFile.c_str());
+		if (!dos.good())
+		{
+			cerr << "Could not create the trace summary " << summaryFile << endl;
+			return false;
+		}
+		dos.writeInt(SUMMARY_VERSION);
+		dos.writeInt(ranks);
+		dos.writeInt(MIN_STRIDE_LOG);
+		dos.writeLong(FileUtils::getFileSize(traceFile));
+		dos.writeLong(FileUtils::getModTime(traceFile));
+
+		// the rank offsets are filled in once the levels are written
+		FileOffset tableOffset = HEADER_SIZE;
+		for (int rank = 0; rank < ranks; rank++)
+			dos.writeLong(0);
+		vector<FileOffset> rankOffsets(ranks);
+		FileOffset currentOffset = tableOffset + ranks * SIZEOF_LONG;
+
+		ProgressBar prog("Summarizing traces", ranks);
+		vector<TimeCPID> level, coarser;
+		for (int rank = 0; rank < ranks; rank++)
+		{
+			rankOffsets[rank] = currentOffset;
+
+			TraceDataByRank trace(&data, rank, 0, headerSize);
+			level.clear();
+			trace.readRecords(1 << MIN_STRIDE_LOG, &level);
+
+			int numLevels = 0;
+			for (size_t count = level.size(); count >= 2; count = (count + 1) / 2)
+				numLevels++;
+
+			dos.writeInt(numLevels);
+			FileOffset recordsOffset = currentOffset + SIZEOF_INT + numLevels * 2 * SIZEOF_LONG;
+			size_t count = level.size();
+			for (int l = 0; l < numLevels; l++)
+			{
+				dos.writeLong(recordsOffset);
+				dos.writeLong(count);
+				recordsOffset += count * SIZE_OF_TRACE_RECORD;
+				count = (count + 1) / 2;
+			}
+
+			for (int l = 0; l < numLevels; l++)
+			{
+				coarser.clear();
+				for (size_t i = 0; i < level.size(); i++)
+				{
+					dos.writeLong(level[i].timestamp);
+					dos.writeInt(level[i].cpid);
+					if (i % 2 == 0)
+						coarser.push_back(level[i]);
+				}
+				level.swap(coarser);
+			}
+			currentOffset = recordsOffset;
+			prog.incrementProgress();
+		}
+		dos.writeLong(MARKER_END_SUMMARY);
+
+		dos.seekp(tableOffset, ios_base::beg);
+		for (int rank = 0; rank < ranks; rank++)
+			dos.writeLong(rankOffsets[rank]);
+		dos.close();
+		return !dos.fail();
+	}
+
+} /* namespace TraceviewerServer */
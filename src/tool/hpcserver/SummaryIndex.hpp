@@ -0,0 +1,124 @@
+// -*-Mode: C++;-*-
+
+// * BeginRiceCopyright *****************************************************
+//
+// $HeadURL$
+// $Id$
+//
+// --------------------------------------------------------------------------
+// Part of HPCToolkit (hpctoolkit.org)
+//
+// Information about sources of support for research and development of
+// HPCToolkit is at 'hpctoolkit.org' and in 'README.Acknowledgments'.
+// --------------------------------------------------------------------------
+//
+// Copyright ((c)) 2002-2018, Rice University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// * Neither the name of Rice University (RICE) nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//
+// This software is provided by RICE and contributors "as is" and any
+// express or implied warranties, including, but not limited to, the
+// implied warranties of merchantability and fitness for a particular
+// purpose are disclaimed. In no event shall RICE or contributors be
+// liable for any direct, indirect, incidental, special, exemplary, or
+// consequential damages (including, but not limited to, procurement of
+// substitute goods or services; loss of use, data, or profits; or
+// business interruption) however caused and on any theory of liability,
+// whether in contract, strict liability, or tort (including negligence
+// or otherwise) arising in any way out of the use of this software, even
+// if advised of the possibility of such damage.
+//
+// ******************************************************* EndRiceCopyright *
+
+//***************************************************************************
+//
+// File:
+//   $HeadURL$
+//
+// Purpose:
+//   A multi-resolution summary of the records of a merged trace database
+//
+// Description:
+//   The summary sits next to the merged trace file and holds, for each rank,
+//   levels of every 2^k-th record (k >= MIN_STRIDE_LOG) in the same 12-byte
+//   (time, cpid) format as the raw records, with times already in
+//   microseconds. Zoomed-out views can be sampled from a level instead of
+//   from the raw records, which are scattered over the whole trace file.
+//
+//   File layout (big endian, like the merged file):
+//     int version, int numRanks, int minStrideLog
+//     long traceSize, long traceModTime (of the merged file summarized)
+//     long rankOffset[numRanks]
+//     for each rank at rankOffset:
+//       int numLevels, then (long recordsOffset, long count)[numLevels]
+//       followed by the records of the levels, finest first
+//     long end marker
+//
+//***************************************************************************
+
+#ifndef SUMMARYINDEX_HPP_
+#define SUMMARYINDEX_HPP_
+
+#include <string>
+#include <stdint.h>
+
+#include "FileUtils.hpp" // For FileOffset
+
+using namespace std;
+namespace TraceviewerServer
+{
+	class SummaryIndex
+	{
+	public:
+		//Maps the summary of the trace file, if there is a complete one
+		SummaryIndex(string traceFile);
+		virtual ~SummaryIndex();
+
+		bool isOpen();
+		void close();
+		int getNumberOfRanks();
+		int getNumLevels(int rank);
+		//The locations of the first and last record of a level, 0 being the finest
+		FileOffset getMinLoc(int rank, int level);
+		FileOffset getMaxLoc(int rank, int level);
+		int64_t getLong(FileOffset position);
+		int getInt(FileOffset position);
+
+		static string getSummaryFile(string traceFile);
+		static bool exists(string traceFile);
+		static void remove(string traceFile);
+		//Writes the summary of a merged trace file
+		static bool build(string traceFile, int headerSize);
+
+		//The finest level keeps every 64th record
+		static const int MIN_STRIDE_LOG = 6;
+		//A level is used for a view if it has at least that many records per pixel
+		static const int MIN_RECORDS_PER_PIXEL = 4;
+	private:
+		FileOffset getLevelEntry(int rank, int level);
+
+		static const int SUMMARY_VERSION = 2;
+		static const int HEADER_SIZE = 28;
+		static const uint64_t MARKER_END_SUMMARY = 0xFFFFFFFFDEADF00D;
+
+		char* mapping;
+		FileOffset fileSize;
+		int numRanks;
+	};
+
+} /* namespace TraceviewerServer */
+#endif /* SUMMARYINDEX_HPP_ */
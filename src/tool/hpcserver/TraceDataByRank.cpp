@@ -76,6 +76,40 @@ namespace TraceviewerServer
 		maxloc = data->getMaxLoc(rank);
 		numPixelsH = _numPixelH;
 
+		FileOffset headerLoc = minloc - _headerSize;
+
+		// a version 1.02 header ends with the calibration that maps the
+		// record times (clock ticks) to nanoseconds since the epoch
+		clockScaled = false;
+		ticksPerSec = 1000000;
+		tick0 = 0;
+		ns0 = 0;
+		if (_headerSize >= TRACE_HEADER_SIZE_WITH_CLOCK)
+		{
+			FileOffset clockLoc = headerLoc + TRACE_HEADER_CLOCK_OFFSET;
+			ticksPerSec = data->getLong(clockLoc);
+			tick0 = data->getLong(clockLoc + SIZEOF_LONG);
+			ns0 = data->getLong(clockLoc + 2 * SIZEOF_LONG);
+			// microseconds need no conversion
+			clockScaled = (ticksPerSec > 0)
+					&& !(ticksPerSec == 1000000 && tick0 == 0 && ns0 == 0);
+		}
+
+		compact = false;
+		dataCentric = false;
+		decodedBlock = -1;
+		fromSummary = false;
+		if (_headerSize >= TRACE_HEADER_FLAGS_OFFSET + SIZEOF_LONG)
+		{
+			Long flags = data->getLong(headerLoc + TRACE_HEADER_FLAGS_OFFSET);
+			compact = (flags & TRACE_FLAG_COMPACT) != 0;
+			dataCentric = (flags & TRACE_FLAG_DATA_CENTRIC) != 0;
+		}
+		if (compact)
+		{
+			// maxloc is the last fixed-size record, so the data ends one record later
+			indexCompactBlocks(maxloc + SIZE_OF_TRACE_RECORD);
+		}
 		
 		listCPID = new vector<TimeCPID>();
 
@@ -83,16 +117,22 @@ namespace TraceviewerServer
 	void TraceDataByRank::getData(Time timeStart, Time timeRange,
 			double pixelLength)
 	{
-		// get the start location
-		FileOffset startLoc = findTimeInInterval(timeStart, minloc, maxloc);
-
-		// get the end location
 		 Time endTime = timeStart + timeRange;
-		 FileOffset endLoc = min(
-				findTimeInInterval(endTime, minloc, maxloc) + SIZE_OF_TRACE_RECORD, maxloc);
+		FileOffset startLoc, endLoc;
+		Long numRec;
 
-		// get the number of records data to display
-		 Long numRec = 1 + getNumberOfRecords(startLoc, endLoc);
+		// zoomed-out views are sampled from the summary index when there is one
+		if (!useSummaryLevel(timeStart, endTime, startLoc, endLoc, numRec))
+			numRec = findRange(timeStart, endTime, startLoc, endLoc);
+
+		// --------------------------------------------------------------------------------------------------
+		// get the first data if necessary: the leftmost time is still bigger than the lower limit
+		//	similarly, we add to the list
+		// --------------------------------------------------------------------------------------------------
+		if (startLoc > minloc)
+		{
+			listCPID->push_back(getData(startLoc - SIZE_OF_TRACE_RECORD));
+		}
 
 		// --------------------------------------------------------------------------------------------------
 		// if the data-to-display is fit in the display zone, we don't need to use recursive binary search
@@ -100,6 +140,7 @@ namespace TraceviewerServer
 		// --------------------------------------------------------------------------------------------------
 		if (numRec <= numPixelsH)
 		{
+			listCPID->reserve(listCPID->size() + numRec + 1);
 			// display all the records
 			for (FileOffset i = startLoc; i <= endLoc;)
 			{
@@ -113,7 +154,7 @@ namespace TraceviewerServer
 			// the data is too big: try to fit the "big" data into the display
 
 			//fills in the rest of the data for this process timeline
-			sampleTimeLine(startLoc, endLoc, 0, numPixelsH, 0, pixelLength, timeStart);
+			sampleTimeLine(startLoc, endLoc, pixelLength, timeStart);
 		}
 		// --------------------------------------------------------------------------------------------------
 		// get the last data if necessary: the rightmost time is still less then the upper limit
@@ -121,54 +162,121 @@ namespace TraceviewerServer
 		// --------------------------------------------------------------------------------------------------
 		if (endLoc < maxloc)
 		{
-			 TimeCPID dataLast = getData(endLoc);
-			addSample(listCPID->size(), dataLast);
+			listCPID->push_back(getData(endLoc));
 		}
 
-		// --------------------------------------------------------------------------------------------------
-		// get the first data if necessary: the leftmost time is still bigger than the lower limit
-		//	similarly, we add to the list
-		// --------------------------------------------------------------------------------------------------
-		if (startLoc > minloc)
+		postProcess();
+	}
+
+	/*********************************************************************************
+	 *	Finds the locations of the first and last records to display between
+	 *	minloc and maxloc, and returns the number of records in between.
+	 ********************************************************************************/
+	Long TraceDataByRank::findRange(Time timeStart, Time endTime, FileOffset& startLoc,
+			FileOffset& endLoc)
+	{
+		// get the start location
+		startLoc = findTimeInInterval(timeStart, minloc, maxloc);
+
+		// get the end location
+		endLoc = min(findTimeInInterval(endTime, minloc, maxloc) + SIZE_OF_TRACE_RECORD, maxloc);
+
+		// get the number of records data to display
+		return 1 + getNumberOfRecords(startLoc, endLoc);
+	}
+
+	/*********************************************************************************
+	 *	Looks for the coarsest level of the summary index that still has
+	 *	SummaryIndex::MIN_RECORDS_PER_PIXEL records per pixel in the view. If
+	 *	there is one, minloc and maxloc are switched to it for the rest of getData.
+	 ********************************************************************************/
+	bool TraceDataByRank::useSummaryLevel(Time timeStart, Time endTime, FileOffset& startLoc,
+			FileOffset& endLoc, Long& numRec)
+	{
+		FileOffset recordMinloc = minloc;
+		FileOffset recordMaxloc = maxloc;
+
+		fromSummary = true;
+		for (int level = data->getNumSummaryLevels(rank) - 1; level >= 0; level--)
 		{
-			 TimeCPID dataFirst = getData(startLoc - SIZE_OF_TRACE_RECORD);
-			addSample(0, dataFirst);
+			minloc = data->getSummaryMinLoc(rank, level);
+			maxloc = data->getSummaryMaxLoc(rank, level);
+			numRec = findRange(timeStart, endTime, startLoc, endLoc);
+			if (numRec >= (Long) SummaryIndex::MIN_RECORDS_PER_PIXEL * numPixelsH)
+				return true;
+		}
+		fromSummary = false;
+		minloc = recordMinloc;
+		maxloc = recordMaxloc;
+		return false;
+	}
+
+	/*********************************************************************************
+	 *	Appends every stride-th record of this rank to records, reading the
+	 *	trace once from beginning to end. Used to build the summary index.
+	 ********************************************************************************/
+	void TraceDataByRank::readRecords(Long stride, vector<TimeCPID>* records)
+	{
+		if (maxloc < minloc)
+			return;
+		Long numRecords = 1 + getNumberOfRecords(minloc, maxloc);
+		for (Long i = 0; i < numRecords; i += stride)
+		{
+			records->push_back(getData(getAbsoluteLocation(i)));
 		}
-		postProcess();
 	}
 	/*******************************************************************************************
-	 * Recursive method that fills in times and timeLine with the correct data from the file.
-	 * Takes in two pixel locations as endpoints and finds the timestamp that owns the pixel
-	 * in between these two. It then recursively calls itself twice - once with the beginning
-	 * location and the newfound location as endpoints and once with the newfound location
-	 * and the end location as endpoints. Effectively updates times and timeLine by calculating
-	 * the index in which to insert the next data. This way, it keeps times and timeLine sorted.
-	 * @author Reed Landrum and Michael Franco
-	 * @param minLoc The beginning location in the file to bound the search.
-	 * @param maxLoc The end location in the file to bound the search.
-	 * @param startPixel The beginning pixel in the image that corresponds to minLoc.
-	 * @param endPixel The end pixel in the image that corresponds to maxLoc.
-	 * @param minIndex An index used for calculating the index in which the data is to be inserted.
-	 * @return Returns the index that shows the size of the recursive subtree that has been read.
-	 * Used for calculating the index in which the data is to be inserted.
+	 * Fills in listCPID with one sample for each of the pixels 1 .. numPixelsH-1.
+	 * The pixel owning the middle of an interval is searched between the locations found
+	 * for the two ends of the interval, which then splits in two, as in the recursive
+	 * version by Reed Landrum and Michael Franco. The intervals are processed one level
+	 * at a time and from left to right, so that the probes of each level touch the file
+	 * in increasing address order, and each location is written to its own slot of a
+	 * per-pixel array instead of being inserted in the middle of listCPID.
+	 * @param minLoc The location in the file of pixel 0.
+	 * @param maxLoc The location in the file of pixel numPixelsH.
 	 ******************************************************************************************/
-	int TraceDataByRank::sampleTimeLine(FileOffset minLoc, FileOffset maxLoc, int startPixel,
-			int endPixel, int minIndex, double pixelLength, Time startingTime)
+	void TraceDataByRank::sampleTimeLine(FileOffset minLoc, FileOffset maxLoc,
+			double pixelLength, Time startingTime)
 	{
-		int midPixel = (startPixel + endPixel) / 2;
-		if (midPixel == startPixel)
-			return 0;
-
-		Long loc = findTimeInInterval((long)(midPixel * pixelLength + startingTime), minLoc,
-				maxLoc);
-		 TimeCPID nextData = getData(loc);
-		addSample(minIndex, nextData);
-		int addedLeft = sampleTimeLine(minLoc, loc, startPixel, midPixel, minIndex,
-				pixelLength, startingTime);
-		int addedRight = sampleTimeLine(loc, maxLoc, midPixel, endPixel,
-				minIndex + addedLeft + 1, pixelLength, startingTime);
-
-		return (addedLeft + addedRight + 1);
+		if (numPixelsH < 2)
+			return;
+
+		vector<FileOffset> pixelLoc(numPixelsH + 1);
+		pixelLoc[0] = minLoc;
+		pixelLoc[numPixelsH] = maxLoc;
+
+		// each level holds the interval ends as pairs of pixels, sorted
+		vector<int> level, nextLevel;
+		level.push_back(0);
+		level.push_back(numPixelsH);
+		while (!level.empty())
+		{
+			nextLevel.clear();
+			for (size_t i = 0; i < level.size(); i += 2)
+			{
+				int startPixel = level[i];
+				int endPixel = level[i + 1];
+				int midPixel = (startPixel + endPixel) / 2;
+				if (midPixel == startPixel)
+					continue;
+
+				pixelLoc[midPixel] = findTimeInInterval((long)(midPixel * pixelLength + startingTime),
+						pixelLoc[startPixel], pixelLoc[endPixel]);
+
+				nextLevel.push_back(startPixel);
+				nextLevel.push_back(midPixel);
+				nextLevel.push_back(midPixel);
+				nextLevel.push_back(endPixel);
+			}
+			level.swap(nextLevel);
+		}
+
+		listCPID->reserve(listCPID->size() + numPixelsH + 1);
+		for (int pixel = 1; pixel < numPixelsH; pixel++)
+		{
+			listCPID->push_back(getData(pixelLoc[pixel]));
+		}
 	}
 
 
@@ -190,8 +298,8 @@ namespace TraceviewerServer
 		FileOffset l_index = getRelativeLocation(l_boundOffset);
 		FileOffset r_index = getRelativeLocation(r_boundOffset);
 
-		Time l_time = data->getLong(l_boundOffset);
-		Time r_time = data->getLong(r_boundOffset);
+		Time l_time = getTime(l_boundOffset);
+		Time r_time = getTime(r_boundOffset);
 	
 		// apply "Newton's method" to find target time
 		while (r_index - l_index > 1)
@@ -220,7 +328,7 @@ namespace TraceviewerServer
 			if (predicted_index >= r_index)
 				predicted_index = r_index - 1;
 
-			Time temp = data->getLong(getAbsoluteLocation(predicted_index));
+			Time temp = getTime(getAbsoluteLocation(predicted_index));
 			if (time >= temp)
 			{
 				l_index = predicted_index;
@@ -235,8 +343,8 @@ namespace TraceviewerServer
 		FileOffset l_offset = getAbsoluteLocation(l_index);
 		FileOffset r_offset = getAbsoluteLocation(r_index);
 
-		l_time = data->getLong(l_offset);
-		r_time = data->getLong(r_offset);
+		l_time = getTime(l_offset);
+		r_time = getTime(r_offset);
 
 		int leftDiff = time - l_time;
 		int rightDiff = r_time - time;
@@ -257,27 +365,145 @@ namespace TraceviewerServer
 	{
 		return (absolutePosition - minloc) / SIZE_OF_TRACE_RECORD;
 	}
-	void TraceDataByRank::addSample(unsigned int index, TimeCPID dataCpid)
+	TimeCPID TraceDataByRank::getData(FileOffset location)
 	{
-		if (index == listCPID->size())
+		if (fromSummary)
+			return TimeCPID(data->getSummaryLong(location),
+					data->getSummaryInt(location + SIZEOF_LONG));
+
+		if (compact)
 		{
-			listCPID->push_back(dataCpid);
+			const TimeCPID& rec = getCompactRecord(location);
+			return TimeCPID(toViewerTime(rec.timestamp), rec.cpid);
+		}
+
+		 Time time = getTime(location);
+		 int CPID = data->getInt(location + SIZEOF_LONG);
+		TimeCPID ToReturn(time, CPID);
+		return ToReturn;
+	}
+
+	Time TraceDataByRank::getTime(FileOffset location)
+	{
+		if (fromSummary)
+			return data->getSummaryLong(location);
+		if (compact)
+			return toViewerTime(getCompactRecord(location).timestamp);
+		return toViewerTime(data->getLong(location));
+	}
+
+	/*********************************************************************************
+	 *	Returns a trace record time in microseconds, the unit of the viewer.
+	 *	Cf. hpctrace_fmt_clock_to_ns in lib/prof-lean.
+	 ********************************************************************************/
+	Time TraceDataByRank::toViewerTime(Time time)
+	{
+		if (!clockScaled)
+			return time;
+
+		const Time nsPerSec = 1000000000;
+		Time ns;
+		if (time >= tick0)
+		{
+			Time d = time - tick0;
+			ns = ns0 + (d / ticksPerSec) * nsPerSec + ((d % ticksPerSec) * nsPerSec) / ticksPerSec;
 		}
 		else
 		{
-			vector<TimeCPID>::iterator it = listCPID->begin();
-			it += index;
-			listCPID->insert(it, dataCpid);
+			Time d = tick0 - time;
+			ns = ns0 - (d / ticksPerSec) * nsPerSec - ((d % ticksPerSec) * nsPerSec) / ticksPerSec;
 		}
+		return ns / 1000;
 	}
 
-	TimeCPID TraceDataByRank::getData(FileOffset location)
+	/*********************************************************************************
+	 *	Builds the block index of a compact trace by hopping from block header to
+	 *	block header, and sets maxloc to the virtual location of the last record.
+	 * @param end: the end of this rank's data in the file
+	 ********************************************************************************/
+	void TraceDataByRank::indexCompactBlocks(FileOffset end)
 	{
+		Long numRecords = 0;
+		FileOffset pos = minloc;
+		while (pos + TRACE_BLOCK_HEADER_SIZE <= end)
+		{
+			CompactBlock blk;
+			blk.payload = pos + TRACE_BLOCK_HEADER_SIZE;
+			blk.size = data->getInt(pos + SIZEOF_LONG);
+			int count = data->getInt(pos + SIZEOF_LONG + SIZEOF_INT);
+			if (blk.size <= 0 || blk.size > TRACE_BLOCK_MAX_SIZE || count <= 0
+					|| blk.payload + blk.size > end)
+				break; // truncated trace
+			blk.firstRecord = numRecords;
+			blocks.push_back(blk);
+			numRecords += count;
+			pos = blk.payload + blk.size;
+		}
+		maxloc = getAbsoluteLocation(numRecords) - SIZE_OF_TRACE_RECORD;
+	}
 
-		 Time time = data->getLong(location);
-		 int CPID = data->getInt(location + SIZEOF_LONG);
-		TimeCPID ToReturn(time, CPID);
-		return ToReturn;
+	/*********************************************************************************
+	 *	Returns the record at a virtual location of a compact trace, decoding its
+	 *	block unless it is the one decoded last.
+	 ********************************************************************************/
+	const TimeCPID& TraceDataByRank::getCompactRecord(FileOffset location)
+	{
+		Long index = getRelativeLocation(location);
+		if (blocks.empty())
+		{
+			decodedRecords.assign(1, TimeCPID(0, 0));
+			return decodedRecords[0];
+		}
+
+		// the last block whose first record is at or before 'index'
+		int lo = 0, hi = blocks.size() - 1;
+		while (lo < hi)
+		{
+			int mid = (lo + hi + 1) / 2;
+			if (blocks[mid].firstRecord <= index)
+				lo = mid;
+			else
+				hi = mid - 1;
+		}
+
+		if (lo != decodedBlock)
+		{
+			const CompactBlock& blk = blocks[lo];
+			char payload[TRACE_BLOCK_MAX_SIZE];
+			data->getBytes(blk.payload, payload, blk.size);
+
+			decodedRecords.clear();
+			Time time = data->getLong(blk.payload - TRACE_BLOCK_HEADER_SIZE);
+			int pos = 0;
+			int numFields = dataCentric ? 3 : 2;
+			while (pos < blk.size)
+			{
+				uint64_t field[3];
+				for (int f = 0; f < numFields; f++)
+				{
+					// LEB128 varint
+					uint64_t val = 0;
+					int shift = 0;
+					unsigned char byte;
+					do
+					{
+						byte = (pos < blk.size) ? payload[pos++] : 0;
+						val |= ((uint64_t) (byte & 0x7f)) << shift;
+						shift += 7;
+					} while ((byte & 0x80) && shift < 64);
+					field[f] = val;
+				}
+				// zigzag-encoded time delta
+				time += (Long) (field[0] >> 1) ^ -(Long) (field[0] & 1);
+				decodedRecords.push_back(TimeCPID(time, (int) field[1]));
+			}
+			decodedBlock = lo;
+		}
+
+		Long i = index - blocks[lo].firstRecord;
+		if (i >= (Long) decodedRecords.size())
+			i = decodedRecords.size() - 1;
+		return decodedRecords[i];
 	}
 
 	Long TraceDataByRank::getNumberOfRecords(FileOffset start, FileOffset end)
@@ -289,21 +515,15 @@ namespace TraceviewerServer
 	 * Removes unnecessary samples:
 	 ********************************************************************************************/
 
-	void TraceDataByRank::postProcess()
+	static bool sameTime(const TimeCPID& a, const TimeCPID& b)
 	{
-		int len = listCPID->size();
-		for (int i = 0; i < len - 2; i++)
-		{
-
-			while (i < len - 1 && (*listCPID)[i].timestamp == (*listCPID)[i + 1].timestamp)
-			{
-				vector<TimeCPID>::iterator it = listCPID->begin();
-				it += (i + 1);
-				listCPID->erase(it);
-				len--;
-			}
+		return a.timestamp == b.timestamp;
+	}
 
-		}
+	// keeps the first of consecutive samples with the same time, in one pass
+	void TraceDataByRank::postProcess()
+	{
+		listCPID->erase(unique(listCPID->begin(), listCPID->end(), sameTime), listCPID->end());
 	}
 
 	TraceDataByRank::~TraceDataByRank()
@@ -77,8 +77,9 @@ namespace TraceviewerServer
 		virtual ~TraceDataByRank();
 
 		void getData(Time timeStart, Time timeRange, double pixelLength);
-		int sampleTimeLine(FileOffset minLoc, FileOffset maxLoc, int startPixel, int endPixel, int minIndex, double pixelLength, Time startingTime);
+		void sampleTimeLine(FileOffset minLoc, FileOffset maxLoc, double pixelLength, Time startingTime);
 		FileOffset findTimeInInterval(Time time, FileOffset l_boundOffset, FileOffset r_boundOffset);
+		void readRecords(Long stride, vector<TimeCPID>* records);
 
 
 
@@ -91,12 +92,40 @@ namespace TraceviewerServer
 		FileOffset maxloc;
 		int numPixelsH;
 
+		// trace clock calibration from the header of this rank's trace
+		bool clockScaled;
+		Time ticksPerSec;
+		Time tick0;
+		Time ns0;
+
+		// compact traces: the block index and the last decoded block.
+		// Locations are then virtual: minloc + index * SIZE_OF_TRACE_RECORD
+		struct CompactBlock
+		{
+			FileOffset payload;
+			int size;
+			Long firstRecord;
+		};
+		bool compact;
+		bool dataCentric;
+		vector<CompactBlock> blocks;
+		int decodedBlock;
+		vector<TimeCPID> decodedRecords;
+
+		// true while the locations refer to a level of the summary index
+		bool fromSummary;
+
 		FileOffset getAbsoluteLocation(FileOffset);
 
 		FileOffset getRelativeLocation(FileOffset);
-		void addSample(unsigned int, TimeCPID);
 		TimeCPID getData(FileOffset);
+		Time getTime(FileOffset);
+		Time toViewerTime(Time);
+		void indexCompactBlocks(FileOffset end);
+		const TimeCPID& getCompactRecord(FileOffset);
 		Long getNumberOfRecords(FileOffset, FileOffset);
+		Long findRange(Time, Time, FileOffset&, FileOffset&);
+		bool useSummaryLevel(Time, Time, FileOffset&, FileOffset&, Long&);
 		void postProcess();
 	};
 
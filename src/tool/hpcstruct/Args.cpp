@@ -66,6 +66,8 @@ using std::endl;
 #include <string>
 using std::string;
 
+#include <unistd.h>
+
 //*************************** User Include Files ****************************
 
 #include <include/hpctoolkit-config.h>
@@ -121,7 +123,9 @@ Options: Structure recovery\n\
                        Use <path> when resolving source file names. For a\n\
                        recursive search, append a '*' after the last slash,\n\
                        e.g., '/mypath/*' (quote or escape to protect from\n\
-                       the shell.) May pass multiple times.\n"
+                       the shell.) May pass multiple times.\n\
+  -j <n>, --jobs <n>   Analyze the functions of the binary with <n> threads.\n\
+                       Use all online processors if <n> is 0. {1}\n"
 
 #if 0
   --loop-intvl <yes|no>\n\
@@ -203,6 +207,8 @@ CmdLineParser::OptArgDesc Args::optArgs[] = {
      NULL},
   {  0 , "show-gaps",       CLP::ARG_NONE, CLP::DUPOPT_CLOB, NULL,
      NULL },
+  { 'j', "jobs",            CLP::ARG_REQ,  CLP::DUPOPT_CLOB, NULL,
+     NULL },
 
   // Output options
   { 'o', "output",          CLP::ARG_REQ , CLP::DUPOPT_CLOB, NULL,
@@ -258,6 +264,7 @@ Args::Ctor()
   prettyPrintOutput = true;
   useBinutils = false;
   show_gaps = false;
+  numThreads = 1;
 }
 
 
@@ -389,6 +396,17 @@ Args::parse(int argc, const char* const argv[])
     if (parser.isOpt("show-gaps")) {
       show_gaps = true;
     }
+    if (parser.isOpt("jobs")) {
+      const string& arg = parser.getOptArg("jobs");
+      long num = CmdLineParser::toLong(arg);
+      if (num < 0) {
+	ARG_ERROR("--jobs/-j option: the number of threads must not be negative");
+      }
+      if (num == 0) {
+	num = sysconf(_SC_NPROCESSORS_ONLN);
+      }
+      numThreads = (num > 0) ? (int)num : 1;
+    }
 
     // Instruction decoder options
     useBinutils = parser.isOpt("use-binutils");
@@ -122,6 +122,7 @@ public:
   bool prettyPrintOutput;         // default: true
   bool useBinutils;		  // default: false
   bool show_gaps;                 // default: false
+  int numThreads;                 // default: 1
 
   // Parsed Data: arguments
   std::string in_filenm;
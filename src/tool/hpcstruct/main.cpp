@@ -214,7 +214,7 @@ realmain(int argc, char* argv[])
   }
 
   BAnal::Struct::makeStructure(loadModule, outFile, gapsFile, gapsName,
-			       ourDemangle, procNameMgr);
+			       ourDemangle, procNameMgr, args.numThreads);
 
   IOUtil::CloseStream(outFile);
   delete[] outBuf;
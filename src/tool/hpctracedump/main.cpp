@@ -103,11 +103,19 @@ main(int argc, char **argv)
     exit(-1);
   }
 
+  hpctrace_fmt_block_t blk;
+  hpctrace_fmt_block_init(&blk);
+
   // read and dump trace records until EOF 
   while ( !feof(infs) ) {
     hpctrace_fmt_datum_t datum;
 
-    ret = hpctrace_fmt_datum_fread(&datum, hdr.flags, infs);
+    if (hdr.flags.fields.isCompact) {
+      ret = hpctrace_fmt_block_datum_fread(&datum, hdr.flags, &blk, infs);
+    }
+    else {
+      ret = hpctrace_fmt_datum_fread(&datum, hdr.flags, infs);
+    }
 
     if (ret == HPCFMT_EOF) {
       break;